@@ -0,0 +1,346 @@
+/*
+    Drawing benchmark tool
+    ----------------------
+
+    Benchmarks the immediate-mode drawing primitives (`fill_rect`, `hline`, `vline`, `line`, `circle`, `blit_raw` and
+    `blit_masked`) against naive loops which write one pixel at a time through a bounds-checked putpixel. Before
+    timing, each primitive is run on a set of random cases, many of them partly or fully off screen, and its output is
+    compared with that of the naive version, so it can be used both as a benchmark and as a regression test for the
+    clipping. Any mismatch is reported and makes the tool exit with a failure code.
+
+    Run it from the `runtime` folder:
+
+        drawbench           runs the checks and the benchmarks
+        drawbench 10        runs ten times as many iterations of each benchmark, for more stable timings
+
+    No window or audio device is opened. Everything is drawn to the screen buffer of a pixie instance created on the
+    calling thread, which is never presented.
+*/
+
+#define PIXIE_NO_MAIN
+#include "pixie.h"
+
+#define PIXIE_IMPLEMENTATION
+#include "pixie.h"
+
+
+// Number of random cases each primitive is checked against the naive version with
+#define DRAWBENCH_CHECK_CASES 5000
+
+// Number of random cases which are timed for each primitive, repeated for the number of iterations
+#define DRAWBENCH_BENCH_CASES 1000
+
+// Size of the image used for the blits. The mask is a filled circle, so both the skip and copy paths are used
+#define DRAWBENCH_BLIT_SIZE 128
+
+
+typedef struct drawbench_t {
+    u8* pixels; // Screen buffer of the pixie instance
+    int width;
+    int height;
+    u32 seed; // State of the random generator, so every run uses the same cases
+    u8 blit_pixels[ DRAWBENCH_BLIT_SIZE * DRAWBENCH_BLIT_SIZE ];
+    u8 blit_mask[ DRAWBENCH_BLIT_SIZE * DRAWBENCH_BLIT_SIZE ];
+} drawbench_t;
+
+
+// Random number in the range [min, max), from a simple LCG so the cases don't depend on the C library
+
+static int drawbench_random( drawbench_t* bench, int min, int max ) {
+    bench->seed = bench->seed * 1664525u + 1013904223u;
+    return min + (int)( ( bench->seed >> 8 ) % (u32)( max - min ) );
+}
+
+
+static void drawbench_putpixel( drawbench_t* bench, int x, int y, int color ) {
+    if( x >= 0 && y >= 0 && x < bench->width && y < bench->height ) bench->pixels[ x + y * bench->width ] = (u8) color;
+}
+
+
+// The naive versions of each primitive, writing every pixel through `drawbench_putpixel`
+
+static void drawbench_naive_fill_rect( drawbench_t* bench, int x, int y, int width, int height, int color ) {
+    for( int iy = 0; iy < height; ++iy ) {
+        for( int ix = 0; ix < width; ++ix ) drawbench_putpixel( bench, x + ix, y + iy, color );
+    }
+}
+
+
+static void drawbench_naive_hline( drawbench_t* bench, int x, int y, int length, int color ) {
+    for( int i = 0; i < length; ++i ) drawbench_putpixel( bench, x + i, y, color );
+}
+
+
+static void drawbench_naive_vline( drawbench_t* bench, int x, int y, int length, int color ) {
+    for( int i = 0; i < length; ++i ) drawbench_putpixel( bench, x, y + i, color );
+}
+
+
+// Steps along the major axis, rounding the minor axis position the same way Bresenham's algorithm does
+
+static void drawbench_naive_line( drawbench_t* bench, int x1, int y1, int x2, int y2, int color ) {
+    int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int dy = y2 > y1 ? y2 - y1 : y1 - y2;
+    int sx = x2 >= x1 ? 1 : -1;
+    int sy = y2 >= y1 ? 1 : -1;
+    if( dx >= dy ) {
+        for( int i = 0; i <= dx; ++i ) {
+            int minor = dx ? (int)( ( 2 * (i64) i * dy + dx ) / ( 2 * (i64) dx ) ) : 0;
+            drawbench_putpixel( bench, x1 + sx * i, y1 + sy * minor, color );
+        }
+    } else {
+        for( int i = 0; i <= dy; ++i ) {
+            int minor = (int)( ( 2 * (i64) i * dx + dy ) / ( 2 * (i64) dy ) );
+            drawbench_putpixel( bench, x1 + sx * minor, y1 + sy * i, color );
+        }
+    }
+}
+
+
+static void drawbench_naive_circle( drawbench_t* bench, int x, int y, int radius, int color ) {
+    int px = radius;
+    int py = 0;
+    int error = 1 - radius;
+    while( px >= py ) {
+        drawbench_putpixel( bench, x + px, y + py, color );
+        drawbench_putpixel( bench, x - px, y + py, color );
+        drawbench_putpixel( bench, x + px, y - py, color );
+        drawbench_putpixel( bench, x - px, y - py, color );
+        drawbench_putpixel( bench, x + py, y + px, color );
+        drawbench_putpixel( bench, x - py, y + px, color );
+        drawbench_putpixel( bench, x + py, y - px, color );
+        drawbench_putpixel( bench, x - py, y - px, color );
+        ++py;
+        if( error < 0 ) {
+            error += 2 * py + 1;
+        } else {
+            --px;
+            error += 2 * ( py - px ) + 1;
+        }
+    }
+}
+
+
+static void drawbench_naive_blit( drawbench_t* bench, int x, int y, u8 const* pixels, u8 const* mask, int width,
+    int height ) {
+
+    for( int iy = 0; iy < height; ++iy ) {
+        for( int ix = 0; ix < width; ++ix ) {
+            if( !mask || mask[ ix + iy * width ] ) {
+                drawbench_putpixel( bench, x + ix, y + iy, pixels[ ix + iy * width ] );
+            }
+        }
+    }
+}
+
+
+// One call to a primitive, with random parameters. `a` to `d` are coordinates and sizes, interpreted per primitive.
+
+typedef enum drawbench_primitive_t {
+    DRAWBENCH_FILL_RECT,
+    DRAWBENCH_HLINE,
+    DRAWBENCH_VLINE,
+    DRAWBENCH_LINE,
+    DRAWBENCH_CIRCLE,
+    DRAWBENCH_BLIT_RAW,
+    DRAWBENCH_BLIT_MASKED,
+    DRAWBENCH_PRIMITIVE_COUNT,
+} drawbench_primitive_t;
+
+typedef struct drawbench_case_t { int a, b, c, d, color; } drawbench_case_t;
+
+
+static char const* drawbench_primitive_name( drawbench_primitive_t primitive ) {
+    switch( primitive ) {
+        case DRAWBENCH_FILL_RECT: return "fill_rect";
+        case DRAWBENCH_HLINE: return "hline";
+        case DRAWBENCH_VLINE: return "vline";
+        case DRAWBENCH_LINE: return "line";
+        case DRAWBENCH_CIRCLE: return "circle";
+        case DRAWBENCH_BLIT_RAW: return "blit_raw";
+        case DRAWBENCH_BLIT_MASKED: return "blit_masked";
+        default: return "";
+    }
+}
+
+
+// Positions are picked from an area extending one screen beyond each edge, so about a third of the cases are
+// clipped on each axis. Sizes include zero and negative values, which should draw nothing.
+
+static drawbench_case_t drawbench_random_case( drawbench_t* bench, drawbench_primitive_t primitive ) {
+    int w = bench->width;
+    int h = bench->height;
+    drawbench_case_t c;
+    c.color = drawbench_random( bench, 1, 256 );
+    switch( primitive ) {
+        case DRAWBENCH_FILL_RECT:
+        case DRAWBENCH_HLINE:
+        case DRAWBENCH_VLINE:
+            c.a = drawbench_random( bench, -w, 2 * w );
+            c.b = drawbench_random( bench, -h, 2 * h );
+            c.c = drawbench_random( bench, -8, w );
+            c.d = drawbench_random( bench, -8, h );
+            break;
+        case DRAWBENCH_LINE:
+            c.a = drawbench_random( bench, -w, 2 * w );
+            c.b = drawbench_random( bench, -h, 2 * h );
+            c.c = drawbench_random( bench, -w, 2 * w );
+            c.d = drawbench_random( bench, -h, 2 * h );
+            break;
+        case DRAWBENCH_CIRCLE:
+            c.a = drawbench_random( bench, -w / 2, w + w / 2 );
+            c.b = drawbench_random( bench, -h / 2, h + h / 2 );
+            c.c = drawbench_random( bench, 0, h );
+            c.d = 0;
+            break;
+        default: // Blits draw the top `d` rows of the blit image, as the width is also the pitch of the image
+            c.a = drawbench_random( bench, -DRAWBENCH_BLIT_SIZE, w );
+            c.b = drawbench_random( bench, -DRAWBENCH_BLIT_SIZE, h );
+            c.c = DRAWBENCH_BLIT_SIZE;
+            c.d = drawbench_random( bench, 1, DRAWBENCH_BLIT_SIZE + 1 );
+            break;
+    }
+    return c;
+}
+
+
+// Draws one case with either the pixie primitive or the naive version
+
+static void drawbench_draw( drawbench_t* bench, drawbench_primitive_t primitive, drawbench_case_t const* c,
+    int naive ) {
+
+    switch( primitive ) {
+        case DRAWBENCH_FILL_RECT:
+            if( naive ) drawbench_naive_fill_rect( bench, c->a, c->b, c->c, c->d, c->color );
+            else fill_rect( c->a, c->b, c->c, c->d, c->color );
+            break;
+        case DRAWBENCH_HLINE:
+            if( naive ) drawbench_naive_hline( bench, c->a, c->b, c->c, c->color );
+            else hline( c->a, c->b, c->c, c->color );
+            break;
+        case DRAWBENCH_VLINE:
+            if( naive ) drawbench_naive_vline( bench, c->a, c->b, c->d, c->color );
+            else vline( c->a, c->b, c->d, c->color );
+            break;
+        case DRAWBENCH_LINE:
+            if( naive ) drawbench_naive_line( bench, c->a, c->b, c->c, c->d, c->color );
+            else line( c->a, c->b, c->c, c->d, c->color );
+            break;
+        case DRAWBENCH_CIRCLE:
+            if( naive ) drawbench_naive_circle( bench, c->a, c->b, c->c, c->color );
+            else circle( c->a, c->b, c->c, c->color );
+            break;
+        case DRAWBENCH_BLIT_RAW:
+            if( naive ) drawbench_naive_blit( bench, c->a, c->b, bench->blit_pixels, NULL, c->c, c->d );
+            else blit_raw( c->a, c->b, bench->blit_pixels, c->c, c->d );
+            break;
+        case DRAWBENCH_BLIT_MASKED:
+            if( naive ) drawbench_naive_blit( bench, c->a, c->b, bench->blit_pixels, bench->blit_mask, c->c, c->d );
+            else blit_masked( c->a, c->b, bench->blit_pixels, bench->blit_mask, c->c, c->d );
+            break;
+        default:
+            break;
+    }
+}
+
+
+// Draws random cases with both versions, returning the number of cases where the screen contents differ
+
+static int drawbench_check( drawbench_t* bench, drawbench_primitive_t primitive, u8* reference ) {
+    size_t size = sizeof( u8 ) * bench->width * bench->height;
+    int mismatches = 0;
+    for( int i = 0; i < DRAWBENCH_CHECK_CASES; ++i ) {
+        drawbench_case_t c = drawbench_random_case( bench, primitive );
+        memset( bench->pixels, 0, size );
+        drawbench_draw( bench, primitive, &c, 0 );
+        memcpy( reference, bench->pixels, size );
+        memset( bench->pixels, 0, size );
+        drawbench_draw( bench, primitive, &c, 1 );
+        if( memcmp( reference, bench->pixels, size ) != 0 ) {
+            if( mismatches == 0 ) {
+                printf( "%s mismatch: %d, %d, %d, %d, color %d\n", drawbench_primitive_name( primitive ), c.a, c.b,
+                    c.c, c.d, c.color );
+            }
+            ++mismatches;
+        }
+    }
+    return mismatches;
+}
+
+
+// Returns the total time taken to draw all the cases `iterations` times, with either version
+
+static u64 drawbench_time( drawbench_t* bench, drawbench_primitive_t primitive, drawbench_case_t const* cases,
+    int iterations, int naive ) {
+
+    u64 start = app_time_count( NULL );
+    for( int i = 0; i < iterations; ++i ) {
+        for( int j = 0; j < DRAWBENCH_BENCH_CASES; ++j ) drawbench_draw( bench, primitive, &cases[ j ], naive );
+    }
+    return app_time_count( NULL ) - start;
+}
+
+
+int main( int argc, char** argv ) {
+    int iterations = argc > 1 ? atoi( argv[ 1 ] ) : 1;
+    iterations = iterations > 0 ? iterations : 1;
+
+    // Create a pixie instance for this thread, the same way `internal_pixie_user_thread` does, but without starting
+    // the app thread - nothing is presented, so only the user thread state is needed
+    internal_pixie_t* pixie = internal_pixie_create( 1024, 44100 );
+    thread_tls_t pixie_tls = thread_tls_create();
+    if( thread_atomic_ptr_compare_and_swap( &g_internal_pixie_tls, NULL, pixie_tls ) ) thread_tls_destroy( pixie_tls );
+    thread_tls_set( thread_atomic_ptr_load( &g_internal_pixie_tls ), pixie );
+
+    drawbench_t* bench = (drawbench_t*) malloc( sizeof( drawbench_t ) );
+    bench->pixels = pixie->user_thread.screen.pixels;
+    bench->width = pixie->user_thread.screen.screen_width;
+    bench->height = pixie->user_thread.screen.screen_height;
+    bench->seed = 0x5eed;
+    for( int y = 0; y < DRAWBENCH_BLIT_SIZE; ++y ) {
+        for( int x = 0; x < DRAWBENCH_BLIT_SIZE; ++x ) {
+            int dx = x - DRAWBENCH_BLIT_SIZE / 2;
+            int dy = y - DRAWBENCH_BLIT_SIZE / 2;
+            int radius = DRAWBENCH_BLIT_SIZE / 2 - 4;
+            bench->blit_pixels[ x + y * DRAWBENCH_BLIT_SIZE ] = (u8)( 1 + ( x + y ) % 255 );
+            bench->blit_mask[ x + y * DRAWBENCH_BLIT_SIZE ] = dx * dx + dy * dy < radius * radius ? 255 : 0;
+        }
+    }
+
+    printf( "Screen %dx%d, %d cases checked and %d timed per primitive, %d iteration%s\n\n", bench->width,
+        bench->height, DRAWBENCH_CHECK_CASES, DRAWBENCH_BENCH_CASES, iterations, iterations == 1 ? "" : "s" );
+    printf( "Primitive      Pixie (us)   Naive (us)   Speedup   Mismatches\n" );
+
+    u8* reference = (u8*) malloc( sizeof( u8 ) * bench->width * bench->height );
+    drawbench_case_t* cases = (drawbench_case_t*) malloc( sizeof( drawbench_case_t ) * DRAWBENCH_BENCH_CASES );
+    u64 const freq = app_time_count( NULL ) ? app_time_freq( NULL ) : 0;
+    int total_mismatches = 0;
+    for( int p = 0; p < DRAWBENCH_PRIMITIVE_COUNT; ++p ) {
+        drawbench_primitive_t primitive = (drawbench_primitive_t) p;
+        int mismatches = drawbench_check( bench, primitive, reference );
+        total_mismatches += mismatches;
+
+        for( int i = 0; i < DRAWBENCH_BENCH_CASES; ++i ) cases[ i ] = drawbench_random_case( bench, primitive );
+        u64 pixie_time = drawbench_time( bench, primitive, cases, iterations, 0 );
+        u64 naive_time = drawbench_time( bench, primitive, cases, iterations, 1 );
+
+        double calls = (double) DRAWBENCH_BENCH_CASES * iterations;
+        double pixie_us = freq ? ( pixie_time * 1000000.0 ) / ( freq * calls ) : 0.0;
+        double naive_us = freq ? ( naive_time * 1000000.0 ) / ( freq * calls ) : 0.0;
+        printf( "%-14s %10.3f   %10.3f   %6.1fx   %10d\n", drawbench_primitive_name( primitive ), pixie_us, naive_us,
+            pixie_us > 0.0 ? naive_us / pixie_us : 0.0, mismatches );
+    }
+    printf( "\nTimes are the average per call, over random cases which are partly or fully clipped\n" );
+
+    free( cases );
+    free( reference );
+    free( bench );
+    internal_pixie_destroy( pixie );
+    thread_tls_set( thread_atomic_ptr_load( &g_internal_pixie_tls ), NULL );
+
+    if( total_mismatches > 0 ) {
+        printf( "%d mismatches in total\n", total_mismatches );
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
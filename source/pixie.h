@@ -14,6 +14,8 @@
 //#define PIXIE_WIN_SDL
 //#define PIXIE_ASSERT_IN_RELEASE_BUILD
 //#define PIXIE_MAX_STRING_LENGTH 256
+//#define PIXIE_SONG_WORKERS 4
+//#define PIXIE_NO_SIMD
 
 //#define _CRT_NONSTDC_NO_DEPRECATE 
 //#define _CRT_SECURE_NO_WARNINGS
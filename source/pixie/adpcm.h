@@ -0,0 +1,210 @@
+/*
+------------------------------------------------------------------------------
+          Licensing information can be found at the end of the file.
+------------------------------------------------------------------------------
+
+adpcm.h - IMA ADPCM encoding/decoding of 16-bit audio in self-contained blocks, for C/C++.
+Written for pixie, and licensed under the same terms as pixie.h.
+
+Do this:
+    #define ADPCM_IMPLEMENTATION
+before you include this file in *one* C/C++ file to create the implementation.
+*/
+
+#ifndef adpcm_h
+#define adpcm_h
+
+#ifndef ADPCM_U8
+    #define ADPCM_U8 unsigned char
+#endif
+#ifndef ADPCM_I16
+    #define ADPCM_I16 short
+#endif
+
+// Each block starts with a 4 byte header per channel (initial sample and step index), which means every block can be
+// decoded on its own, without knowing anything about the blocks before it. The header holds the first sample of the
+// block, and the remaining `samples_per_block - 1` samples are stored as 4-bit codes, interleaved per channel, so
+// `samples_per_block` should be odd for mono data.
+
+int adpcm_block_size( int channels, int samples_per_block );
+
+void adpcm_encode_block( ADPCM_I16 const* samples, int samples_count, int channels, int samples_per_block,
+    int* step_indices, ADPCM_U8* block );
+
+void adpcm_decode_block( ADPCM_U8 const* block, int channels, int samples_per_block, ADPCM_I16* samples );
+
+// Reads only the first sample frame of a block, straight from its header, without decoding the rest of it.
+void adpcm_block_first_frame( ADPCM_U8 const* block, int channels, ADPCM_I16* samples );
+
+#endif /* adpcm_h */
+
+
+/*
+----------------------
+    IMPLEMENTATION
+----------------------
+*/
+
+#ifdef ADPCM_IMPLEMENTATION
+#undef ADPCM_IMPLEMENTATION
+
+
+static int const adpcm_index_table[ 16 ] = { -1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8 };
+
+static int const adpcm_step_table[ 89 ] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45, 50, 55, 60, 66, 73, 80, 88, 97, 107,
+    118, 130, 143, 157, 173, 190, 209, 230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894,
+    6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+    32767
+};
+
+
+// Applies a 4-bit code to the predictor/step index pair - shared by the encoder and decoder, so the encoder tracks
+// exactly the same state as the decoder will see.
+
+static int adpcm_step( int code, int* predictor, int* step_index ) {
+    int step = adpcm_step_table[ *step_index ];
+    int diff = step >> 3;
+    if( code & 4 ) diff += step;
+    if( code & 2 ) diff += step >> 1;
+    if( code & 1 ) diff += step >> 2;
+    int value = ( code & 8 ) ? *predictor - diff : *predictor + diff;
+    value = value > 32767 ? 32767 : value < -32768 ? -32768 : value;
+    *predictor = value;
+    int index = *step_index + adpcm_index_table[ code ];
+    *step_index = index < 0 ? 0 : index > 88 ? 88 : index;
+    return value;
+}
+
+
+int adpcm_block_size( int channels, int samples_per_block ) {
+    return channels * 4 + ( ( samples_per_block - 1 ) * channels + 1 ) / 2;
+}
+
+
+void adpcm_encode_block( ADPCM_I16 const* samples, int samples_count, int channels, int samples_per_block,
+    int* step_indices, ADPCM_U8* block ) {
+
+    int predictors[ 8 ];
+    for( int c = 0; c < channels; ++c ) {
+        int first = samples_count > 0 ? samples[ c ] : 0;
+        predictors[ c ] = first;
+        block[ c * 4 + 0 ] = (ADPCM_U8)( first & 0xff );
+        block[ c * 4 + 1 ] = (ADPCM_U8)( ( first >> 8 ) & 0xff );
+        block[ c * 4 + 2 ] = (ADPCM_U8)( step_indices[ c ] );
+        block[ c * 4 + 3 ] = 0;
+    }
+
+    ADPCM_U8* codes = block + channels * 4;
+    int code_count = ( samples_per_block - 1 ) * channels;
+    for( int i = 0; i < ( code_count + 1 ) / 2; ++i ) codes[ i ] = 0;
+
+    for( int i = 1; i < samples_per_block; ++i ) {
+        for( int c = 0; c < channels; ++c ) {
+            // Past the end of the input, we keep repeating the last sample, which encodes to near silent codes
+            int source = i < samples_count ? i : samples_count - 1;
+            int sample = source >= 0 ? samples[ source * channels + c ] : 0;
+            int diff = sample - predictors[ c ];
+            int code = 0;
+            if( diff < 0 ) { code = 8; diff = -diff; }
+            int step = adpcm_step_table[ step_indices[ c ] ];
+            if( diff >= step ) { code |= 4; diff -= step; }
+            step >>= 1;
+            if( diff >= step ) { code |= 2; diff -= step; }
+            step >>= 1;
+            if( diff >= step ) { code |= 1; }
+            adpcm_step( code, &predictors[ c ], &step_indices[ c ] );
+
+            int n = ( i - 1 ) * channels + c;
+            codes[ n >> 1 ] |= (ADPCM_U8)( ( n & 1 ) ? code << 4 : code );
+        }
+    }
+}
+
+
+void adpcm_decode_block( ADPCM_U8 const* block, int channels, int samples_per_block, ADPCM_I16* samples ) {
+    int predictors[ 8 ];
+    int step_indices[ 8 ];
+    for( int c = 0; c < channels; ++c ) {
+        predictors[ c ] = (ADPCM_I16)( block[ c * 4 + 0 ] | ( block[ c * 4 + 1 ] << 8 ) );
+        step_indices[ c ] = block[ c * 4 + 2 ] > 88 ? 88 : block[ c * 4 + 2 ];
+        samples[ c ] = (ADPCM_I16) predictors[ c ];
+    }
+
+    ADPCM_U8 const* codes = block + channels * 4;
+    int n = 0;
+    for( int i = 1; i < samples_per_block; ++i ) {
+        for( int c = 0; c < channels; ++c, ++n ) {
+            int code = ( n & 1 ) ? codes[ n >> 1 ] >> 4 : codes[ n >> 1 ] & 0x0f;
+            samples[ i * channels + c ] = (ADPCM_I16) adpcm_step( code, &predictors[ c ], &step_indices[ c ] );
+        }
+    }
+}
+
+
+void adpcm_block_first_frame( ADPCM_U8 const* block, int channels, ADPCM_I16* samples ) {
+    for( int c = 0; c < channels; ++c ) {
+        samples[ c ] = (ADPCM_I16)( block[ c * 4 + 0 ] | ( block[ c * 4 + 1 ] << 8 ) );
+    }
+}
+
+
+#endif /* ADPCM_IMPLEMENTATION */
+
+
+/*
+------------------------------------------------------------------------------
+
+This software is available under 2 licenses - you may choose the one you like.
+
+------------------------------------------------------------------------------
+
+ALTERNATIVE A - MIT License
+
+Copyright (c) 2026 The pixie contributors
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of
+this software and associated documentation files (the "Software"), to deal in
+the Software without restriction, including without limitation the rights to
+use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies
+of the Software, and to permit persons to whom the Software is furnished to do
+so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+
+------------------------------------------------------------------------------
+
+ALTERNATIVE B - Public Domain (www.unlicense.org)
+
+This is free and unencumbered software released into the public domain.
+
+Anyone is free to copy, modify, publish, use, compile, sell, or distribute this
+software, either in source code form or as a compiled binary, for any purpose,
+commercial or non-commercial, and by any means.
+
+In jurisdictions that recognize copyright laws, the author or authors of this
+software dedicate any and all copyright interest in the software to the public
+domain. We make this dedication for the benefit of the public at large and to
+the detriment of our heirs and successors. We intend this dedication to be an
+overt act of relinquishment in perpetuity of all present and future rights to
+this software under copyright law.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+------------------------------------------------------------------------------
+*/
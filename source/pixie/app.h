@@ -88,6 +88,7 @@ void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height,
 void app_sound( app_t* app, int sample_pairs_count,
     void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data );
 void app_sound_volume( app_t* app, float volume );
+int app_sound_sample_rate( app_t* app );
 
 typedef enum app_key_t { APP_KEY_INVALID, APP_KEY_LBUTTON, APP_KEY_RBUTTON, APP_KEY_CANCEL, APP_KEY_MBUTTON,
     APP_KEY_XBUTTON1, APP_KEY_XBUTTON2, APP_KEY_BACK, APP_KEY_TAB, APP_KEY_CLEAR, APP_KEY_RETURN, APP_KEY_SHIFT,
@@ -630,6 +631,16 @@ app_sound_volume
 Sets the output volume level of the sound stream, as a normalized linear value in the range 0.0f to 1.0f, inclusive.
 
 
+app_sound_sample_rate
+---------------------
+
+    int app_sound_sample_rate( app_t* app )
+
+Returns the sample rate, in samples per second, of the sound stream. The rate is decided by the sound device when the
+stream is started with `app_sound`, and the sound callback should render samples at this rate. Before any stream has
+been started, the preferred rate of 44100 is returned.
+
+
 app_input
 ---------
 
@@ -1142,6 +1153,7 @@ app_displays_t app_displays( app_t* app ) { app_displays_t ret = { 0 }; return r
 void app_present( app_t* app, APP_U32 const* pixels_xbgr, int width, int height, APP_U32 mod_xbgr, APP_U32 border_xbgr ) { }
 void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ), void* user_data ) { }
 void app_sound_volume( app_t* app, float volume ) { }
+int app_sound_sample_rate( app_t* app ) { (void) app; return 44100; }
 app_input_t app_input( app_t* app ) { app_input_t ret = { 0 }; return ret; }
 void app_coordinates_window_to_bitmap( app_t* app, int width, int height, int* x, int* y ) { }
 void app_coordinates_bitmap_to_window( app_t* app, int width, int height, int* x, int* y );
@@ -3194,6 +3206,13 @@ void app_sound_volume( app_t* app, float volume )
     }
 
 
+int app_sound_sample_rate( app_t* app )
+    {
+    (void) app;
+    return 44100; // The sound buffer is always created with this rate, and DirectSound converts it as needed
+    }
+
+
 app_input_t app_input( app_t* app )
     {
     app_input_t input;
@@ -3341,6 +3360,7 @@ struct app_t
     void (*sound_callback)( APP_S16* sample_pairs, int sample_pairs_count, void* user_data );
     void* sound_user_data;
     int volume;
+    int sound_sample_rate;
 
     app_input_event_t input_events[ 1024 ];
     int input_count;
@@ -3383,6 +3403,7 @@ int app_run( int (*app_proc)( app_t*, void* ), void* user_data, void* memctx, vo
     SDL_HideWindow( app->window );
     app->has_focus = 1;
     app->volume = 256;
+    app->sound_sample_rate = 44100;
 
     int display_count = SDL_GetNumVideoDisplays();
     for( int i = 0; i < display_count; ++i )
@@ -3898,8 +3919,11 @@ void app_sound( app_t* app, int sample_pairs_count, void (*sound_callback)( APP_
         spec.callback = app_internal_sdl_sound_callback;
         spec.userdata = app;
 
-        app->sound_device = SDL_OpenAudioDevice( NULL, 0, &spec, NULL, 0 );
+        // Let the device pick its native rate (typically 48000 on Linux), to avoid resampling it down the line
+        SDL_AudioSpec obtained;
+        app->sound_device = SDL_OpenAudioDevice( NULL, 0, &spec, &obtained, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE );
         if( !app->sound_device ) return;
+        app->sound_sample_rate = obtained.freq;
 
         app->sound_callback = sound_callback;
         app->sound_user_data = user_data;
@@ -3915,6 +3939,12 @@ void app_sound_volume( app_t* app, float volume )
     }
 
 
+int app_sound_sample_rate( app_t* app )
+    {
+    return app->sound_sample_rate;
+    }
+
+
 app_input_t app_input( app_t* app )
     {
     app_input_t input;
@@ -28,6 +28,12 @@ int mid_render_float( mid_t* mid, float* sample_pairs, int sample_pairs_count, t
 
 void mid_skip_leading_silence( mid_t* mid, tsf* sound_font );
 
+void mid_seek( mid_t* mid, unsigned long long sample_pos, tsf* sound_font );
+
+void mid_set_channel_mask( mid_t* mid, unsigned int channel_mask );
+
+void mid_set_output_rate( mid_t* mid, int sample_rate );
+
 #endif /* mid_h */
 
 #ifdef MID_ENABLE_RAW
@@ -53,7 +59,7 @@ void mid_skip_leading_silence( mid_t* mid, tsf* sound_font );
 
 typedef struct mid_event_t
     {
-    MID_U32 delay_us;
+    MID_U64 sample_pos; // Absolute position, in samples at the song's sample rate
     MID_U8 channel;
     MID_U8 type;
     union 
@@ -69,10 +75,52 @@ typedef struct mid_event_t
     } mid_event_t;
 
 
+// Synth state of a channel, as set by the events of the song. Values are 14-bit, as in the midi controllers.
+typedef struct mid_channel_state_t
+    {
+    MID_U16 bank;
+    MID_U16 volume;
+    MID_U16 expression;
+    MID_U16 pan;
+    MID_U16 pitch_wheel;
+    MID_U16 pitch_range;
+    MID_U16 fine_tuning;
+    MID_U16 coarse_tuning;
+    MID_U16 rpn;
+    MID_U16 data;
+    MID_U8 program;
+    MID_U8 flags; // MID_CHANNEL_... flags, for things which should only be restored if the song has set them
+    } mid_channel_state_t;
+
+
+// Snapshot of the synth state at a given position, which makes it possible to seek without replaying the whole song.
+// The channel states (16 of them) followed by the held notes (3 bytes each: channel, note, velocity) are stored at
+// `state_pos` in the keyframe data.
+typedef struct mid_keyframe_t
+    {
+    MID_U64 sample_pos;
+    MID_U64 data_sample_pos; // Position of the event before `event_index`, which its delta is relative to
+    MID_U32 event_index; // First event at or after `sample_pos`
+    MID_U32 data_pos; // Offset of the record for `event_index`
+    MID_U32 state_pos;
+    MID_U32 note_count;
+    } mid_keyframe_t;
+
+
+// Events are stored packed, one record per event: the delta from the previous event in samples (as a varint, 7 bits 
+// per byte with the high bit set on all bytes but the last), a midi status byte (type and channel) and one or two 
+// bytes of data depending on the type.
 typedef struct mid_song_t
     {
     int event_count;
-    mid_event_t* events;
+    int sample_rate;
+    MID_U64 length; // Position of the last event, in samples
+    size_t data_size;
+    MID_U8 const* data;
+    int keyframe_count;
+    mid_keyframe_t const* keyframes;
+    size_t keyframe_data_size;
+    MID_U8 const* keyframe_data;
     } mid_song_t;
 
 
@@ -80,16 +128,22 @@ struct mid_t
     {
     void* memctx;
     mid_song_t song;
+    MID_U8* song_data; // Owned by the mid_t when created through `mid_create`, NULL when using `mid_init_raw`
+    MID_U8* song_keyframes; // As above
     int percussion_preset;
-    MID_U64 playback_accumulated_time_us;
-    int playback_sample_pos;
-    int playback_event_pos;
+    unsigned int channel_mask; // Bit per channel, events on channels not in the mask are skipped
+    int output_sample_rate; // Rate of the synth, which event positions are converted to when playing
+    MID_U64 playback_sample_pos; // In samples at `output_sample_rate`
+    int playback_event_pos; // Index of `playback_next_event`
+    size_t playback_data_pos; // Offset of the record following `playback_next_event`
+    mid_event_t playback_next_event;
     };
 
 int mid_init_raw( mid_t* mid, void const* raw_data, size_t raw_size );
 
 size_t mid_save_raw( mid_t* mid, void* data, size_t capacity ); 
 
+size_t mid_read_event( mid_song_t const* song, size_t data_pos, MID_U64 prev_sample_pos, mid_event_t* event );
 
 #endif /* MID_ENABLE_RAW */
 
@@ -168,7 +222,7 @@ size_t mid_save_raw( mid_t* mid, void* data, size_t capacity );
 
 typedef struct mid_event_t
     {
-    MID_U32 delay_us;
+    MID_U64 sample_pos; // Absolute position, in samples at the song's sample rate
     MID_U8 channel;
     MID_U8 type;
     union 
@@ -184,10 +238,52 @@ typedef struct mid_event_t
     } mid_event_t;
 
 
+// Synth state of a channel, as set by the events of the song. Values are 14-bit, as in the midi controllers.
+typedef struct mid_channel_state_t
+    {
+    MID_U16 bank;
+    MID_U16 volume;
+    MID_U16 expression;
+    MID_U16 pan;
+    MID_U16 pitch_wheel;
+    MID_U16 pitch_range;
+    MID_U16 fine_tuning;
+    MID_U16 coarse_tuning;
+    MID_U16 rpn;
+    MID_U16 data;
+    MID_U8 program;
+    MID_U8 flags; // MID_CHANNEL_... flags, for things which should only be restored if the song has set them
+    } mid_channel_state_t;
+
+
+// Snapshot of the synth state at a given position, which makes it possible to seek without replaying the whole song.
+// The channel states (16 of them) followed by the held notes (3 bytes each: channel, note, velocity) are stored at
+// `state_pos` in the keyframe data.
+typedef struct mid_keyframe_t
+    {
+    MID_U64 sample_pos;
+    MID_U64 data_sample_pos; // Position of the event before `event_index`, which its delta is relative to
+    MID_U32 event_index; // First event at or after `sample_pos`
+    MID_U32 data_pos; // Offset of the record for `event_index`
+    MID_U32 state_pos;
+    MID_U32 note_count;
+    } mid_keyframe_t;
+
+
+// Events are stored packed, one record per event: the delta from the previous event in samples (as a varint, 7 bits 
+// per byte with the high bit set on all bytes but the last), a midi status byte (type and channel) and one or two 
+// bytes of data depending on the type.
 typedef struct mid_song_t
     {
     int event_count;
-    mid_event_t* events;
+    int sample_rate;
+    MID_U64 length; // Position of the last event, in samples
+    size_t data_size;
+    MID_U8 const* data;
+    int keyframe_count;
+    mid_keyframe_t const* keyframes;
+    size_t keyframe_data_size;
+    MID_U8 const* keyframe_data;
     } mid_song_t;
 
 
@@ -195,81 +291,440 @@ struct mid_t
     {
     void* memctx;
     mid_song_t song;
+    MID_U8* song_data; // Owned by the mid_t when created through `mid_create`, NULL when using `mid_init_raw`
+    MID_U8* song_keyframes; // As above
     int percussion_preset;
-    MID_U64 playback_accumulated_time_us;
-    int playback_sample_pos;
-    int playback_event_pos;
+    unsigned int channel_mask; // Bit per channel, events on channels not in the mask are skipped
+    int output_sample_rate; // Rate of the synth, which event positions are converted to when playing
+    MID_U64 playback_sample_pos; // In samples at `output_sample_rate`
+    int playback_event_pos; // Index of `playback_next_event`
+    size_t playback_data_pos; // Offset of the record following `playback_next_event`
+    mid_event_t playback_next_event;
     };
 
+size_t mid_read_event( mid_song_t const* song, size_t data_pos, MID_U64 prev_sample_pos, mid_event_t* event );
 
 #endif /* MID_ENABLE_RAW */
 
 
-mid_t* mid_create( void const* midi_data, size_t midi_size, void* memctx )
+#ifndef MID_SAMPLE_RATE
+    #define MID_SAMPLE_RATE 44100
+#endif
+
+#ifndef MID_KEYFRAME_INTERVAL
+    #define MID_KEYFRAME_INTERVAL 4 // Seconds between keyframes
+#endif
+
+#define MID_CHANNEL_USED 1
+#define MID_CHANNEL_PROGRAM 2
+#define MID_CHANNEL_BANK 4
+
+
+// The raw format is this header, the event records, padding to 8 bytes, the keyframes and finally the keyframe data
+typedef struct mid_raw_header_t
     {
-    tml_message* mid_file = tml_load_memory( midi_data, (int) midi_size );
-    if( !mid_file ) return NULL;
-    int count = 0;
-    tml_message* iter = mid_file;
-    while( iter ) 
+    char id[ 8 ];
+    MID_U32 sample_rate;
+    MID_U32 event_count;
+    MID_U32 data_size;
+    MID_U32 keyframe_count;
+    MID_U64 length;
+    MID_U32 keyframe_data_size;
+    MID_U32 reserved;
+    } mid_raw_header_t;
+
+#define MID_RAW_ID "MIDSONG3"
+
+
+// Full synth state while tracking a song, used when building keyframes and when seeking
+typedef struct mid_state_t
+    {
+    mid_channel_state_t channels[ 16 ];
+    MID_U8 notes[ 16 ][ 128 ]; // Velocity of held notes, 0 if not held
+    } mid_state_t;
+
+
+static int mid_is_supported_event( int type )
+    {
+    return type == TML_PROGRAM_CHANGE || type == TML_NOTE_ON || type == TML_NOTE_OFF || type == TML_PITCH_BEND || 
+        type == TML_CONTROL_CHANGE;
+    }
+
+
+static size_t mid_write_event( MID_U8* out, MID_U64 delta, tml_message const* msg )
+    {
+    size_t size = 0;
+    do
         {
-        if( iter->type == TML_PROGRAM_CHANGE || iter->type == TML_NOTE_ON || iter->type == TML_NOTE_OFF || 
-            iter->type == TML_PITCH_BEND || iter->type == TML_CONTROL_CHANGE )
-            {
-            ++count;
-            }
-        iter = iter->next;
+        MID_U8 byte = (MID_U8)( delta & 0x7f );
+        delta >>= 7;
+        out[ size++ ] = (MID_U8)( delta ? byte | 0x80 : byte );
+        } while( delta );
+
+    out[ size++ ] = (MID_U8)( ( msg->type & 0xf0 ) | ( msg->channel & 0x0f ) );
+    switch( msg->type ) 
+        {
+		case TML_PROGRAM_CHANGE:
+            out[ size++ ] = (MID_U8)( msg->program & 0x7f );
+            break;
+		case TML_NOTE_ON:
+            out[ size++ ] = (MID_U8)( msg->key & 0x7f );
+            out[ size++ ] = (MID_U8)( msg->velocity & 0x7f );
+            break;
+		case TML_NOTE_OFF:
+            out[ size++ ] = (MID_U8)( msg->key & 0x7f );
+            break;
+		case TML_PITCH_BEND:
+            out[ size++ ] = (MID_U8)( msg->pitch_bend & 0x7f );
+            out[ size++ ] = (MID_U8)( ( msg->pitch_bend >> 7 ) & 0x7f );
+            break;
+		case TML_CONTROL_CHANGE:
+            out[ size++ ] = (MID_U8)( msg->control & 0x7f );
+            out[ size++ ] = (MID_U8)( msg->control_value & 0x7f );
+            break;
         }
+    return size;
+    }
+
 
-    mid_event_t* events = (mid_event_t*) malloc( sizeof( mid_event_t ) * count );
-    int events_count = 0;
-    unsigned int time = 0;
-    tml_message* msg = mid_file;
-    while( msg ) 
+// Number of data bytes following the status byte of an event record
+static size_t mid_event_data_size( int type )
+    {
+    switch( type ) 
         {
-        if( msg->type == TML_PROGRAM_CHANGE || msg->type == TML_NOTE_ON || msg->type == TML_NOTE_OFF || 
-            msg->type == TML_PITCH_BEND || msg->type == TML_CONTROL_CHANGE )
+		case TML_PROGRAM_CHANGE:
+		case TML_NOTE_OFF:
+            return 1;
+		case TML_NOTE_ON:
+		case TML_PITCH_BEND:
+		case TML_CONTROL_CHANGE:
+            return 2;
+        }
+    return 0;
+    }
+
+
+// Decodes the record at `data_pos` into `event`, and returns the offset of the record after it. Every read is checked
+// against the size of the song data, and if the record would run past the end, 0 is returned and the song should be 
+// treated as ending there.
+size_t mid_read_event( mid_song_t const* song, size_t data_pos, MID_U64 prev_sample_pos, mid_event_t* event )
+    {
+    MID_U8 const* data = song->data;
+    size_t const end = song->data_size;
+    MID_U64 delta = 0;
+    int shift = 0;
+    MID_U8 byte;
+    do
+        {
+        if( data_pos >= end || shift >= 64 ) return 0;
+        byte = data[ data_pos++ ];
+        delta |= ( (MID_U64)( byte & 0x7f ) ) << shift;
+        shift += 7;
+        } while( byte & 0x80 );
+    event->sample_pos = prev_sample_pos + delta;
+
+    if( data_pos >= end ) return 0;
+    MID_U8 status = data[ data_pos++ ];
+    event->type = (MID_U8)( status & 0xf0 );
+    event->channel = (MID_U8)( status & 0x0f );
+    if( end - data_pos < mid_event_data_size( event->type ) ) return 0;
+    switch( event->type ) 
+        {
+		case TML_PROGRAM_CHANGE:
+            event->data.program_change.program = data[ data_pos++ ];
+            break;
+		case TML_NOTE_ON:
+            event->data.note_on.note = data[ data_pos++ ];
+            event->data.note_on.velocity = data[ data_pos++ ];
+            break;
+		case TML_NOTE_OFF:
+            event->data.note_off.note = data[ data_pos++ ];
+            break;
+		case TML_PITCH_BEND:
+            event->data.pitch_bend.value = (MID_U16)( data[ data_pos ] | ( data[ data_pos + 1 ] << 7 ) );
+            data_pos += 2;
+            break;
+		case TML_CONTROL_CHANGE:
+            event->data.control_change.control = data[ data_pos++ ];
+            event->data.control_change.control_value = data[ data_pos++ ];
+            break;
+        }
+    return data_pos;
+    }
+
+
+static void mid_state_init( mid_state_t* state )
+    {
+    memset( state, 0, sizeof( *state ) );
+    for( int i = 0; i < 16; ++i )
+        {
+        mid_channel_state_t* channel = &state->channels[ i ];
+        channel->volume = channel->expression = 16383;
+        channel->pan = channel->pitch_wheel = channel->fine_tuning = 8192;
+        channel->pitch_range = 2 << 7;
+        channel->coarse_tuning = 64 << 7;
+        channel->rpn = 0xffff;
+        }
+    }
+
+
+// Mirrors what `mid_process_event` will do to the synth, but only records the resulting state 
+static void mid_state_apply( mid_state_t* state, mid_event_t const* event )
+    {
+    mid_channel_state_t* channel = &state->channels[ event->channel ];
+    channel->flags |= MID_CHANNEL_USED;
+    switch( event->type )
+        {
+		case TML_PROGRAM_CHANGE: 
+            channel->program = event->data.program_change.program;
+            channel->flags |= MID_CHANNEL_PROGRAM;
+			break;
+		case TML_NOTE_ON:
+            state->notes[ event->channel ][ event->data.note_on.note ] = event->data.note_on.velocity;
+			break;
+		case TML_NOTE_OFF:
+            state->notes[ event->channel ][ event->data.note_off.note ] = 0;
+			break;
+		case TML_PITCH_BEND:
+            channel->pitch_wheel = event->data.pitch_bend.value;
+			break;
+		case TML_CONTROL_CHANGE:
             {
-            mid_event_t* event = &events[ events_count++ ];
-            event->delay_us = ( msg->time - time ) * 1000;
-            time = msg->time;
-            event->channel = msg->channel;
-            event->type = msg->type;
-            switch( msg->type ) 
+            int value = event->data.control_change.control_value;
+            MID_U16* data = NULL;
+            switch( event->data.control_change.control )
                 {
-			    case TML_PROGRAM_CHANGE:
-                    event->data.program_change.program = (MID_U8) msg->program;
-				    break;
-			    case TML_NOTE_ON: //play a note
-                    event->data.note_on.note = (MID_U8) msg->key;
-                    event->data.note_on.velocity = (MID_U8) msg->velocity;
-				    break;
-			    case TML_NOTE_OFF: //stop a note
-                    event->data.note_off.note = (MID_U8) msg->key;
-				    break;
-			    case TML_PITCH_BEND: //pitch wheel modification
-                    event->data.pitch_bend.value = (MID_U16) msg->pitch_bend;
-				    break;
-			    case TML_CONTROL_CHANGE: //MIDI controller messages
-                    event->data.control_change.control = (MID_U8) msg->control;
-                    event->data.control_change.control_value = (MID_U8) msg->control_value;
-				    break;
+                case 7: channel->volume = (MID_U16)( ( channel->volume & 0x7f ) | ( value << 7 ) ); break;
+                case 39: channel->volume = (MID_U16)( ( channel->volume & 0x3f80 ) | value ); break;
+                case 11: channel->expression = (MID_U16)( ( channel->expression & 0x7f ) | ( value << 7 ) ); break;
+                case 43: channel->expression = (MID_U16)( ( channel->expression & 0x3f80 ) | value ); break;
+                case 10: channel->pan = (MID_U16)( ( channel->pan & 0x7f ) | ( value << 7 ) ); break;
+                case 42: channel->pan = (MID_U16)( ( channel->pan & 0x3f80 ) | value ); break;
+                case 6: 
+                    channel->data = (MID_U16)( ( channel->data & 0x7f ) | ( value << 7 ) ); 
+                    data = &channel->data;
+                    break;
+                case 38: 
+                    channel->data = (MID_U16)( ( channel->data & 0x3f80 ) | value ); 
+                    data = &channel->data;
+                    break;
+                case 0: 
+                    channel->bank = (MID_U16)( 0x8000 | value ); 
+                    channel->flags |= MID_CHANNEL_BANK;
+                    break;
+                case 32: 
+                    channel->bank = (MID_U16)( ( channel->bank & 0x8000 ? ( ( channel->bank & 0x7f ) << 7 ) : 0 ) | value ); 
+                    channel->flags |= MID_CHANNEL_BANK;
+                    break;
+                case 101: channel->rpn = (MID_U16)( ( ( channel->rpn == 0xffff ? 0 : channel->rpn ) & 0x7f ) | ( value << 7 ) ); break;
+                case 100: channel->rpn = (MID_U16)( ( ( channel->rpn == 0xffff ? 0 : channel->rpn ) & 0x3f80 ) | value ); break;
+                case 98: case 99: channel->rpn = 0xffff; break;
+                case 120: case 123: memset( state->notes[ event->channel ], 0, sizeof( state->notes[ 0 ] ) ); break;
+                case 121:
+                    channel->volume = channel->expression = 16383;
+                    channel->pan = 8192;
+                    channel->bank = 0;
+                    channel->pitch_range = 2 << 7;
+                    channel->flags |= MID_CHANNEL_BANK;
+                    break;
                 }
+            if( data )
+                {
+                if( channel->rpn == 0 ) channel->pitch_range = *data;
+                else if( channel->rpn == 1 ) channel->fine_tuning = *data;
+                else if( channel->rpn == 2 && event->data.control_change.control == 6 ) channel->coarse_tuning = *data;
+                }
+            } break;
+		}
+    }
+
+
+// Stops everything playing, and sets up the synth to match the given state. Held notes are restarted from the 
+// beginning of their attack, as there's no way to restore the exact state of a voice.
+static void mid_state_restore( mid_t* mid, mid_state_t const* state, tsf* sound_font )
+    {
+    tsf_reset( sound_font ); // Also clears all channel settings
+    tsf_channel_set_bank_preset( sound_font, 9, 128, mid->percussion_preset );
+    for( int i = 0; i < 16; ++i )
+        {
+        mid_channel_state_t const* channel = &state->channels[ i ];
+        if( !( channel->flags & MID_CHANNEL_USED ) || !( mid->channel_mask & ( 1u << i ) ) ) continue;
+        if( channel->flags & MID_CHANNEL_BANK ) tsf_channel_set_bank( sound_font, i, channel->bank );
+        if( channel->flags & MID_CHANNEL_PROGRAM ) tsf_channel_set_presetnumber( sound_font, i, channel->program, i == 9 );
+        tsf_channel_midi_control( sound_font, i, 7, channel->volume >> 7 );
+        tsf_channel_midi_control( sound_font, i, 39, channel->volume & 0x7f );
+        tsf_channel_midi_control( sound_font, i, 11, channel->expression >> 7 );
+        tsf_channel_midi_control( sound_font, i, 43, channel->expression & 0x7f );
+        tsf_channel_midi_control( sound_font, i, 10, channel->pan >> 7 );
+        tsf_channel_midi_control( sound_font, i, 42, channel->pan & 0x7f );
+        MID_U16 const values[ 3 ] = { channel->pitch_range, channel->fine_tuning, channel->coarse_tuning };
+        for( int j = 0; j < 3; ++j )
+            {
+            tsf_channel_midi_control( sound_font, i, 101, 0 );
+            tsf_channel_midi_control( sound_font, i, 100, j );
+            tsf_channel_midi_control( sound_font, i, 6, values[ j ] >> 7 );
+            tsf_channel_midi_control( sound_font, i, 38, values[ j ] & 0x7f );
+            }
+        if( channel->rpn == 0xffff ) 
+            {
+            tsf_channel_midi_control( sound_font, i, 99, 0 );
             }
-        
-        msg = msg->next;
+        else
+            {
+            tsf_channel_midi_control( sound_font, i, 101, channel->rpn >> 7 );
+            tsf_channel_midi_control( sound_font, i, 100, channel->rpn & 0x7f );
+            }
+        tsf_channel_set_pitchwheel( sound_font, i, channel->pitch_wheel );
+        for( int j = 0; j < 128; ++j )
+            if( state->notes[ i ][ j ] ) tsf_channel_note_on( sound_font, i, j, state->notes[ i ][ j ] / 127.0f );
+        }
+    }
+
+
+static size_t mid_keyframe_state_size( int note_count )
+    {
+    return sizeof( mid_channel_state_t ) * 16 + (size_t) note_count * 3;
+    }
+
+
+// Walks all the events of the song, tracking the synth state, and records a keyframe every MID_KEYFRAME_INTERVAL 
+// seconds. Keyframes and their data are stored in a single allocation, keyframes first.
+static void mid_build_keyframes( mid_t* mid )
+    {
+    MID_U64 interval = (MID_U64) mid->song.sample_rate * MID_KEYFRAME_INTERVAL;
+    int keyframe_count = (int)( mid->song.length / interval ) + 1;
+    mid_keyframe_t* keyframes = (mid_keyframe_t*) MID_MALLOC( mid->memctx, sizeof( mid_keyframe_t ) * keyframe_count );
+    size_t data_capacity = mid_keyframe_state_size( 64 ) * keyframe_count;
+    MID_U8* data = (MID_U8*) MID_MALLOC( mid->memctx, data_capacity );
+    size_t data_size = 0;
+
+    mid_state_t* state = (mid_state_t*) MID_MALLOC( mid->memctx, sizeof( mid_state_t ) );
+    mid_state_init( state );
+
+    size_t data_pos = 0;
+    MID_U64 prev_sample_pos = 0;
+    int event_index = 0;
+    for( int i = 0; i < keyframe_count; ++i )
+        {
+        MID_U64 keyframe_pos = interval * i;
+        while( event_index < mid->song.event_count )
+            {
+            mid_event_t event;
+            size_t next_pos = mid_read_event( &mid->song, data_pos, prev_sample_pos, &event );
+            if( event.sample_pos >= keyframe_pos ) break;
+            mid_state_apply( state, &event );
+            prev_sample_pos = event.sample_pos;
+            data_pos = next_pos;
+            ++event_index;
+            }
+
+        int note_count = 0;
+        for( int j = 0; j < 16 * 128; ++j ) 
+            if( state->notes[ j / 128 ][ j % 128 ] ) ++note_count;
+
+        size_t size = mid_keyframe_state_size( note_count );
+        if( data_size + size > data_capacity )
+            {
+            data_capacity = ( data_size + size ) * 2;
+            MID_U8* new_data = (MID_U8*) MID_MALLOC( mid->memctx, data_capacity );
+            memcpy( new_data, data, data_size );
+            MID_FREE( mid->memctx, data );
+            data = new_data;
+            }
+
+        mid_keyframe_t* keyframe = &keyframes[ i ];
+        keyframe->sample_pos = keyframe_pos;
+        keyframe->data_sample_pos = prev_sample_pos;
+        keyframe->event_index = (MID_U32) event_index;
+        keyframe->data_pos = (MID_U32) data_pos;
+        keyframe->state_pos = (MID_U32) data_size;
+        keyframe->note_count = (MID_U32) note_count;
+
+        memcpy( data + data_size, state->channels, sizeof( state->channels ) );
+        MID_U8* notes = data + data_size + sizeof( state->channels );
+        for( int j = 0; j < 16 * 128; ++j ) 
+            {
+            if( !state->notes[ j / 128 ][ j % 128 ] ) continue;
+            *notes++ = (MID_U8)( j / 128 );
+            *notes++ = (MID_U8)( j % 128 );
+            *notes++ = state->notes[ j / 128 ][ j % 128 ];
+            }
+        data_size += size;
+        }
+    MID_FREE( mid->memctx, state );
+
+    mid->song_keyframes = (MID_U8*) MID_MALLOC( mid->memctx, sizeof( mid_keyframe_t ) * keyframe_count + data_size );
+    memcpy( mid->song_keyframes, keyframes, sizeof( mid_keyframe_t ) * keyframe_count );
+    memcpy( mid->song_keyframes + sizeof( mid_keyframe_t ) * keyframe_count, data, data_size );
+    MID_FREE( mid->memctx, keyframes );
+    MID_FREE( mid->memctx, data );
+
+    mid->song.keyframe_count = keyframe_count;
+    mid->song.keyframes = (mid_keyframe_t const*) mid->song_keyframes;
+    mid->song.keyframe_data_size = data_size;
+    mid->song.keyframe_data = mid->song_keyframes + sizeof( mid_keyframe_t ) * keyframe_count;
+    }
+
+
+// Converts a position in the song (as stored in events and keyframes) to a position in output samples
+static MID_U64 mid_output_pos( mid_t const* mid, MID_U64 sample_pos )
+    {
+    if( mid->output_sample_rate == mid->song.sample_rate ) return sample_pos;
+    return ( sample_pos * (MID_U64) mid->output_sample_rate ) / (MID_U64) mid->song.sample_rate;
+    }
+
+
+static void mid_rewind( mid_t* mid )
+    {
+    mid->playback_sample_pos = 0ull;
+    mid->playback_event_pos = 0;
+    mid->playback_data_pos = 0;
+    memset( &mid->playback_next_event, 0, sizeof( mid->playback_next_event ) );
+    if( mid->song.event_count > 0 )
+        {
+        mid->playback_data_pos = mid_read_event( &mid->song, 0, 0ull, &mid->playback_next_event );
+        if( !mid->playback_data_pos ) mid->playback_event_pos = mid->song.event_count; // Damaged song, nothing to play
+        }
+    }
+
+
+mid_t* mid_create( void const* midi_data, size_t midi_size, void* memctx )
+    {
+    tml_message* mid_file = tml_load_memory( midi_data, (int) midi_size );
+    if( !mid_file ) return NULL;
+    int count = 0;
+    for( tml_message* iter = mid_file; iter; iter = iter->next )
+        if( mid_is_supported_event( iter->type ) ) ++count;
+
+    // Varint delta (at most 10 bytes) + status byte + 2 data bytes
+    MID_U8* data = (MID_U8*) MID_MALLOC( memctx, (size_t) count * 13 + 1 );
+    size_t data_size = 0;
+
+    // Timestamps are calculated from the absolute time of each message, so there's no rounding error accumulating
+    MID_U64 prev_sample_pos = 0;
+    for( tml_message* msg = mid_file; msg; msg = msg->next )
+        {
+        if( !mid_is_supported_event( msg->type ) ) continue;
+        MID_U64 sample_pos = ( ( (MID_U64) msg->time ) * MID_SAMPLE_RATE ) / 1000ull;
+        data_size += mid_write_event( data + data_size, sample_pos - prev_sample_pos, msg );
+        prev_sample_pos = sample_pos;
         }
 
     tml_free( mid_file );
 
     mid_t* mid = (mid_t*) MID_MALLOC( memctx, sizeof( mid_t ) );
+    memset( mid, 0, sizeof( *mid ) );
     mid->memctx = memctx;
-    mid->song.event_count = events_count;
-    mid->song.events = events;
-
-    mid->playback_accumulated_time_us = 0ull;
-    mid->playback_sample_pos = 0;
-    mid->playback_event_pos = 0;
+    mid->song_data = data;
+    mid->song.event_count = count;
+    mid->song.sample_rate = MID_SAMPLE_RATE;
+    mid->song.length = prev_sample_pos;
+    mid->song.data_size = data_size;
+    mid->song.data = data;
+    mid->channel_mask = 0xffff;
+    mid->output_sample_rate = mid->song.sample_rate;
+    mid_build_keyframes( mid );
+    mid_rewind( mid );
 
     return mid; 
     }
@@ -277,24 +732,46 @@ mid_t* mid_create( void const* midi_data, size_t midi_size, void* memctx )
 
 void mid_destroy( mid_t* mid )
     {
-    if( mid->song.events ) MID_FREE( mid->memctx, mid->song.events );
+    if( mid->song_data ) MID_FREE( mid->memctx, mid->song_data );
+    if( mid->song_keyframes ) MID_FREE( mid->memctx, mid->song_keyframes );
     MID_FREE( mid->memctx, mid );
     }
 
 
 int mid_init_raw( mid_t* mid, void const* raw_data, size_t raw_size )
     {
-    int events_count = *(int*)raw_data;
-    if( sizeof( mid_event_t ) * events_count != raw_size - sizeof( int ) ) return 0;
-
-    mid->memctx = NULL;
-
-    mid->song.event_count = events_count;
-    mid->song.events = (mid_event_t*)( ( (int*)raw_data ) + 1 );
+    mid_raw_header_t header;
+    if( raw_size < sizeof( header ) ) return 0;
+    memcpy( &header, raw_data, sizeof( header ) );
+    if( memcmp( header.id, MID_RAW_ID, sizeof( header.id ) ) != 0 || header.sample_rate == 0 ) return 0;
+    size_t keyframes_pos = sizeof( header ) + ( ( header.data_size + 7 ) & ~7u );
+    size_t keyframe_data_pos = keyframes_pos + sizeof( mid_keyframe_t ) * header.keyframe_count;
+    if( keyframe_data_pos + header.keyframe_data_size != raw_size ) return 0;
+
+    // Keyframes point into the event records and the keyframe data, so make sure seeking can't read outside of them
+    mid_keyframe_t const* keyframes = (mid_keyframe_t const*)( ( (MID_U8 const*) raw_data ) + keyframes_pos );
+    for( MID_U32 i = 0; i < header.keyframe_count; ++i )
+        {
+        mid_keyframe_t const* keyframe = &keyframes[ i ];
+        if( keyframe->event_index > header.event_count || keyframe->data_pos > header.data_size ) return 0;
+        if( keyframe->note_count > 16 * 128 || keyframe->state_pos > header.keyframe_data_size || 
+            mid_keyframe_state_size( (int) keyframe->note_count ) > header.keyframe_data_size - keyframe->state_pos )
+            return 0;
+        }
 
-    mid->playback_accumulated_time_us = 0ull;
-    mid->playback_sample_pos = 0;
-    mid->playback_event_pos = 0;
+    memset( mid, 0, sizeof( *mid ) );
+    mid->song.event_count = (int) header.event_count;
+    mid->song.sample_rate = (int) header.sample_rate;
+    mid->song.length = header.length;
+    mid->song.data_size = header.data_size;
+    mid->song.data = ( (MID_U8 const*) raw_data ) + sizeof( header );
+    mid->song.keyframe_count = (int) header.keyframe_count;
+    mid->song.keyframes = keyframes;
+    mid->song.keyframe_data_size = header.keyframe_data_size;
+    mid->song.keyframe_data = ( (MID_U8 const*) raw_data ) + keyframe_data_pos;
+    mid->channel_mask = 0xffff;
+    mid->output_sample_rate = mid->song.sample_rate;
+    mid_rewind( mid );
 
     return 1; 
     }
@@ -302,103 +779,189 @@ int mid_init_raw( mid_t* mid, void const* raw_data, size_t raw_size )
 
 size_t mid_save_raw( mid_t* mid, void* data, size_t capacity ) 
     {
-    size_t size = sizeof( mid_event_t ) * mid->song.event_count + sizeof( int );
+    size_t keyframes_pos = sizeof( mid_raw_header_t ) + ( ( mid->song.data_size + 7 ) & ~(size_t) 7 );
+    size_t keyframe_data_pos = keyframes_pos + sizeof( mid_keyframe_t ) * mid->song.keyframe_count;
+    size_t size = keyframe_data_pos + mid->song.keyframe_data_size;
     if( data && capacity >= size ) 
         {
-        *(int*)data = mid->song.event_count;
-        memcpy( ( (int*)data ) + 1, mid->song.events, sizeof( mid_event_t ) * mid->song.event_count );
+        mid_raw_header_t header;
+        memset( &header, 0, sizeof( header ) );
+        memcpy( header.id, MID_RAW_ID, sizeof( header.id ) );
+        header.sample_rate = (MID_U32) mid->song.sample_rate;
+        header.event_count = (MID_U32) mid->song.event_count;
+        header.data_size = (MID_U32) mid->song.data_size;
+        header.keyframe_count = (MID_U32) mid->song.keyframe_count;
+        header.length = mid->song.length;
+        header.keyframe_data_size = (MID_U32) mid->song.keyframe_data_size;
+        memset( data, 0, size );
+        memcpy( data, &header, sizeof( header ) );
+        memcpy( ( (MID_U8*) data ) + sizeof( header ), mid->song.data, mid->song.data_size );
+        memcpy( ( (MID_U8*) data ) + keyframes_pos, mid->song.keyframes, 
+            sizeof( mid_keyframe_t ) * mid->song.keyframe_count );
+        memcpy( ( (MID_U8*) data ) + keyframe_data_pos, mid->song.keyframe_data, mid->song.keyframe_data_size );
         }
     return size;
     }
 
 
+static void mid_process_event( mid_t* mid, mid_event_t const* event, tsf* sound_font )
+    {
+    if( !( mid->channel_mask & ( 1u << event->channel ) ) ) return;
+    switch( event->type )
+        {
+		case TML_PROGRAM_CHANGE: 
+			tsf_channel_set_presetnumber( sound_font, event->channel, event->data.program_change.program, ( event->channel == 9 ) );
+			break;
+		case TML_NOTE_ON:
+			tsf_channel_note_on( sound_font, event->channel, event->data.note_on.note, event->data.note_on.velocity / 127.0f );
+			break;
+		case TML_NOTE_OFF: //stop a note
+			tsf_channel_note_off( sound_font, event->channel, event->data.note_off.note );
+			break;
+		case TML_PITCH_BEND: //pitch wheel modification
+			tsf_channel_set_pitchwheel( sound_font, event->channel, event->data.pitch_bend.value );
+			break;
+		case TML_CONTROL_CHANGE: //MIDI controller messages
+			tsf_channel_midi_control( sound_font, event->channel, event->data.control_change.control, event->data.control_change.control_value );
+			break;
+		}
+    }
+
+
+static void mid_next_event( mid_t* mid )
+    {
+    MID_U64 sample_pos = mid->playback_next_event.sample_pos;
+    if( ++mid->playback_event_pos < mid->song.event_count )
+        {
+        size_t data_pos = mid_read_event( &mid->song, mid->playback_data_pos, sample_pos, &mid->playback_next_event );
+        if( data_pos ) 
+            mid->playback_data_pos = data_pos;
+        else
+            mid->playback_event_pos = mid->song.event_count; // The song data is cut short, so stop playing here
+        }
+    }
+
+
 void mid_skip_leading_silence( mid_t* mid, tsf* sound_font )
     {
-    (void) sound_font;
-    for( ; ; )
+    while( mid->playback_event_pos < mid->song.event_count )
         {
-        MID_U64 next_event_delay_us = mid->song.events[ mid->playback_event_pos ].delay_us;
-        MID_U64 playback_time_us = ( mid->playback_sample_pos * 1000000ull ) / 44100ull;
-        MID_U64 next_event_time_us = mid->playback_accumulated_time_us + next_event_delay_us;
-        assert( next_event_time_us >= playback_time_us );
-        MID_U64 time_until_next_event = next_event_time_us - playback_time_us;
-        int samples_until_next_event = (int)( ( time_until_next_event * 44100ull ) / 1000000ull );       
-        mid_event_t* event = &mid->song.events[ mid->playback_event_pos ];
-        switch( event->type )
+        mid_event_t const* event = &mid->playback_next_event;
+        if( event->type == TML_NOTE_ON ) 
             {
-			case TML_PROGRAM_CHANGE: 
-				tsf_channel_set_presetnumber( sound_font, event->channel, event->data.program_change.program, ( event->channel == 9 ) );
-				break;
-			case TML_NOTE_ON:
-				return;
-			case TML_NOTE_OFF: //stop a note
-				tsf_channel_note_off( sound_font, event->channel, event->data.note_off.note );
-				break;
-			case TML_PITCH_BEND: //pitch wheel modification
-				tsf_channel_set_pitchwheel( sound_font, event->channel, event->data.pitch_bend.value );
-				break;
-			case TML_CONTROL_CHANGE: //MIDI controller messages
-				tsf_channel_midi_control( sound_font, event->channel, event->data.control_change.control, event->data.control_change.control_value );
-				break;
-			}
-        mid->playback_sample_pos += samples_until_next_event;
-        mid->playback_accumulated_time_us += next_event_delay_us; 
-        mid->playback_event_pos++;
+            mid->playback_sample_pos = mid_output_pos( mid, event->sample_pos );
+            return;
+            }
+        mid_process_event( mid, event, sound_font );
+        mid_next_event( mid );
         }
     }
 
 
+// Restores the nearest keyframe before `sample_pos` (in output samples), and only replays the events between it and
+// `sample_pos`. The events are only applied to a tracked state, not the synth, so there's no cost for the notes that 
+// start and stop in between, and the synth is then set up from that state in one go.
+void mid_seek( mid_t* mid, unsigned long long sample_pos, tsf* sound_font )
+    {
+    MID_U64 length = mid_output_pos( mid, mid->song.length );
+    if( sample_pos > length ) sample_pos = length;
+
+    mid_state_t state;
+    mid_state_init( &state );
+    size_t data_pos = 0;
+    MID_U64 prev_sample_pos = 0;
+    int event_index = 0;
+
+    int keyframe_index = mid->song.keyframe_count - 1;
+    while( keyframe_index >= 0 && mid_output_pos( mid, mid->song.keyframes[ keyframe_index ].sample_pos ) > sample_pos ) 
+        --keyframe_index;
+    if( keyframe_index >= 0 )
+        {
+        mid_keyframe_t const* keyframe = &mid->song.keyframes[ keyframe_index ];
+        MID_U8 const* keyframe_state = mid->song.keyframe_data + keyframe->state_pos;
+        memcpy( state.channels, keyframe_state, sizeof( state.channels ) );
+        MID_U8 const* notes = keyframe_state + sizeof( state.channels );
+        for( MID_U32 i = 0; i < keyframe->note_count; ++i, notes += 3 )
+            state.notes[ notes[ 0 ] & 15 ][ notes[ 1 ] & 127 ] = notes[ 2 ];
+        data_pos = keyframe->data_pos;
+        prev_sample_pos = keyframe->data_sample_pos;
+        event_index = (int) keyframe->event_index;
+        }
+
+    while( event_index < mid->song.event_count )
+        {
+        mid_event_t event;
+        size_t next_pos = mid_read_event( &mid->song, data_pos, prev_sample_pos, &event );
+        if( !next_pos ) 
+            {
+            event_index = mid->song.event_count;
+            break;
+            }
+        if( mid_output_pos( mid, event.sample_pos ) >= sample_pos ) break;
+        mid_state_apply( &state, &event );
+        prev_sample_pos = event.sample_pos;
+        data_pos = next_pos;
+        ++event_index;
+        }
+
+    mid_state_restore( mid, &state, sound_font );
+
+    mid->playback_sample_pos = sample_pos;
+    mid->playback_event_pos = event_index;
+    if( event_index < mid->song.event_count )
+        {
+        mid->playback_data_pos = mid_read_event( &mid->song, data_pos, prev_sample_pos, &mid->playback_next_event );
+        if( !mid->playback_data_pos ) mid->playback_event_pos = mid->song.event_count;
+        }
+    }
+
+
+// Only events on the channels in the mask will be played, which makes it possible to split the rendering of a song 
+// across multiple instances, each with its own synth, and mix the results.
+void mid_set_channel_mask( mid_t* mid, unsigned int channel_mask )
+    {
+    mid->channel_mask = channel_mask;
+    }
+
+
+// Sets the sample rate the song is rendered at, which should match the one passed to `tsf_set_output`. Event 
+// positions are converted from the rate the song was created with. Should be called before starting playback, as the
+// playback position is in output samples.
+void mid_set_output_rate( mid_t* mid, int sample_rate )
+    {
+    mid->output_sample_rate = sample_rate > 0 ? sample_rate : mid->song.sample_rate;
+    }
+
+
 int mid_render_short( mid_t* mid, short* sample_pairs, int sample_pairs_count, tsf* sound_font )
     {
     int samples_rendered = 0;
     memset( sample_pairs, 0, sample_pairs_count * sizeof( short ) * 2 );
     while( samples_rendered < sample_pairs_count )
         {
-        MID_U64 next_event_delay_us = mid->song.events[ mid->playback_event_pos ].delay_us;
-        MID_U64 playback_time_us = ( mid->playback_sample_pos * 1000000ull ) / 44100ull;
-        MID_U64 next_event_time_us = mid->playback_accumulated_time_us + next_event_delay_us;
-        assert( next_event_time_us >= playback_time_us );
-        MID_U64 time_until_next_event = next_event_time_us - playback_time_us;
-        int samples_until_next_event = (int)( ( time_until_next_event * 44100ull ) / 1000000ull );
-        int samples_to_render = samples_until_next_event;
-        if( samples_to_render > sample_pairs_count - samples_rendered )
+        // Process every event which is due at the current position, so that the render below can cover the whole 
+        // span until the next event. Events outside of the channel mask are skipped right away, as they would only 
+        // split the render for no reason.
+        while( mid->playback_event_pos < mid->song.event_count && 
+            ( mid_output_pos( mid, mid->playback_next_event.sample_pos ) <= mid->playback_sample_pos || 
+                !( mid->channel_mask & ( 1u << mid->playback_next_event.channel ) ) ) )
             {
-            samples_to_render = sample_pairs_count - samples_rendered;
-            tsf_render_short( sound_font, sample_pairs + samples_rendered * 2, 
-                samples_to_render, 1 );
-            samples_rendered += samples_to_render;
-            mid->playback_sample_pos += samples_to_render;
-            return samples_rendered;
+            mid_process_event( mid, &mid->playback_next_event, sound_font );
+            mid_next_event( mid );
             }
-        else
+
+        int samples_to_render = sample_pairs_count - samples_rendered;
+        if( mid->playback_event_pos < mid->song.event_count ) 
             {
-            tsf_render_short( sound_font, sample_pairs + samples_rendered * 2, 
-                samples_to_render, 1 );
-            samples_rendered += samples_to_render;
-            mid->playback_sample_pos += samples_to_render;
+            MID_U64 next_event_pos = mid_output_pos( mid, mid->playback_next_event.sample_pos );
+            MID_U64 samples_until_next_event = next_event_pos - mid->playback_sample_pos;
+            if( samples_until_next_event < (MID_U64) samples_to_render ) 
+                samples_to_render = (int) samples_until_next_event;
             }
 
-
-        mid->playback_accumulated_time_us += next_event_delay_us; 
-        mid_event_t* event = &mid->song.events[ mid->playback_event_pos++ ];
-        switch( event->type )
-            {
-			case TML_PROGRAM_CHANGE: 
-				tsf_channel_set_presetnumber( sound_font, event->channel, event->data.program_change.program, ( event->channel == 9 ) );
-				break;
-			case TML_NOTE_ON:
-				tsf_channel_note_on( sound_font, event->channel, event->data.note_on.note, event->data.note_on.velocity / 127.0f );
-				break;
-			case TML_NOTE_OFF: //stop a note
-				tsf_channel_note_off( sound_font, event->channel, event->data.note_off.note );
-				break;
-			case TML_PITCH_BEND: //pitch wheel modification
-				tsf_channel_set_pitchwheel( sound_font, event->channel, event->data.pitch_bend.value );
-				break;
-			case TML_CONTROL_CHANGE: //MIDI controller messages
-				tsf_channel_midi_control( sound_font, event->channel, event->data.control_change.control, event->data.control_change.control_value );
-				break;
-			}
+        tsf_render_short( sound_font, sample_pairs + samples_rendered * 2, samples_to_render, 1 );
+        samples_rendered += samples_to_render;
+        mid->playback_sample_pos += samples_to_render;
         }
     
     return samples_rendered;
@@ -39,6 +39,27 @@ void palrle_decode( palrle_data_t* rle_data, PALRLE_U8* pixels, PALRLE_U8* mask
 
 void palrle_blit( palrle_data_t* rle_data, int x, int y, PALRLE_U8* pixels, int width, int height );
 
+// Same as palrle_blit, but mirrored horizontally (if flip_h is non-zero) and/or vertically (if flip_v is non-zero),
+// within the full width/height of the encoded bitmap
+void palrle_blit_flip( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8* pixels, int width, 
+    int height );
+
+// Same as palrle_blit_flip, but every pixel written is looked up in the 256 entry `remap` table first. Passing NULL for
+// `remap` draws the original colors, at the same speed as palrle_blit_flip
+void palrle_blit_remap( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8 const* remap, 
+    PALRLE_U8* pixels, int width, int height );
+
+// Same as palrle_blit_remap, but instead of overwriting the target pixels, they are combined with the bitmap through
+// the 256x256 entry `blend` table, indexed as `blend[ bitmap_color * 256 + target_color ]`. Passing NULL for `blend`
+// overwrites the target pixels, the same as palrle_blit_remap
+void palrle_blit_blend( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8 const* remap, 
+    PALRLE_U8 const* blend, PALRLE_U8* pixels, int width, int height );
+
+// Same as palrle_blit_blend, but scaled (using nearest neighbor) by `scale_x` and `scale_y`, which are in 16.16 fixed
+// point. The bitmap is drawn straight from the RLE data, with every run and pixel written as a scaled span.
+void palrle_blit_scaled( palrle_data_t* rle_data, int x, int y, int scale_x, int scale_y, int flip_h, int flip_v, 
+    PALRLE_U8 const* remap, PALRLE_U8 const* blend, PALRLE_U8* pixels, int width, int height );
+
 void palrle_free( palrle_data_t* rle_data, void* memctx );
 
 
@@ -110,9 +131,9 @@ palrle_data_t* palrle_encode_mask( PALRLE_U8* pixels, PALRLE_U8* mask, int width
         sizeof( palrle_data_t ) + // size for the struct itself
         sizeof( PALRLE_U32 ) * palette_count + // size for storing palette entries
         sizeof( PALRLE_U32 ) * vpitch + // size for storing the offset for each row
-        hpitch * vpitch * 2 ); // assume worst case - we should never need more than twice the number of pixels
+        hpitch * vpitch * 3 ); // assume worst case - a single pixel between empty ones takes three bytes to store
     memset( data, 0, sizeof( palrle_data_t ) + sizeof( PALRLE_U32 ) * palette_count + sizeof( PALRLE_U32 ) * vpitch + 
-        hpitch * vpitch * 2 ); 
+        hpitch * vpitch * 3 ); 
 
 
     data->size = (PALRLE_U32) ( sizeof( palrle_data_t ) - sizeof( PALRLE_U8 ) );
@@ -147,6 +168,10 @@ palrle_data_t* palrle_encode_mask( PALRLE_U8* pixels, PALRLE_U8* mask, int width
             data->data[ rle_offset++ ] = (PALRLE_U8) empty;
 
             // add non-empty pixels
+            if( x >= hpitch ) {
+                data->data[ rle_offset++ ] = 0;
+                continue;
+            }
             int color = pixels[ x + xmin + ( y + ymin ) * width ];
             int count = 0;
             int tx = x;
@@ -243,29 +268,151 @@ void palrle_decode( palrle_data_t* rle_data, PALRLE_U8* pixels, PALRLE_U8* mask
 
 
 void palrle_blit( palrle_data_t* rle_data, int x, int y, PALRLE_U8* pixels, int width, int height ) {
-    PALRLE_U8* data = &rle_data->data[ sizeof( PALRLE_U32 ) * ( rle_data->palette_count + rle_data->vpitch ) ];
-    for( int iy = 0; iy < rle_data->vpitch; ++iy ) {
+    palrle_blit_flip( rle_data, x, y, 0, 0, pixels, width, height );
+}
+
+
+void palrle_blit_flip( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8* pixels, int width,
+    int height ) {
+    palrle_blit_remap( rle_data, x, y, flip_h, flip_v, NULL, pixels, width, height );
+}
+
+
+void palrle_blit_remap( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8 const* remap, 
+    PALRLE_U8* pixels, int width, int height ) {
+    palrle_blit_blend( rle_data, x, y, flip_h, flip_v, remap, NULL, pixels, width, height );
+}
+
+
+void palrle_blit_blend( palrle_data_t* rle_data, int x, int y, int flip_h, int flip_v, PALRLE_U8 const* remap, 
+    PALRLE_U8 const* blend, PALRLE_U8* pixels, int width, int height ) {
+
+    int hpitch = rle_data->hpitch;
+    int vpitch = rle_data->vpitch;
+    PALRLE_U8* row_offsets = &rle_data->data[ sizeof( PALRLE_U32 ) * rle_data->palette_count ];
+
+    // Top left corner of the cropped region, after flipping
+    int left = x + ( flip_h ? rle_data->width - rle_data->xoffset - hpitch : rle_data->xoffset );
+    int top = y + ( flip_v ? rle_data->height - rle_data->yoffset - vpitch : rle_data->yoffset );
+
+    // Rows are looked up in the row offset table, so only the ones which end up inside the target are decoded
+    int first_row = top < 0 ? -top : 0;
+    int last_row = top + vpitch > height ? height - top : vpitch;
+    for( int iy = first_row; iy < last_row; ++iy ) {
+        int row = flip_v ? vpitch - 1 - iy : iy;
+        PALRLE_U32 offset;
+        memcpy( &offset, row_offsets + sizeof( PALRLE_U32 ) * row, sizeof( offset ) );
+        PALRLE_U8* data = &rle_data->data[ offset ];
+        PALRLE_U8* out = pixels + ( top + iy ) * width;
         int ix = 0;
-        while( ix < rle_data->hpitch ) {
+        while( ix < hpitch ) {
             ix += *data++;
-            char count = (char)( *data++ );
-            if( count > 0 ) {
-                PALRLE_U8 color = *data++;
-                for( int i = 0; i < count; ++i ) {
-                    int xp = rle_data->xoffset + ix + x;
-                    int yp = rle_data->yoffset + iy + y;
-                    if( xp > 0 && yp > 0 && xp < width && yp < height ) pixels[ xp + yp * width ] = color;
-                    ++ix;
+            signed char count = (signed char)( *data++ );
+            int n = count > 0 ? count : -count;
+            PALRLE_U8* values = data;
+            data += count > 0 ? 1 : n;
+
+            // Runs are decoded left to right, but when flipping they are written from the right edge and leftwards
+            int start = flip_h ? left + hpitch - ix - n : left + ix;
+            int clip_start = start < 0 ? 0 : start;
+            int clip_end = start + n > width ? width : start + n;
+            ix += n;
+            if( clip_start >= clip_end ) continue;
+
+            if( blend ) {
+                if( count > 0 ) {
+                    PALRLE_U8 const* blend_row = blend + ( ( remap ? remap[ *values ] : *values ) << 8 );
+                    for( int i = clip_start; i < clip_end; ++i ) {
+                        out[ i ] = blend_row[ out[ i ] ];
+                    }
+                } else {
+                    for( int i = clip_start; i < clip_end; ++i ) {
+                        PALRLE_U8 color = values[ flip_h ? start + n - 1 - i : i - start ];
+                        out[ i ] = blend[ ( ( remap ? remap[ color ] : color ) << 8 ) | out[ i ] ];
+                    }
+                }
+            } else if( count > 0 ) {
+                memset( out + clip_start, remap ? remap[ *values ] : *values, (size_t)( clip_end - clip_start ) );
+            } else if( !remap ) {
+                if( !flip_h ) {
+                    memcpy( out + clip_start, values + ( clip_start - start ), (size_t)( clip_end - clip_start ) );
+                } else {
+                    for( int i = clip_start; i < clip_end; ++i ) {
+                        out[ i ] = values[ start + n - 1 - i ];
+                    }
                 }
             } else {
-                for( int i = 0; i < -count; ++i ) {
-                    PALRLE_U8 color = *data++;
-                    int xp = rle_data->xoffset + ix + x;
-                    int yp = rle_data->yoffset + iy + y;
-                    if( xp > 0 && yp > 0 && xp < width && yp < height ) pixels[ xp + yp * width ] = color;
-                    ++ix;
+                for( int i = clip_start; i < clip_end; ++i ) {
+                    out[ i ] = remap[ values[ flip_h ? start + n - 1 - i : i - start ] ];
+                }
+            }
+        }
+    }
+}
+
+
+// Position, in the target, of the start of a source pixel row or column, in the 16.16 `scale` given
+static int palrle_scale( int position, int scale ) {
+    return (int)( ( (long long) position * scale ) >> 16 );
+}
+
+
+void palrle_blit_scaled( palrle_data_t* rle_data, int x, int y, int scale_x, int scale_y, int flip_h, int flip_v, 
+    PALRLE_U8 const* remap, PALRLE_U8 const* blend, PALRLE_U8* pixels, int width, int height ) {
+
+    if( scale_x <= 0 || scale_y <= 0 ) return;
+
+    int hpitch = rle_data->hpitch;
+    int vpitch = rle_data->vpitch;
+    PALRLE_U8* row_offsets = &rle_data->data[ sizeof( PALRLE_U32 ) * rle_data->palette_count ];
+
+    for( int iy = 0; iy < vpitch; ++iy ) {
+        // Each source row covers the target rows from where it starts to where the next row starts, which can be 
+        // none at all when scaling down, in which case the row is skipped without being decoded
+        int source_row = rle_data->yoffset + iy;
+        if( flip_v ) source_row = rle_data->height - 1 - source_row;
+        int row_start = y + palrle_scale( source_row, scale_y );
+        int row_end = y + palrle_scale( source_row + 1, scale_y );
+        if( row_start < 0 ) row_start = 0;
+        if( row_end > height ) row_end = height;
+        if( row_start >= row_end ) continue;
+
+        PALRLE_U32 offset;
+        memcpy( &offset, row_offsets + sizeof( PALRLE_U32 ) * iy, sizeof( offset ) );
+        PALRLE_U8* data = &rle_data->data[ offset ];
+        int ix = 0;
+        while( ix < hpitch ) {
+            ix += *data++;
+            signed char count = (signed char)( *data++ );
+            int n = count > 0 ? count : -count;
+            PALRLE_U8* values = data;
+            data += count > 0 ? 1 : n;
+
+            // A run is written as one span, while each pixel of a unique value sequence gets a span of its own
+            int span = count > 0 ? n : 1;
+            for( int i = 0; i < ( count > 0 ? 1 : n ); ++i ) {
+                int column = rle_data->xoffset + ix + i;
+                if( flip_h ) column = rle_data->width - column - span;
+                int start = x + palrle_scale( column, scale_x );
+                int end = x + palrle_scale( column + span, scale_x );
+                if( start < 0 ) start = 0;
+                if( end > width ) end = width;
+                if( start >= end ) continue;
+
+                PALRLE_U8 color = remap ? remap[ values[ i ] ] : values[ i ];
+                for( int row = row_start; row < row_end; ++row ) {
+                    PALRLE_U8* out = pixels + row * width;
+                    if( blend ) {
+                        PALRLE_U8 const* blend_row = blend + ( color << 8 );
+                        for( int j = start; j < end; ++j ) {
+                            out[ j ] = blend_row[ out[ j ] ];
+                        }
+                    } else {
+                        memset( out + start, color, (size_t)( end - start ) );
+                    }
                 }
             }
+            ix += n;
         }
     }
 }
@@ -74,6 +74,9 @@ void crt_mode_off( void );
 
 void print( char const* str );
 
+void pixie_batch_begin( void );
+void pixie_batch_end( void );
+
 typedef int asset_t;
 
 void load_palette( asset_t asset );
@@ -86,6 +89,23 @@ typedef struct rgb_t {
 
 void setcol( int index, rgb_t rgb );
 rgb_t getcol( int index );
+void setcols( int first, int count, rgb_t const* rgb );
+void getcols( int first, int count, rgb_t* rgb );
+void remap_table( int table, u8 const* remap );
+
+typedef enum easing_t { 
+    EASING_LINEAR, EASING_SMOOTHSTEP, EASING_SMOOTHERSTEP, EASING_OUT_QUAD, EASING_OUT_BACK, EASING_OUT_BOUNCE, 
+    EASING_OUT_SINE, EASING_OUT_ELASTIC, EASING_OUT_EXPO, EASING_OUT_CUBIC, EASING_OUT_QUART, EASING_OUT_QUINT, 
+    EASING_OUT_CIRCLE, EASING_IN_QUAD, EASING_IN_BACK, EASING_IN_BOUNCE, EASING_IN_SINE, EASING_IN_ELASTIC, 
+    EASING_IN_EXPO, EASING_IN_CUBIC, EASING_IN_QUART, EASING_IN_QUINT, EASING_IN_CIRCLE, EASING_IN_OUT_QUAD, 
+    EASING_IN_OUT_BACK, EASING_IN_OUT_BOUNCE, EASING_IN_OUT_SINE, EASING_IN_OUT_ELASTIC, EASING_IN_OUT_EXPO, 
+    EASING_IN_OUT_CUBIC, EASING_IN_OUT_QUART, EASING_IN_OUT_QUINT, EASING_IN_OUT_CIRCLE, 
+} easing_t;
+
+void palette_fade( rgb_t target, int frames, easing_t easing );
+void palette_crossfade( asset_t asset, int frames );
+int palette_fading( void );
+void palette_cycle( int first, int last, int speed );
 
 void sprites_off( void );
 
@@ -101,6 +121,27 @@ void sprite_origin( int spr_index, int x, int y );
 int sprite_origin_x( int spr_index );
 int sprite_origin_y( int spr_index );
 void sprite_cel( int spr_index, int cel );
+int sprite_current_cel( int spr_index );
+
+typedef enum flip_t { FLIP_NONE = 0, FLIP_H = 1, FLIP_V = 2, } flip_t;
+void sprite_flip( int spr_index, int flip );
+void sprite_remap( int spr_index, int table );
+
+typedef enum blend_t { BLEND_NONE, BLEND_HALF, BLEND_ADD, BLEND_MULTIPLY, BLEND_SHADOW, } blend_t;
+void sprite_blend( int spr_index, blend_t mode );
+void sprite_scale( int spr_index, int scale_x, int scale_y );
+
+typedef enum anim_mode_t { ANIM_LOOP, ANIM_PINGPONG, ANIM_ONCE, } anim_mode_t;
+void sprite_animate( int spr_index, int first_cel, int last_cel, int frames_per_cel, anim_mode_t mode );
+
+void sprites_pos( int const* spr_indices, int const* xs, int const* ys, int count );
+void sprites_origin( int const* spr_indices, int const* xs, int const* ys, int count );
+
+void camera( int x, int y );
+int camera_x( void );
+int camera_y( void );
+void layer_parallax( int layer, int percent_x, int percent_y );
+void sprite_layer( int spr_index, int layer );
 
 typedef enum text_align_t { TEXT_ALIGN_LEFT, TEXT_ALIGN_RIGHT, TEXT_ALIGN_CENTER, } text_align_t;
 int label( int spr_index, int x, int y, char const* text, int color, asset_t font );
@@ -111,6 +152,18 @@ int label_outline( int spr_index, int color );
 int label_shadow( int spr_index, int color );
 int label_wrap( int spr_index, int wrap );
 
+int tilemap( int spr_index, int x, int y, asset_t tileset );
+void tilemap_resize( int spr_index, int width, int height );
+void tilemap_set( int spr_index, int tile_x, int tile_y, int tile );
+int tilemap_get( int spr_index, int tile_x, int tile_y );
+
+int surface_create( int width, int height );
+void surface_destroy( int surface );
+void surface_clear( int surface, int color );
+void surface_encode( int surface );
+void draw_target( int surface );
+int sprite_surface( int spr_index, int surface );
+
 typedef struct move_t { u32 data[ 4 ]; /* opaque struct, 16 bytes long */ } move_t;
 
 move_t move_loop( void );
@@ -153,10 +206,41 @@ move_t move_ease_in_out_circle( int duration, int target );
 void sprite_move_x( int spr_index, move_t moves, ... );
 void sprite_move_y( int spr_index, move_t moves, ... );
 
+typedef struct path_point_t { int x; int y; } path_point_t;
+typedef enum path_type_t { PATH_POLYLINE, PATH_CATMULL_ROM, PATH_BEZIER, } path_type_t;
+void sprite_move_path( int spr_index, path_type_t type, path_point_t const* points, int count, int duration, 
+    easing_t easing, int loop );
+int sprite_moving( int spr_index );
+
 #define ARRAY_COUNT( x ) ( (int)( sizeof( x ) / sizeof( *x ) ) )
 
 void set_soundfont( asset_t asset );
 void play_song( asset_t asset );
+void song_seek( float seconds );
+float song_position( void );
+void play_sound( int channel, asset_t asset );
+void stop_sound( int channel );
+void play_stream( asset_t asset );
+void stop_stream( void );
+float stream_position( void );
+int stream_underruns( void );
+
+typedef struct sound_stats_t {
+    int buffer_size; // Current size of the sound buffer, in samples
+    float latency; // Current size of the sound buffer, in milliseconds
+    int buffer_changes; // Number of times the sound buffer size has been adapted
+    int callbacks; // Number of times the sound device has asked for more samples
+    float callback_period; // Average time between callbacks, in milliseconds
+    float callback_period_max; // Longest time between two callbacks, in milliseconds
+    float render_time; // Average time spent mixing samples in each callback, in milliseconds
+    float render_time_max; // Longest time spent mixing samples in a single callback, in milliseconds
+    int underruns; // Number of callbacks which came too late for the sound device not to run out of samples
+    int overruns; // Number of callbacks where mixing took more than half the duration of the samples mixed
+    int stream_underruns; // Number of times the stream reader couldn't keep up, same as `stream_underruns`
+    int song_underruns; // Number of times a song worker couldn't keep up, always 0 unless PIXIE_SONG_WORKERS is set
+} sound_stats_t;
+
+sound_stats_t sound_stats( void );
 char const* load_text( asset_t asset );
 
 int asset_size( asset_t asset );
@@ -166,6 +250,15 @@ void text( int x, int y, char const* str, int color, asset_t font
 	/*, text_align align, int wrap_width, int hspacing, int vspacing, int limit, bool bold, bool italic, 
     bool underline */ );
 
+void cls( int color );
+void fill_rect( int x, int y, int width, int height, int color );
+void hline( int x, int y, int length, int color );
+void vline( int x, int y, int length, int color );
+void line( int x1, int y1, int x2, int y2, int color );
+void circle( int x, int y, int radius, int color );
+void blit_raw( int x, int y, u8 const* pixels, int width, int height );
+void blit_masked( int x, int y, u8 const* pixels, u8 const* mask, int width, int height );
+
 typedef enum keys_t { 
 	KEY_INVALID, KEY_LBUTTON, KEY_RBUTTON, KEY_CANCEL, KEY_MBUTTON,  KEY_XBUTTON1, KEY_XBUTTON2, KEY_BACK, KEY_TAB, 
 	KEY_CLEAR, KEY_RETURN, KEY_SHIFT,  KEY_CONTROL, KEY_MENU, KEY_PAUSE, KEY_CAPITAL, KEY_KANA, KEY_HANGUL = KEY_KANA, 
@@ -291,7 +384,12 @@ char const* internal_pixie_format_assert_message( char const* format, ... );
 #define ASSET_PALETTE( id, filename ) id,
 #define ASSET_SPRITE( id, filename ) id,
 #define ASSET_SONG( id, filename ) id,
+#define ASSET_SONG_PRERENDERED( id, filename ) id,
+#define ASSET_SONG_PRERENDERED_ADPCM( id, filename ) id,
+#define ASSET_SOUNDFONT( id, filename ) id,
+#define ASSET_SOUND( id, filename ) id,
 #define ASSET_FONT( id, filename ) id,
+#define ASSET_TILESET( id, filename, tile_width, tile_height ) id,
 
 #ifdef PIXIE_NO_BUILD
     // If data builds are disabled, we just define the functions to load a bundle, not create it.
@@ -775,6 +873,7 @@ char const* internal_pixie_format_assert_message( char const* format, ... );
 #include <stdarg.h>
 
 // Libraries includes
+#include "adpcm.h"
 #include "app.h"
 #include "crtemu.h"
 #include "crt_frame.h"
@@ -792,6 +891,11 @@ char const* internal_pixie_format_assert_message( char const* format, ... );
 #include "thread.h"
 #include "tsf.h"
 
+#if !defined( PIXIE_NO_SIMD ) && ( defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 ) )
+    #define INTERNAL_PIXIE_SSE2
+    #include <emmintrin.h>
+#endif
+
 
 // In C, a void* can be implicitly cast to any other kind of pointer, while in C++ you need an explicit cast. In most
 // cases, the explicit cast works for both C and C++, but if we consider the case where we have nested structs, then
@@ -863,31 +967,293 @@ typedef struct internal_pixie_move_t {
 } internal_pixie_move_t;
 
 
+// Number of segments each easing curve is sampled into, for the lookup tables used by sprite movement
+#define INTERNAL_PIXIE_EASE_TABLE_SIZE 256
+
+
+// Pre-rendered songs (as built by `build_song_rendered`) are stored as this header, followed directly by the sample
+// data, which is either plain 16-bit stereo samples or IMA ADPCM blocks. The id string is what `play_song` uses to tell
+// them apart from midi songs. All positions and lengths are in sample pairs.
+
+#define INTERNAL_PIXIE_SONG_PCM_ID "PIXIEPCM"
+#define INTERNAL_PIXIE_SONG_PCM_ADPCM_BLOCK 1025 // Sample pairs per ADPCM block, odd so it works for mono too
+
+typedef enum internal_pixie_song_pcm_encoding_t {
+    INTERNAL_PIXIE_SONG_PCM_ENCODING_PCM16, 
+    INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM,
+} internal_pixie_song_pcm_encoding_t;
+
+
+typedef struct internal_pixie_song_pcm_t {
+    char id[ 8 ];
+    i32 sample_rate;
+    i32 encoding;
+    i32 samples_per_block; // Only used for ADPCM
+    i32 block_size; // Size in bytes of each ADPCM block
+    i32 length;
+    i32 loop_start; // Playback restarts from here when reaching `loop_end`
+    i32 loop_end;
+    i32 start; // Leading silence skipped by the build, so positions can be reported in the same time as midi songs
+} internal_pixie_song_pcm_t;
+
+
+// Sound effects (as built by `build_sound`) are stored as this header, followed by IMA ADPCM blocks. Each block can be
+// decoded on its own, so the audio thread only ever needs to decode one block at a time. Positions and lengths are in
+// sample frames (one sample for each channel).
+
+#define INTERNAL_PIXIE_SOUND_ID "PIXIESND"
+#define INTERNAL_PIXIE_SOUND_ADPCM_BLOCK 1025 // Sample frames per block, odd so mono blocks are whole bytes
+#define INTERNAL_PIXIE_SOUND_CHANNELS 4
+
+typedef struct internal_pixie_sound_t {
+    char id[ 8 ];
+    i32 sample_rate;
+    i32 channels; // 1 or 2
+    i32 samples_per_block;
+    i32 block_size; // Size in bytes of each ADPCM block
+    i32 length;
+    i32 reserved;
+} internal_pixie_sound_t;
+
+
+// Playback state for a sound, used both for the sound effect channels and for the stream channel.
+
+typedef struct internal_pixie_sound_channel_t {
+    internal_pixie_sound_t const* sound; // Points into the asset bundle, NULL if not playing
+    i16 const* samples; // Fully decoded samples from `sound_cache`, or NULL to decode one block at a time
+    int position;
+    u32 position_fraction; // 16.16 fraction of `position`, used when resampling to the device rate
+    int decoded_block; // Index of the ADPCM block currently held in `decoded`, or -1 if none
+    i16* decoded; // One block, followed by the first frame of the next block, so interpolation never needs two blocks
+} internal_pixie_sound_channel_t;
+
+
+// Recently played sounds are kept fully decoded, up to a total of PIXIE_SOUND_CACHE_SIZE bytes, so that frequently
+// used effects don't have to be decoded every time they are played. Sounds too large for the cache are decoded a block
+// at a time as they play.
+
+#ifndef PIXIE_SOUND_CACHE_SIZE
+    #define PIXIE_SOUND_CACHE_SIZE ( 2 * 1024 * 1024 )
+#endif
+
+#define INTERNAL_PIXIE_SOUND_CACHE_ENTRIES 32
+
+
+// Long sounds, like music or voice-over, can be played with `play_stream`, in which case they are decoded ahead of 
+// time by a reader thread, into a ring buffer which the audio callback reads from without locking. The ring buffer 
+// holds PIXIE_STREAM_BUFFER_MS of audio at the device rate, regardless of the length of the sound, and is filled a 
+// frame's worth of audio at a time.
+
+#ifndef PIXIE_STREAM_BUFFER_MS
+    #define PIXIE_STREAM_BUFFER_MS 250
+#endif
+
+
+// The sound buffer starts out at PIXIE_SOUND_BUFFER_MIN_FRAMES frames (1/60th of a second) worth of audio, and grows
+// by a frame, up to PIXIE_SOUND_BUFFER_MAX_FRAMES, whenever the sound device runs out of samples or mixing goes over 
+// budget. Resizing means reopening the sound device, which leaves a brief gap in playback, so the buffer is never made
+// smaller than it started out - a machine which keeps up never has its sound reopened. After growing, it shrinks back 
+// by a frame after a stretch with no problems. That stretch starts out at ten seconds, and doubles each time the buffer
+// has to grow, and if problems come back after shrinking, the larger size is kept from then on, so that a machine 
+// which can't keep up at a low latency settles on a larger buffer instead of repeatedly dropping out.
+
+#ifndef PIXIE_SOUND_BUFFER_MIN_FRAMES
+    #define PIXIE_SOUND_BUFFER_MIN_FRAMES 3
+#endif
+
+#ifndef PIXIE_SOUND_BUFFER_MAX_FRAMES
+    #define PIXIE_SOUND_BUFFER_MAX_FRAMES 8
+#endif
+
+#define INTERNAL_PIXIE_SOUND_BUFFER_SHRINK_DELAY ( 60 * 10 ) // In frames
+
+
+// When PIXIE_SONG_WORKERS is defined to a value greater than 0, midi songs are rendered ahead of time on that many 
+// worker threads instead of in the audio callback, with the channels split between them (channel `c` is played by 
+// worker `c % PIXIE_SONG_WORKERS`). Each worker has its own synth, a copy of the main soundfont sharing its preset and
+// sample data, and its own cursor into the song. It renders into a ring buffer, which the audio callback mixes from.
+// The audio callback never waits for a worker or renders anything itself - if a worker falls behind, its part of the
+// song is silent until it catches up.
+
+#ifndef PIXIE_SONG_WORKERS
+    #define PIXIE_SONG_WORKERS 0
+#endif
+
+typedef struct internal_pixie_song_worker_t {
+    thread_ptr_t thread;
+    thread_signal_t signal; // Raised when there's space in the ring buffer, when the song is changed and on exit
+    thread_mutex_t mutex; // Held by the worker while rendering, and by the user thread while changing the song
+    thread_atomic_int_t exit_flag;
+    tsf* sound_font;
+    struct mid_t song;
+    int capacity; // Size of `buffer` in sample pairs
+    int chunk_size; // Number of sample pairs rendered at a time
+    i16* buffer;
+    // Positions are in sample pairs since the worker was started, and are only ever increased. They wrap around 
+    // after 2^32 samples, so all comparisons are done on their difference, as unsigned values.
+    thread_atomic_int_t write_pos; // Only changed by the worker
+    thread_atomic_int_t read_pos; // Only changed by the audio callback, ahead of `write_pos` if the worker is behind
+    thread_atomic_int_t valid_pos; // Samples before this are for a song which is no longer playing, and are skipped
+} internal_pixie_song_worker_t;
+
+
 // Main engine state - *everything* is stored here, and data is accessed from both the app thread and the user thread,
 // with various mutexes being used to limit concurrent access where necessary. The instance is created within the `run` 
 // function, and a pointer to it is stored in thread local storage for the user thread, so that every API method can 
 // access it to perform its function. The app thread gets a pointer to it through the user_data parameter to the 
 // internal_pixie_app_proc.
 
-typedef enum internal_pixie_sprite_type_t { TYPE_NONE, TYPE_SPRITE, TYPE_LABEL, } internal_pixie_sprite_type_t;
+typedef enum internal_pixie_sprite_type_t { TYPE_NONE, TYPE_SPRITE, TYPE_LABEL, TYPE_TILEMAP, TYPE_SURFACE, } 
+    internal_pixie_sprite_type_t;
+
+
+// Tileset assets (built by `build_tileset` in pixie_build.h) start with this header. It is followed by the map, with
+// one u16 tile index per cell, then one byte per tile which is non-zero if the tile is fully opaque, and finally the
+// tiles themselves, each stored as `tile_width * tile_height` palette indices followed by as many mask values. The id
+// string is what `tilemap` uses to tell tilesets apart from other assets.
+
+#define INTERNAL_PIXIE_TILESET_ID "PIXIETIL"
+
+typedef struct internal_pixie_tileset_t {
+    char id[ 8 ];
+    int tile_width;
+    int tile_height;
+    int tile_count;
+    int map_width;
+    int map_height;
+} internal_pixie_tileset_t;
+
+#define INTERNAL_PIXIE_TILE_EMPTY 0xffff // Map value for cells without a tile
+
+
+// Sprite assets (built by `build_sprite` in pixie_build.h) start with the number of cels, followed by one of these for
+// each cel, and then the RLE data of all the cels. The boxes let the renderer skip sprites which are off screen or
+// hidden behind opaque sprites, without touching their RLE data. All positions are relative to the top left of the cel.
+
+typedef struct internal_pixie_sprite_cel_t {
+    int offset; // From the start of the asset to the RLE data of the cel
+    int x; // Bounding box of the visible pixels
+    int y;
+    int width;
+    int height;
+    int opaque_x; // Largest fully opaque rectangle, with zero size if there is none
+    int opaque_y;
+    int opaque_width;
+    int opaque_height;
+    int cel_width; // Full size of the cel, to place the boxes when the sprite is flipped
+    int cel_height;
+} internal_pixie_sprite_cel_t;
+
+
+// Maximum number of opaque rectangles kept by `internal_pixie_cull_sprites` to test the sprites behind them against
+#define INTERNAL_PIXIE_OCCLUDERS 16
+
+
+// How a sprite was drawn in the last frame, kept by `internal_pixie_find_damage` to tell which sprites have changed.
+// Everything which affects the pixels drawn goes into `key`, so a sprite needs redrawing if any of it differs.
+
+typedef struct internal_pixie_render_state_t {
+    int top; // Rows of the screen the sprite covers, with `bottom` exclusive. Both are 0 if nothing is drawn.
+    int bottom;
+    int key[ 12 ];
+} internal_pixie_render_state_t;
+
+
+// Offscreen bitmap created by `surface_create`, which the drawing functions can draw to (selected with `draw_target`)
+// and which can be displayed by any number of sprites. A slot with no `pixels` is free.
+
+typedef struct internal_pixie_surface_t {
+    int width;
+    int height;
+    int version; // The surface `version` of the latest change, so the app thread only copies surfaces that changed
+    u8* pixels;
+    u8* mask; // Non-zero for pixels which have been drawn to
+    palrle_data_t* rle; // Set by `surface_encode`, and dropped again when the surface is drawn to
+} internal_pixie_surface_t;
 
 
 typedef struct internal_pixie_sprite_moves_t {
     int count;
-    internal_pixie_move_t moves[ 16 ];
     int index;
     int time;
     int start;
     int loop;
+    internal_pixie_move_t moves[ 16 ];
 } internal_pixie_sprite_moves_t;
 
 
+// Cel animation set up by `sprite_animate`, advanced by the app thread (in `internal_pixie_frame_update`)
+
+typedef struct internal_pixie_sprite_anim_t {
+    int active;
+    int first;
+    int last;
+    int frames_per_cel;
+    anim_mode_t mode;
+    int time; // Frames since the current cel was shown
+    int dir; // 1 when moving from `first` towards `last`, -1 on the way back (for ANIM_PINGPONG)
+} internal_pixie_sprite_anim_t;
+
+
+// Number of straight pieces each curved path segment is split into, when building the arc-length table
+#define INTERNAL_PIXIE_PATH_STEPS 16
+
+// Path set up by `sprite_move_path`. The curve is flattened into points along it, with the distance from the start to
+// each of them, so that the app thread can move along it at constant speed, regardless of how the control points are
+// spaced. Allocated as a single block, with the `samples` array directly after the struct.
+
+typedef struct internal_pixie_sprite_path_t {
+    int active;
+    int duration;
+    int time;
+    int loop;
+    internal_pixie_move_type_t type; // The easing function to use, as one of the move types
+    int count;
+    struct {
+        i32 x; // 16.16 fixed point
+        i32 y; // 16.16 fixed point
+        i32 distance; // From the start of the path, 16.16 fixed point
+    }* samples;
+} internal_pixie_sprite_path_t;
+
+
+#define INTERNAL_PIXIE_PALETTE_CYCLES 8
+
+// Palette effects, updated by the app thread once per frame (in `internal_pixie_frame_update`) and written directly to
+// the user thread palette, so they cost nothing on the user thread.
+
+typedef struct internal_pixie_palette_effects_t {
+    struct {
+        int duration; // Length of the fade in frames, or 0 if no fade is in progress
+        int time;
+        internal_pixie_move_type_t type; // The easing function to use, as one of the move types
+        u32 from[ 256 ];
+        u32 to[ 256 ];
+    } fade;
+
+    struct {
+        int first;
+        int last;
+        int speed; // Steps per second, or 0 if the cycle is not in use
+        int accumulator; // Time since the last step, in 1/60 of a step
+    } cycles[ INTERNAL_PIXIE_PALETTE_CYCLES ];
+} internal_pixie_palette_effects_t;
+
+
+// Number of layers sprites can be assigned to with `sprite_layer`, each scrolled by the camera at its own speed
+#define INTERNAL_PIXIE_LAYER_COUNT 8
+
+// Number of color remap tables which can be set up with `remap_table`, numbered from 1 and up
+#define INTERNAL_PIXIE_REMAP_TABLES 16
+
+
 typedef struct internal_pixie_sprite_t {
     int x;
     int y;
     int origin_x;
     int origin_y;
     int visible;
+    int layer;
 
     internal_pixie_sprite_type_t type;
             
@@ -895,6 +1261,11 @@ typedef struct internal_pixie_sprite_t {
         struct {
             asset_t asset;
             int cel;
+            int flip; // Combination of FLIP_H and FLIP_V
+            int remap; // Color remap table to draw with, or 0 to draw with the original colors
+            blend_t blend;
+            int scale_x; // 16.16 fixed point
+            int scale_y; // 16.16 fixed point
         } sprite;
 
         struct {
@@ -906,10 +1277,24 @@ typedef struct internal_pixie_sprite_t {
 		    int shadow;
             int wrap;
         } label;
+
+        struct {
+            asset_t asset;
+            int width; // Size of the map, in tiles
+            int height;
+            int version; // The `tilemap_version` of the latest change, so the app thread only copies maps that changed
+            u16* map; // One tile index per cell, or INTERNAL_PIXIE_TILE_EMPTY
+        } tilemap;
+
+        struct {
+            int surface;
+        } surface;
     } data;
 
     internal_pixie_sprite_moves_t move_x;
     internal_pixie_sprite_moves_t move_y;
+    internal_pixie_sprite_anim_t anim;
+    internal_pixie_sprite_path_t* path;
 
 } internal_pixie_sprite_t;
 
@@ -927,18 +1312,40 @@ typedef struct internal_pixie_user_thread_data_t {
 
     struct { 
         u32 palette[ 256 ];
+        u8 remap_tables[ INTERNAL_PIXIE_REMAP_TABLES ][ 256 ];
         int screen_width;
         int screen_height;
         int border_width;
         int border_height;
         u8* pixels;
+        int damage_top; // Rows of `pixels` drawn to since the last frame, with `damage_bottom` exclusive
+        int damage_bottom;
     } screen;
 
     struct {
         int sprite_count;
         internal_pixie_sprite_t* sprites;
+        int tilemap_version; // Incremented for every change made to any tilemap
     } sprites;
 
+    struct {
+        int count;
+        internal_pixie_surface_t* surfaces;
+        int version; // Incremented for every change made to any surface
+        int draw_target; // Surface which drawing functions draw to, or 0 for the screen
+    } surfaces;
+
+    internal_pixie_palette_effects_t palette_effects;
+
+    // Scroll position, subtracted from the position of every sprite when it is rendered, scaled by the parallax 
+    // factor of the layer the sprite is on
+    struct {
+        int x;
+        int y;
+        int parallax_x[ INTERNAL_PIXIE_LAYER_COUNT ]; // In percent of the camera movement
+        int parallax_y[ INTERNAL_PIXIE_LAYER_COUNT ];
+    } camera;
+
 } internal_pixie_user_thread_data_t;
 
 
@@ -946,6 +1353,13 @@ typedef struct internal_pixie_t {
     thread_atomic_ptr_t acquired_instance;
     thread_mutex_t instance_mutex;
 
+    // Set up by `pixie_batch_begin` to let the user thread hold on to the acquired instance across many API calls.
+    // Only ever accessed from the user thread.
+    struct {
+        int depth; // Number of `pixie_batch_begin` calls not yet matched by a `pixie_batch_end`
+        struct internal_pixie_t* instance; // The instance acquired by the outermost `pixie_batch_begin`
+    } batch;
+
     // Controls the exit of the program, both via the `end` call and the window being closed
     struct {
         jmp_buf exit_jump; // Jump target set in `run` function, to jump back to when `end` is called
@@ -987,19 +1401,143 @@ typedef struct internal_pixie_t {
 
         struct { 
             u32* xbgr;
+            u8* composite; // The screen with all the sprites drawn on top, kept from one frame to the next
         } screen;
 
         internal_pixie_user_thread_data_t copy_of_user_thread;
 
+        // Easing curves for each move type, in 16.16 fixed point. The last sample is repeated, so that interpolating
+        // at the very end of the curve doesn't need a special case.
+        i32 ease_tables[ INTERNAL_PIXIE_MOVECOUNT ][ INTERNAL_PIXIE_EASE_TABLE_SIZE + 2 ];
+
+        // The moves in progress, gathered every frame by `internal_pixie_update_sprite_moves` into separate arrays 
+        // so they can all be evaluated in a single tight loop
+        struct {
+            int capacity;
+            int count;
+            int** values; // Sprite position to update
+            i32* starts;
+            i32* ranges;
+            i32* times; // Progress through the move, in 16.16 fixed point
+            i32 const** tables; // Easing curve to use
+        } tweens;
+
+        // Lookup tables for `sprite_blend`, one 256x256 table for each blend mode (apart from BLEND_NONE), built from 
+        // the palette by a worker thread. They are not built until a sprite is drawn blended, and are rebuilt in the 
+        // background whenever the palette changes, with the previous tables being used until the new ones are done.
+        struct {
+            thread_ptr_t thread; // NULL until tables are first requested
+            thread_signal_t signal; // Raised when new tables are requested, and on exit
+            thread_mutex_t mutex; // Held while accessing `palette`, `requested`, `ready` and `ready_is_new`
+            thread_atomic_int_t exit_flag;
+            u32 palette[ 256 ]; // The palette to build tables for
+            int requested; // Set when `palette` changes, and cleared by the worker when it starts building
+            u8* ready; // The most recently completed tables, swapped with `tables` if `ready_is_new` is set
+            int ready_is_new;
+            u8* building; // Only accessed by the worker
+            u8* tables; // The tables used for rendering, NULL until the first ones have been built
+            int used; // 1 once a sprite has been drawn blended, 2 once tables have been requested
+        } blend;
+
+        // One entry for each sprite, set by `internal_pixie_cull_sprites` if it doesn't need to be drawn this frame
+        u8* culled;
+
+        // Damage tracking, so only the rows of the screen where something has changed since the last frame are 
+        // recomposited and converted to XBGR
+        struct {
+            internal_pixie_render_state_t* states; // One for each sprite
+            u8* rows; // One entry for each row of the screen, set if it needs to be redrawn this frame
+            int width; // Size of the screen in the last frame, or 0 before the first one
+            int height;
+            u32 palette[ 256 ]; // The palette the XBGR screen was converted with
+            u8 remap_tables[ INTERNAL_PIXIE_REMAP_TABLES ][ 256 ]; // The remap tables the sprites were drawn with
+            u8 const* blend_tables; // The blend tables the sprites were drawn with
+        } damage;
+
     } app_thread;
 
     struct {
         int sound_buffer_size;
+        int sample_rate; // Rate of the sound device, which everything is rendered at
         i16* mix_buffers;
 
         thread_mutex_t song_mutex;
         tsf* sound_font;
         struct mid_t current_song;
+
+        #if PIXIE_SONG_WORKERS > 0
+            internal_pixie_song_worker_t song_workers[ PIXIE_SONG_WORKERS ];
+        #endif
+        thread_atomic_int_t song_underruns; // Number of times the audio callback found a song worker's buffer empty
+
+        // Used instead of `current_song` when the song being played is pre-rendered
+        struct {
+            internal_pixie_song_pcm_t const* song; // Points into the asset bundle, NULL if not playing
+            int position;
+            u32 position_fraction; // 16.16 fraction of `position`, used when resampling to the device rate
+            int decoded_block; // Index of the ADPCM block currently held in `decoded`, or -1 if none
+            i16* decoded;
+        } prerendered;
+
+        thread_mutex_t sound_mutex; // Held while changing or rendering the `sounds` channels
+        internal_pixie_sound_channel_t sounds[ INTERNAL_PIXIE_SOUND_CHANNELS ];
+
+        // Only accessed from the user thread, apart from the samples of entries which are currently playing
+        struct {
+            int size; // Total size, in bytes, of all entries
+            u32 counter; // Incremented every time an entry is used, to find the least recently used one
+            struct {
+                internal_pixie_sound_t const* sound; // NULL for unused entries
+                i16* samples;
+                int size;
+                u32 last_used;
+            } entries[ INTERNAL_PIXIE_SOUND_CACHE_ENTRIES ];
+        } sound_cache;
+
+        struct {
+            thread_ptr_t thread;
+            thread_signal_t signal; // Raised when there's space in the ring buffer, when the stream changes and on exit
+            thread_mutex_t mutex; // Held by the reader while decoding, and by the user thread while changing `channel`
+            thread_atomic_int_t exit_flag;
+            internal_pixie_sound_channel_t channel; // Only accessed by the reader thread, apart from in `play_stream`
+            int capacity; // Size of `buffer` in sample pairs
+            int chunk_size; // Number of sample pairs decoded at a time
+            i16* buffer;
+            // Positions are in sample pairs since the reader was started, and are only ever increased. They wrap 
+            // around after 2^32 samples, so all comparisons are done on their difference, as unsigned values.
+            thread_atomic_int_t write_pos; // Only changed by the reader
+            thread_atomic_int_t read_pos; // Only changed by the audio callback
+            thread_atomic_int_t start_pos; // Where the current stream starts - samples before this are skipped
+            thread_atomic_int_t end_pos; // Where the current stream ends, only valid once `ended` is set
+            thread_atomic_int_t ended; // Set by the reader when all of the stream has been written to the buffer
+            thread_atomic_int_t filled; // Set by the reader once the buffer has been filled for the current stream
+            // Incremented before and after the stream is changed, so it is odd while `start_pos`, `end_pos` and 
+            // `ended` are being updated. The audio callback checks it is unchanged after reading them.
+            thread_atomic_int_t generation;
+            thread_atomic_int_t underruns; // Number of times the audio callback found the buffer empty mid-stream
+        } stream;
+
+        app_t* app; // Used by the audio callback to time itself, set by the app thread before starting playback
+        struct {
+            APP_U64 prev_callback; // Time of the previous callback, only accessed by the audio callback
+            // Written by the audio callback, and read by the user thread (for `sound_stats`) and the app thread
+            thread_atomic_int_t callbacks;
+            thread_atomic_int_t period_avg_us; // Moving average, over roughly the last 16 callbacks
+            thread_atomic_int_t period_max_us;
+            thread_atomic_int_t render_avg_us; // Moving average, over roughly the last 16 callbacks
+            thread_atomic_int_t render_max_us;
+            thread_atomic_int_t underruns;
+            thread_atomic_int_t overruns;
+            // Written by the app thread when it adapts the size of the sound buffer
+            thread_atomic_int_t buffer_size;
+            thread_atomic_int_t buffer_changes;
+            // Only accessed by the app thread
+            int problems; // Sum of `underruns` and `overruns` when the buffer size was last checked
+            int clean_frames; // Number of frames since the last problem or buffer size change
+            int shrink_delay; // Number of clean frames needed before the buffer is made smaller
+            int min_size; // The buffer is never made smaller than this, raised if problems come back after shrinking
+            int shrunk; // Set if the last change to the buffer size made it smaller
+        } timing;
     } audio;
 
     #ifndef PIXIE_NO_BUILD
@@ -1039,11 +1577,16 @@ static internal_pixie_t* internal_pixie_instance( void ) {
 }
 
 
+// Takes exclusive access to the `internal_pixie_t` state, blocking the app thread from copying it until it is given
+// back with `internal_pixie_release`. Between `pixie_batch_begin` and `pixie_batch_end`, the instance is already held
+// by the user thread, so it is returned without any synchronization at all.
+
 static internal_pixie_t* internal_pixie_acquire( void ) { 
     // Get the `internal_pixie_t` pointer for this thread from the global TLS instance `g_internal_pixie_tls`
     internal_pixie_t*  pixie = (internal_pixie_t*) thread_tls_get( thread_atomic_ptr_load( &g_internal_pixie_tls ) );
 
-    void* instance = thread_atomic_ptr_compare_and_swap( &pixie->acquired_instance, pixie, NULL );
+    void* instance = pixie->batch.depth > 0 ? pixie->batch.instance : NULL;
+    if( !instance ) instance = thread_atomic_ptr_compare_and_swap( &pixie->acquired_instance, pixie, NULL );
     if( !instance ) {
         thread_mutex_lock( &pixie->instance_mutex );
         instance = thread_atomic_ptr_compare_and_swap( &pixie->acquired_instance, pixie, NULL );
@@ -1062,13 +1605,264 @@ static void internal_pixie_release( internal_pixie_t* instance ) {
     // Get the `internal_pixie_t` pointer for this thread from the global TLS instance `g_internal_pixie_tls`
     internal_pixie_t*  pixie = (internal_pixie_t*) thread_tls_get( thread_atomic_ptr_load( &g_internal_pixie_tls ) );
 
+    // Within a batch, the instance is held until the outermost `pixie_batch_end`
+    if( pixie->batch.depth > 0 ) return;
+
     thread_atomic_ptr_compare_and_swap( &pixie->acquired_instance, NULL, instance );
 }
 
 
+#if PIXIE_SONG_WORKERS > 0
+
+// Entry point for the song worker threads. Keeps the worker's ring buffer filled, one chunk at a time, and sleeps 
+// whenever it is full or there's no midi song playing, until the audio callback or the user thread raises its signal.
+// If it has fallen behind the audio callback, it keeps rendering (to keep its place in the song) until it has caught
+// up, and the samples it missed are overwritten before they are ever read.
+
+static int internal_pixie_song_worker_thread( void* user_data ) {
+    internal_pixie_song_worker_t* worker = (internal_pixie_song_worker_t*) user_data;
+
+    while( !thread_atomic_int_load( &worker->exit_flag ) ) {
+        u32 write_pos = (u32) thread_atomic_int_load( &worker->write_pos );
+        int used = (int)( write_pos - (u32) thread_atomic_int_load( &worker->read_pos ) );
+        int count = worker->capacity - ( used > 0 ? used : 0 );
+        if( count < worker->chunk_size ) {
+            thread_signal_wait( &worker->signal, THREAD_SIGNAL_WAIT_INFINITE );
+            continue;
+        }
+
+        thread_mutex_lock( &worker->mutex );
+        if( !worker->song.song.data ) {
+            thread_mutex_unlock( &worker->mutex );
+            thread_signal_wait( &worker->signal, THREAD_SIGNAL_WAIT_INFINITE );
+            continue;
+        }
+        int offset = (int)( write_pos % (u32) worker->capacity );
+        count = worker->chunk_size;
+        if( count > worker->capacity - offset ) count = worker->capacity - offset; // Don't render past the wrap
+        mid_render_short( &worker->song, worker->buffer + offset * 2, count, worker->sound_font );
+        thread_atomic_int_store( &worker->write_pos, (int)( write_pos + (u32) count ) );
+        thread_mutex_unlock( &worker->mutex );
+    }
+
+    return 0;
+}
+
+#endif /* PIXIE_SONG_WORKERS > 0 */
+
+
+static int internal_pixie_render_sound( internal_pixie_sound_channel_t* channel, int sample_rate, 
+    i16* sample_pairs, int sample_pairs_count );
+
+
+// Entry point for the stream reader thread. Keeps the stream ring buffer filled, one chunk at a time, and sleeps 
+// whenever it is full or there's no stream playing.
+
+static int internal_pixie_stream_thread( void* user_data ) {
+    internal_pixie_t* pixie = (internal_pixie_t*) user_data;
+
+    while( !thread_atomic_int_load( &pixie->audio.stream.exit_flag ) ) {
+        u32 write_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.write_pos );
+        u32 used = write_pos - (u32) thread_atomic_int_load( &pixie->audio.stream.read_pos );
+        int count = pixie->audio.stream.capacity - (int) used;
+        if( count < pixie->audio.stream.chunk_size ) {
+            thread_signal_wait( &pixie->audio.stream.signal, 100 );
+            continue;
+        }
+
+        thread_mutex_lock( &pixie->audio.stream.mutex );
+        if( !pixie->audio.stream.channel.sound ) {
+            thread_mutex_unlock( &pixie->audio.stream.mutex );
+            thread_signal_wait( &pixie->audio.stream.signal, 100 );
+            continue;
+        }
+        int offset = (int)( write_pos % (u32) pixie->audio.stream.capacity );
+        count = pixie->audio.stream.chunk_size;
+        if( count > pixie->audio.stream.capacity - offset ) count = pixie->audio.stream.capacity - offset;
+        count = internal_pixie_render_sound( &pixie->audio.stream.channel, pixie->audio.sample_rate, 
+            pixie->audio.stream.buffer + offset * 2, count );
+        write_pos += (u32) count;
+        thread_atomic_int_store( &pixie->audio.stream.write_pos, (int) write_pos );
+        if( !pixie->audio.stream.channel.sound ) {
+            thread_atomic_int_store( &pixie->audio.stream.end_pos, (int) write_pos );
+            thread_atomic_int_store( &pixie->audio.stream.ended, 1 );
+        }
+
+        // Until the buffer has been filled (or the whole stream written) once, the audio callback may be ahead of the
+        // reader just because the stream has only started, so that's not counted as an underrun. Samples left over 
+        // from the previous stream are skipped, so only the ones written since `start_pos` count towards filling it.
+        u32 read_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.read_pos );
+        u32 start_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.start_pos );
+        if( (int)( start_pos - read_pos ) > 0 ) read_pos = start_pos;
+        if( !pixie->audio.stream.channel.sound || 
+            (int)( write_pos - read_pos ) > pixie->audio.stream.capacity - pixie->audio.stream.chunk_size ) {
+            thread_atomic_int_store( &pixie->audio.stream.filled, 1 );
+        }
+        thread_mutex_unlock( &pixie->audio.stream.mutex );
+    }
+
+    return 0;
+}
+
+
+// Easing functions for each of the move types. Also used for palette fades, as `easing_t` values map directly to move 
+// types (offset by INTERNAL_PIXIE_MOVE_LINEAR)
+
+static float (* const internal_pixie_easefuncs[])( float ) = { 
+    ease_linear, ease_linear, ease_linear, ease_linear, ease_smoothstep, ease_smootherstep, ease_out_quad, 
+    ease_out_back, ease_out_bounce, ease_out_sine, ease_out_elastic, ease_out_expo, ease_out_cubic, ease_out_quart, 
+    ease_out_quint, ease_out_circle, ease_in_quad, ease_in_back, ease_in_bounce, ease_in_sine, ease_in_elastic, 
+    ease_in_expo,  ease_in_cubic, ease_in_quart, ease_in_quint, ease_in_circle, ease_in_out_quad, 
+    ease_in_out_back, ease_in_out_bounce, ease_in_out_sine, ease_in_out_elastic, ease_in_out_expo, 
+    ease_in_out_cubic, ease_in_out_quart, ease_in_out_quint, ease_in_out_circle,
+};
+
+
+// Samples the easing function of each move type into a lookup table, so that moves can be evaluated without calling
+// the float easing functions (many of which use `pow`, `sin` or `sqrt`) for every move every frame.
+
+static void internal_pixie_build_ease_tables( i32 (*tables)[ INTERNAL_PIXIE_EASE_TABLE_SIZE + 2 ] ) {
+    for( int type = 0; type < INTERNAL_PIXIE_MOVECOUNT; ++type ) {
+        for( int i = 0; i <= INTERNAL_PIXIE_EASE_TABLE_SIZE; ++i ) {
+            float t = internal_pixie_easefuncs[ type ]( (float) i / (float) INTERNAL_PIXIE_EASE_TABLE_SIZE );
+            tables[ type ][ i ] = (i32)( t * 65536.0f + ( t < 0.0f ? -0.5f : 0.5f ) );
+        }
+        tables[ type ][ INTERNAL_PIXIE_EASE_TABLE_SIZE + 1 ] = tables[ type ][ INTERNAL_PIXIE_EASE_TABLE_SIZE ];
+    }
+}
+
+
+#define INTERNAL_PIXIE_BLEND_TABLE_SIZE ( 256 * 256 )
+#define INTERNAL_PIXIE_BLEND_TABLES_SIZE ( ( BLEND_SHADOW - BLEND_NONE ) * INTERNAL_PIXIE_BLEND_TABLE_SIZE )
+
+// Builds one 256x256 table for each blend mode, mapping each pair of bitmap color and screen color to the palette 
+// entry closest to the blended color. Blended colors are looked up in a 32x32x32 inverse palette, which is filled in
+// as it is used, so that only the parts of the color cube the blends actually reach need to be searched for.
+
+static void internal_pixie_build_blend_tables( u32 const* palette, u8* tables ) {
+    i16* inverse = (i16*) malloc( sizeof( i16 ) * 32 * 32 * 32 );
+    memset( inverse, 0xff, sizeof( i16 ) * 32 * 32 * 32 ); // All -1, meaning not searched yet
+
+    int rgb[ 256 ][ 3 ];
+    for( int i = 0; i < 256; ++i ) {
+        rgb[ i ][ 0 ] = (int)( palette[ i ] & 0xff );
+        rgb[ i ][ 1 ] = (int)( ( palette[ i ] >> 8 ) & 0xff );
+        rgb[ i ][ 2 ] = (int)( ( palette[ i ] >> 16 ) & 0xff );
+    }
+
+    for( int mode = BLEND_HALF; mode <= BLEND_SHADOW; ++mode ) {
+        u8* table = tables + ( mode - BLEND_HALF ) * INTERNAL_PIXIE_BLEND_TABLE_SIZE;
+        for( int src = 0; src < 256; ++src ) {
+            for( int dst = 0; dst < 256; ++dst ) {
+                int c[ 3 ];
+                for( int j = 0; j < 3; ++j ) {
+                    int a = rgb[ src ][ j ];
+                    int b = rgb[ dst ][ j ];
+                    switch( mode ) {
+                        case BLEND_HALF: c[ j ] = ( a + b ) >> 1; break;
+                        case BLEND_ADD: c[ j ] = a + b > 255 ? 255 : a + b; break;
+                        case BLEND_MULTIPLY: c[ j ] = ( a * b + 127 ) / 255; break;
+                        default: c[ j ] = b >> 1; break; // BLEND_SHADOW only uses the shape of the bitmap
+                    }
+                }
+                int cell = ( c[ 0 ] >> 3 ) | ( ( c[ 1 ] >> 3 ) << 5 ) | ( ( c[ 2 ] >> 3 ) << 10 );
+                if( inverse[ cell ] < 0 ) {
+                    // Search from the center of the cell
+                    int r = ( ( c[ 0 ] >> 3 ) << 3 ) + 4;
+                    int g = ( ( c[ 1 ] >> 3 ) << 3 ) + 4;
+                    int b = ( ( c[ 2 ] >> 3 ) << 3 ) + 4;
+                    int best = 0;
+                    int best_distance = INT_MAX;
+                    for( int i = 0; i < 256; ++i ) {
+                        int dr = rgb[ i ][ 0 ] - r;
+                        int dg = rgb[ i ][ 1 ] - g;
+                        int db = rgb[ i ][ 2 ] - b;
+                        int distance = dr * dr + dg * dg + db * db;
+                        if( distance < best_distance ) {
+                            best_distance = distance;
+                            best = i;
+                        }
+                    }
+                    inverse[ cell ] = (i16) best;
+                }
+                table[ ( src << 8 ) | dst ] = (u8) inverse[ cell ];
+            }
+        }
+    }
+
+    free( inverse );
+}
+
+
+// Entry point for the blend table worker thread. Builds tables for the most recently requested palette, and sleeps 
+// when there's nothing to do. If the palette changes again while building (like during a fade) the requests are 
+// merged, so the worker always moves on to the latest palette.
+
+static int internal_pixie_blend_thread( void* user_data ) {
+    internal_pixie_t* pixie = (internal_pixie_t*) user_data;
+
+    while( !thread_atomic_int_load( &pixie->app_thread.blend.exit_flag ) ) {
+        thread_mutex_lock( &pixie->app_thread.blend.mutex );
+        if( !pixie->app_thread.blend.requested ) {
+            thread_mutex_unlock( &pixie->app_thread.blend.mutex );
+            thread_signal_wait( &pixie->app_thread.blend.signal, THREAD_SIGNAL_WAIT_INFINITE );
+            continue;
+        }
+        u32 palette[ 256 ];
+        memcpy( palette, pixie->app_thread.blend.palette, sizeof( palette ) );
+        pixie->app_thread.blend.requested = 0;
+        thread_mutex_unlock( &pixie->app_thread.blend.mutex );
+
+        if( !pixie->app_thread.blend.building ) {
+            pixie->app_thread.blend.building = (u8*) malloc( INTERNAL_PIXIE_BLEND_TABLES_SIZE );
+        }
+        internal_pixie_build_blend_tables( palette, pixie->app_thread.blend.building );
+
+        thread_mutex_lock( &pixie->app_thread.blend.mutex );
+        u8* ready = pixie->app_thread.blend.ready;
+        pixie->app_thread.blend.ready = pixie->app_thread.blend.building;
+        pixie->app_thread.blend.building = ready;
+        pixie->app_thread.blend.ready_is_new = 1;
+        thread_mutex_unlock( &pixie->app_thread.blend.mutex );
+    }
+
+    return 0;
+}
+
+
+// Called by the app thread once per frame, before rendering. Picks up tables completed by the worker, and asks for new
+// ones if the palette has changed since they were last requested. The worker is started the first time tables are
+// requested, so apps which never draw blended sprites don't have the thread at all.
+
+static void internal_pixie_update_blend_tables( internal_pixie_t* pixie, u32 const* palette ) {
+    if( !pixie->app_thread.blend.used ) return;
+
+    if( !pixie->app_thread.blend.thread ) {
+        pixie->app_thread.blend.thread = thread_create( internal_pixie_blend_thread, pixie, THREAD_STACK_SIZE_DEFAULT );
+    }
+
+    thread_mutex_lock( &pixie->app_thread.blend.mutex );
+    if( pixie->app_thread.blend.ready_is_new ) {
+        u8* tables = pixie->app_thread.blend.tables;
+        pixie->app_thread.blend.tables = pixie->app_thread.blend.ready;
+        pixie->app_thread.blend.ready = tables;
+        pixie->app_thread.blend.ready_is_new = 0;
+    }
+    if( pixie->app_thread.blend.used == 1 || 
+        memcmp( pixie->app_thread.blend.palette, palette, sizeof( pixie->app_thread.blend.palette ) ) != 0 ) {
+
+        pixie->app_thread.blend.used = 2; // Tables have been requested at least once
+        memcpy( pixie->app_thread.blend.palette, palette, sizeof( pixie->app_thread.blend.palette ) );
+        pixie->app_thread.blend.requested = 1;
+        thread_signal_raise( &pixie->app_thread.blend.signal );
+    }
+    thread_mutex_unlock( &pixie->app_thread.blend.mutex );
+}
+
+
 // Create the instance for holding the main engine state. Called from `run` before app thread is started.
 
-static internal_pixie_t* internal_pixie_create( int sound_buffer_size ) {
+static internal_pixie_t* internal_pixie_create( int sound_buffer_size, int sample_rate ) {
     // Allocate the state and clear it, to avoid uninitialized varible problems
     internal_pixie_t* pixie = (internal_pixie_t*) malloc( sizeof( internal_pixie_t ) );
     memset( pixie, 0, sizeof( *pixie ) );
@@ -1127,6 +1921,9 @@ static internal_pixie_t* internal_pixie_create( int sound_buffer_size ) {
     pixie->app_thread.screen.xbgr = (u32*) malloc( xbgr_size );
     memset( pixie->app_thread.screen.xbgr, 0, xbgr_size );
 
+    pixie->app_thread.screen.composite = (u8*) malloc( pixels_size );
+    memset( pixie->app_thread.screen.composite, 0, pixels_size );
+
 
     // Set up sprites
 
@@ -1142,19 +1939,93 @@ static internal_pixie_t* internal_pixie_create( int sound_buffer_size ) {
     pixie->app_thread.copy_of_user_thread.sprites.sprites = VOID_CAST( malloc( sprites_size ) );
     memset( pixie->app_thread.copy_of_user_thread.sprites.sprites, 0, sprites_size );
 
+    pixie->app_thread.culled = (u8*) malloc( sizeof( u8 ) * initial_sprite_count );
+    memset( pixie->app_thread.culled, 0, sizeof( u8 ) * initial_sprite_count );
+
+    size_t states_size = sizeof( internal_pixie_render_state_t ) * initial_sprite_count;
+    pixie->app_thread.damage.states = (internal_pixie_render_state_t*) malloc( states_size );
+    memset( pixie->app_thread.damage.states, 0, states_size );
+
+    internal_pixie_build_ease_tables( pixie->app_thread.ease_tables );
+
+    thread_signal_init( &pixie->app_thread.blend.signal );
+    thread_mutex_init( &pixie->app_thread.blend.mutex );
+    thread_atomic_int_store( &pixie->app_thread.blend.exit_flag, 0 );
+
+    // Remap tables start out as identity tables, so using one before it is set up draws the original colors
+    for( int i = 0; i < INTERNAL_PIXIE_REMAP_TABLES; ++i ) {
+        for( int j = 0; j < 256; ++j ) {
+            pixie->user_thread.screen.remap_tables[ i ][ j ] = (u8) j;
+        }
+    }
+
+    // Layer 0 is not scrolled by the camera, so sprites stay in screen space until they are assigned another layer
+    for( int i = 1; i < INTERNAL_PIXIE_LAYER_COUNT; ++i ) {
+        pixie->user_thread.camera.parallax_x[ i ] = 100;
+        pixie->user_thread.camera.parallax_y[ i ] = 100;
+    }
+
 
     // Set up audio
     
-    pixie->audio.sound_buffer_size = sound_buffer_size ;
+    pixie->audio.sound_buffer_size = sound_buffer_size;
+    pixie->audio.sample_rate = sample_rate;
     int const mix_buffer_count = 6; // 6 buffers (song, speech + 4 sounds);
     pixie->audio.mix_buffers = (i16*) malloc( sizeof( i16 ) * sound_buffer_size * 2 * mix_buffer_count ); 
     thread_mutex_init( &pixie->audio.song_mutex );
+    pixie->audio.prerendered.decoded_block = -1;
+    pixie->audio.prerendered.decoded = (i16*) malloc( sizeof( i16 ) * ( INTERNAL_PIXIE_SONG_PCM_ADPCM_BLOCK + 1 ) * 2 );
+    thread_mutex_init( &pixie->audio.sound_mutex );
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CHANNELS; ++i ) {
+        pixie->audio.sounds[ i ].decoded_block = -1;
+        pixie->audio.sounds[ i ].decoded = 
+            (i16*) malloc( sizeof( i16 ) * ( INTERNAL_PIXIE_SOUND_ADPCM_BLOCK + 1 ) * 2 );
+    }
 
-    int soundfont_size = 0;
-    u8 const* soundfont = default_soundfont( &soundfont_size );
-    pixie->audio.sound_font = tsf_load_memory( soundfont, soundfont_size );
-    tsf_channel_set_bank_preset( pixie->audio.sound_font, 9, 128, 0);
-    tsf_set_output( pixie->audio.sound_font, TSF_STEREO_INTERLEAVED, 44100, 0.0f );
+    thread_signal_init( &pixie->audio.stream.signal );
+    thread_mutex_init( &pixie->audio.stream.mutex );
+    thread_atomic_int_store( &pixie->audio.stream.exit_flag, 0 );
+    pixie->audio.stream.channel.decoded_block = -1;
+    pixie->audio.stream.channel.decoded = (i16*) malloc( sizeof( i16 ) * ( INTERNAL_PIXIE_SOUND_ADPCM_BLOCK + 1 ) * 2 );
+    pixie->audio.stream.capacity = (int)( ( (i64) sample_rate * PIXIE_STREAM_BUFFER_MS ) / 1000 );
+    pixie->audio.stream.chunk_size = sound_buffer_size / 3; // One frame worth of samples
+    pixie->audio.stream.capacity = pixie->audio.stream.capacity < sound_buffer_size * 2 ? 
+        sound_buffer_size * 2 : pixie->audio.stream.capacity;
+    pixie->audio.stream.buffer = (i16*) malloc( sizeof( i16 ) * pixie->audio.stream.capacity * 2 );
+    thread_atomic_int_store( &pixie->audio.stream.write_pos, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.read_pos, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.start_pos, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.end_pos, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.ended, 1 );
+    thread_atomic_int_store( &pixie->audio.stream.filled, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.generation, 0 );
+    thread_atomic_int_store( &pixie->audio.stream.underruns, 0 );
+    pixie->audio.stream.thread = thread_create( internal_pixie_stream_thread, pixie, THREAD_STACK_SIZE_DEFAULT );
+
+    thread_atomic_int_store( &pixie->audio.timing.buffer_size, sound_buffer_size );
+    pixie->audio.timing.shrink_delay = INTERNAL_PIXIE_SOUND_BUFFER_SHRINK_DELAY;
+    pixie->audio.timing.min_size = sound_buffer_size;
+
+    // The default soundfont is not loaded until a midi song is played, as the game might set its own soundfont first
+    pixie->audio.sound_font = NULL;
+
+    thread_atomic_int_store( &pixie->audio.song_underruns, 0 );
+    #if PIXIE_SONG_WORKERS > 0
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+            internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+            thread_signal_init( &worker->signal );
+            thread_mutex_init( &worker->mutex );
+            thread_atomic_int_store( &worker->exit_flag, 0 );
+            worker->sound_font = NULL; // Created from `sound_font` when it is loaded
+            worker->capacity = sound_buffer_size * 4;
+            worker->chunk_size = sound_buffer_size / 3; // One frame worth of samples
+            worker->buffer = (i16*) malloc( sizeof( i16 ) * worker->capacity * 2 );
+            thread_atomic_int_store( &worker->write_pos, 0 );
+            thread_atomic_int_store( &worker->read_pos, 0 );
+            thread_atomic_int_store( &worker->valid_pos, 0 );
+            worker->thread = thread_create( internal_pixie_song_worker_thread, worker, THREAD_STACK_SIZE_DEFAULT );
+        }
+    #endif
 
     return pixie;
 }
@@ -1162,12 +2033,35 @@ static internal_pixie_t* internal_pixie_create( int sound_buffer_size ) {
 
 // Destroy the specified pixie instance. Called by `run` function, after app thread has finished.
 
+// Frees the memory owned by a sprite (the text of a label or the map of a tilemap) and clears its type specific data
+
+static void internal_pixie_free_sprite_data( internal_pixie_sprite_t* sprite ) {
+    if( sprite->type == TYPE_LABEL && sprite->data.label.text ) {
+        free( sprite->data.label.text );
+    } else if( sprite->type == TYPE_TILEMAP && sprite->data.tilemap.map ) {
+        free( sprite->data.tilemap.map );
+    }
+    memset( &sprite->data, 0, sizeof( sprite->data ) );
+}
+
+
+// Frees the pixels and RLE data of a surface, which leaves its slot free to be reused
+
+static void internal_pixie_free_surface( internal_pixie_surface_t* surface ) {
+    free( surface->pixels );
+    free( surface->mask );
+    if( surface->rle ) palrle_free( surface->rle, NULL );
+    memset( surface, 0, sizeof( *surface ) );
+}
+
+
 static void internal_pixie_destroy( internal_pixie_t* pixie ) {
     // Cleanup `vbl` field
     thread_signal_term( &pixie->vbl.signal );
 
     // Cleanup screen
     free( pixie->app_thread.screen.xbgr );
+    free( pixie->app_thread.screen.composite );
 
     free( pixie->app_thread.copy_of_user_thread.screen.pixels );
     free( pixie->user_thread.screen.pixels );
@@ -1176,28 +2070,82 @@ static void internal_pixie_destroy( internal_pixie_t* pixie ) {
     // Cleanup sprites
 
     for( int i = 0; i < pixie->user_thread.sprites.sprite_count; ++i ) {
-        if( pixie->user_thread.sprites.sprites[ i ].type == TYPE_LABEL ) {
-            if( pixie->user_thread.sprites.sprites[ i ].data.label.text ) {
-                free( pixie->user_thread.sprites.sprites[ i ].data.label.text );
-            }
-        }
+        internal_pixie_free_sprite_data( &pixie->user_thread.sprites.sprites[ i ] );
+        free( pixie->user_thread.sprites.sprites[ i ].path );
     }
     free( pixie->user_thread.sprites.sprites );
 
     for( int i = 0; i < pixie->app_thread.copy_of_user_thread.sprites.sprite_count; ++i ) {
-        if( pixie->app_thread.copy_of_user_thread.sprites.sprites[ i ].type == TYPE_LABEL ) {
-            if( pixie->app_thread.copy_of_user_thread.sprites.sprites[ i ].data.label.text ) {
-                free( pixie->app_thread.copy_of_user_thread.sprites.sprites[ i ].data.label.text );
-            }
-        }
+        internal_pixie_free_sprite_data( &pixie->app_thread.copy_of_user_thread.sprites.sprites[ i ] );
     }
     free( pixie->app_thread.copy_of_user_thread.sprites.sprites );
+    free( pixie->app_thread.culled );
+    free( pixie->app_thread.damage.states );
+    free( pixie->app_thread.damage.rows );
+
+    // Cleanup surfaces
+    for( int i = 0; i < pixie->user_thread.surfaces.count; ++i ) {
+        internal_pixie_free_surface( &pixie->user_thread.surfaces.surfaces[ i ] );
+    }
+    free( pixie->user_thread.surfaces.surfaces );
+
+    for( int i = 0; i < pixie->app_thread.copy_of_user_thread.surfaces.count; ++i ) {
+        internal_pixie_free_surface( &pixie->app_thread.copy_of_user_thread.surfaces.surfaces[ i ] );
+    }
+    free( pixie->app_thread.copy_of_user_thread.surfaces.surfaces );
+
+    free( pixie->app_thread.tweens.values );
+    free( pixie->app_thread.tweens.starts );
+    free( pixie->app_thread.tweens.ranges );
+    free( pixie->app_thread.tweens.times );
+    free( pixie->app_thread.tweens.tables );
+
+    if( pixie->app_thread.blend.thread ) {
+        thread_atomic_int_store( &pixie->app_thread.blend.exit_flag, 1 );
+        thread_signal_raise( &pixie->app_thread.blend.signal );
+        thread_join( pixie->app_thread.blend.thread );
+        thread_destroy( pixie->app_thread.blend.thread );
+    }
+    thread_signal_term( &pixie->app_thread.blend.signal );
+    thread_mutex_term( &pixie->app_thread.blend.mutex );
+    free( pixie->app_thread.blend.tables );
+    free( pixie->app_thread.blend.ready );
+    free( pixie->app_thread.blend.building );
 
 
     // Cleanup audio
+    #if PIXIE_SONG_WORKERS > 0
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+            internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+            thread_atomic_int_store( &worker->exit_flag, 1 );
+            thread_signal_raise( &worker->signal );
+            thread_join( worker->thread );
+            thread_destroy( worker->thread );
+            thread_signal_term( &worker->signal );
+            thread_mutex_term( &worker->mutex );
+            tsf_close( worker->sound_font );
+            free( worker->buffer );
+        }
+    #endif
     thread_mutex_term( &pixie->audio.song_mutex );
     free( pixie->audio.mix_buffers );
-    tsf_close( pixie->audio.sound_font );
+    free( pixie->audio.prerendered.decoded );
+    thread_mutex_term( &pixie->audio.sound_mutex );
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CHANNELS; ++i ) {
+        free( pixie->audio.sounds[ i ].decoded );
+    }
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CACHE_ENTRIES; ++i ) {
+        free( pixie->audio.sound_cache.entries[ i ].samples );
+    }
+    thread_atomic_int_store( &pixie->audio.stream.exit_flag, 1 );
+    thread_signal_raise( &pixie->audio.stream.signal );
+    thread_join( pixie->audio.stream.thread );
+    thread_destroy( pixie->audio.stream.thread );
+    thread_signal_term( &pixie->audio.stream.signal );
+    thread_mutex_term( &pixie->audio.stream.mutex );
+    free( pixie->audio.stream.channel.decoded );
+    free( pixie->audio.stream.buffer );
+    tsf_close( pixie->audio.sound_font ); // Must be closed before the bundle, as it might be using it in place
 
     if( pixie->assets.bundle ) {
         mmap_close( pixie->assets.bundle );
@@ -1342,9 +2290,11 @@ void internal_pixie_copy_user_thread_data( internal_pixie_user_thread_data_t* de
     internal_pixie_user_thread_data_t* source ) {
 
     dest->window = source->window;
+    dest->camera = source->camera;
     
     ASSERT( sizeof( source->screen.palette ) == sizeof( dest->screen.palette ), "Palette size mismatch" );
     memcpy( dest->screen.palette, source->screen.palette, sizeof( dest->screen.palette ) );
+    memcpy( dest->screen.remap_tables, source->screen.remap_tables, sizeof( dest->screen.remap_tables ) );
     
     dest->screen.screen_width = source->screen.screen_width;
     dest->screen.screen_height = source->screen.screen_height;
@@ -1353,11 +2303,63 @@ void internal_pixie_copy_user_thread_data( internal_pixie_user_thread_data_t* de
 
     size_t dest_pixels_size = sizeof( u8 ) * dest->screen.screen_width * dest->screen.screen_height;
     size_t source_pixels_size = sizeof( u8 ) * source->screen.screen_width * source->screen.screen_height;
+    dest->screen.damage_top = source->screen.damage_top;
+    dest->screen.damage_bottom = source->screen.damage_bottom;
     if( dest_pixels_size != source_pixels_size ) {
         free( dest->screen.pixels );
         dest->screen.pixels = (u8*) malloc( source_pixels_size );
+        dest->screen.damage_top = 0;
+        dest->screen.damage_bottom = source->screen.screen_height;
+    }
+
+    // Only the rows which have been drawn to since the last frame are copied
+    if( dest->screen.damage_top < dest->screen.damage_bottom ) {
+        size_t offset = sizeof( u8 ) * source->screen.screen_width * dest->screen.damage_top;
+        memcpy( dest->screen.pixels + offset, source->screen.pixels + offset, sizeof( u8 ) * 
+            source->screen.screen_width * ( dest->screen.damage_bottom - dest->screen.damage_top ) );
+    }
+
+    // Surfaces are only copied when they have changed since the last frame, and for encoded ones, only the RLE data
+    // is needed
+    if( dest->surfaces.count < source->surfaces.count ) {
+        dest->surfaces.surfaces = (internal_pixie_surface_t*) realloc( dest->surfaces.surfaces, 
+            sizeof( internal_pixie_surface_t ) * source->surfaces.count );
+        memset( dest->surfaces.surfaces + dest->surfaces.count, 0, 
+            sizeof( internal_pixie_surface_t ) * ( source->surfaces.count - dest->surfaces.count ) );
+        dest->surfaces.count = source->surfaces.count;
+    }
+    for( int i = 0; i < source->surfaces.count; ++i ) {
+        internal_pixie_surface_t* dest_surface = &dest->surfaces.surfaces[ i ];
+        internal_pixie_surface_t const* source_surface = &source->surfaces.surfaces[ i ];
+        if( !source_surface->pixels ) {
+            if( dest_surface->version ) internal_pixie_free_surface( dest_surface );
+            continue;
+        }
+        if( dest_surface->version == source_surface->version ) continue;
+
+        if( dest_surface->width != source_surface->width || dest_surface->height != source_surface->height ) {
+            internal_pixie_free_surface( dest_surface );
+        }
+        if( dest_surface->rle ) {
+            palrle_free( dest_surface->rle, NULL );
+            dest_surface->rle = NULL;
+        }
+        dest_surface->width = source_surface->width;
+        dest_surface->height = source_surface->height;
+        dest_surface->version = source_surface->version;
+        if( source_surface->rle ) {
+            dest_surface->rle = (palrle_data_t*) malloc( source_surface->rle->size );
+            memcpy( dest_surface->rle, source_surface->rle, source_surface->rle->size );
+        } else {
+            size_t size = sizeof( u8 ) * source_surface->width * source_surface->height;
+            if( !dest_surface->pixels ) {
+                dest_surface->pixels = (u8*) malloc( size );
+                dest_surface->mask = (u8*) malloc( size );
+            }
+            memcpy( dest_surface->pixels, source_surface->pixels, size );
+            memcpy( dest_surface->mask, source_surface->mask, size );
+        }
     }
-    memcpy( dest->screen.pixels, source->screen.pixels, source_pixels_size );
 
     for( int i = 0; i < source->sprites.sprite_count; ++i ) {
         dest->sprites.sprites[ i ].x = source->sprites.sprites[ i ].x;
@@ -1365,16 +2367,21 @@ void internal_pixie_copy_user_thread_data( internal_pixie_user_thread_data_t* de
         dest->sprites.sprites[ i ].origin_x = source->sprites.sprites[ i ].origin_x;
         dest->sprites.sprites[ i ].origin_y = source->sprites.sprites[ i ].origin_y;
         dest->sprites.sprites[ i ].visible = source->sprites.sprites[ i ].visible;
+        dest->sprites.sprites[ i ].layer = source->sprites.sprites[ i ].layer;
+        if( dest->sprites.sprites[ i ].type != source->sprites.sprites[ i ].type ) {
+            internal_pixie_free_sprite_data( &dest->sprites.sprites[ i ] );
+        }
         switch( source->sprites.sprites[ i ].type ) {
             case TYPE_NONE: {
             } break;
             case TYPE_SPRITE: {
-                if( dest->sprites.sprites[ i ].type == TYPE_LABEL && dest->sprites.sprites[ i ].data.label.text ) {
-                    free( dest->sprites.sprites[ i ].data.label.text );
-                    dest->sprites.sprites[ i ].data.label.text = 0;
-                }
                 dest->sprites.sprites[ i ].data.sprite.asset = source->sprites.sprites[ i ].data.sprite.asset;
                 dest->sprites.sprites[ i ].data.sprite.cel = source->sprites.sprites[ i ].data.sprite.cel;
+                dest->sprites.sprites[ i ].data.sprite.flip = source->sprites.sprites[ i ].data.sprite.flip;
+                dest->sprites.sprites[ i ].data.sprite.remap = source->sprites.sprites[ i ].data.sprite.remap;
+                dest->sprites.sprites[ i ].data.sprite.blend = source->sprites.sprites[ i ].data.sprite.blend;
+                dest->sprites.sprites[ i ].data.sprite.scale_x = source->sprites.sprites[ i ].data.sprite.scale_x;
+                dest->sprites.sprites[ i ].data.sprite.scale_y = source->sprites.sprites[ i ].data.sprite.scale_y;
             } break;
             case TYPE_LABEL: {
                 char const* dest_text = dest->sprites.sprites[ i ].type == TYPE_LABEL ? 
@@ -1398,60 +2405,475 @@ void internal_pixie_copy_user_thread_data( internal_pixie_user_thread_data_t* de
                 dest->sprites.sprites[ i ].data.label.shadow = source->sprites.sprites[ i ].data.label.shadow;
                 dest->sprites.sprites[ i ].data.label.wrap = source->sprites.sprites[ i ].data.label.wrap;
             } break;
+            case TYPE_TILEMAP: {
+                // Maps can be big, so they are only copied when they have changed since the last frame
+                internal_pixie_sprite_t* dest_sprite = &dest->sprites.sprites[ i ];
+                internal_pixie_sprite_t const* source_sprite = &source->sprites.sprites[ i ];
+                if( !dest_sprite->data.tilemap.map || 
+                    dest_sprite->data.tilemap.version != source_sprite->data.tilemap.version ) {
+
+                    size_t map_size = sizeof( u16 ) * source_sprite->data.tilemap.width * 
+                        source_sprite->data.tilemap.height;
+                    if( !dest_sprite->data.tilemap.map || dest_sprite->data.tilemap.width * 
+                        dest_sprite->data.tilemap.height != source_sprite->data.tilemap.width * 
+                        source_sprite->data.tilemap.height ) {
+
+                        free( dest_sprite->data.tilemap.map );
+                        dest_sprite->data.tilemap.map = (u16*) malloc( map_size + sizeof( u16 ) );
+                    }
+                    memcpy( dest_sprite->data.tilemap.map, source_sprite->data.tilemap.map, map_size );
+                }
+                dest_sprite->data.tilemap.asset = source_sprite->data.tilemap.asset;
+                dest_sprite->data.tilemap.width = source_sprite->data.tilemap.width;
+                dest_sprite->data.tilemap.height = source_sprite->data.tilemap.height;
+                dest_sprite->data.tilemap.version = source_sprite->data.tilemap.version;
+            } break;
+            case TYPE_SURFACE: {
+                dest->sprites.sprites[ i ].data.surface.surface = source->sprites.sprites[ i ].data.surface.surface;
+            } break;
         }
         dest->sprites.sprites[ i ].type = source->sprites.sprites[ i ].type;
 
-        // Intentionally not copying `move_x` and `move_y` data, as it is not used by app thread
+        // Intentionally not copying `move_x`, `move_y`, `anim` and `path` data, as it is not used by app thread
     }
+
+    // Intentionally not copying `palette_effects`, as they have already been applied to the palette
 }
 
 
-void internal_pixie_update_sprite_movement( int* value, internal_pixie_sprite_moves_t* moves ) {
-    static float (* const easefuncs[])( float ) = { 
-        ease_linear, ease_linear, ease_linear, ease_linear, ease_smoothstep, ease_smootherstep, ease_out_quad, 
-        ease_out_back, ease_out_bounce, ease_out_sine, ease_out_elastic, ease_out_expo, ease_out_cubic, ease_out_quart, 
-        ease_out_quint, ease_out_circle, ease_in_quad, ease_in_back, ease_in_bounce, ease_in_sine, ease_in_elastic, 
-        ease_in_expo,  ease_in_cubic, ease_in_quart, ease_in_quint, ease_in_circle, ease_in_out_quad, 
-        ease_in_out_back, ease_in_out_bounce, ease_in_out_sine, ease_in_out_elastic, ease_in_out_expo, 
-        ease_in_out_cubic, ease_in_out_quart, ease_in_out_quint, ease_in_out_circle,
-    };
+// Steps a cel animation forward by one frame, moving to the next cel every `frames_per_cel` frames
 
-    if( moves->count > 0 ) {
-        ++moves->time;
-        internal_pixie_move_t* move = &moves->moves[ moves->index ];
-        if( moves->time <= move->duration ) {
-            float range = (float)( move->target - moves->start );
-            float current = ( (float) moves->time ) / (float) move->duration;
-            if( move->type >= INTERNAL_PIXIE_MOVE_LINEAR ) {
-                float t = easefuncs[ move->type ]( current );
-                int pos = moves->start + (int)( t * range );
-                *value = pos;
-            }
-        } else {
-            ++moves->index;
-            if( moves->index >= moves->count ) {
-                if( moves->loop ) {
-                    moves->index = 0;
-                } else {
-                    moves->count = 0;
+void internal_pixie_update_sprite_animation( int* cel, internal_pixie_sprite_anim_t* anim ) {
+    if( !anim->active || ++anim->time < anim->frames_per_cel ) {
+        return;
+    }
+    anim->time = 0;
+
+    // Animations may run backwards, if `last` is lower than `first`
+    int sign = anim->last >= anim->first ? 1 : -1;
+    int count = ( anim->last - anim->first ) * sign + 1;
+    int index = ( *cel - anim->first ) * sign + anim->dir;
+    if( index < 0 || index >= count ) {
+        if( anim->mode == ANIM_LOOP ) {
+            index = 0;
+        } else if( anim->mode == ANIM_PINGPONG ) {
+            anim->dir = -anim->dir;
+            index = count > 1 ? index + anim->dir * 2 : 0;
+        } else {
+            anim->active = 0;
+            return;
+        }
+    }
+    *cel = anim->first + index * sign;
+}
+
+
+// Looks up the eased value for `t` (0 to 1 in 16.16 fixed point) in an easing table, interpolating linearly between 
+// table entries. The result is 16.16 as well.
+
+static i32 internal_pixie_ease_fixed( i32 const* table, i32 t ) {
+    i32 pos = t * INTERNAL_PIXIE_EASE_TABLE_SIZE;
+    i32 index = pos >> 16;
+    i32 frac = pos & 0xffff;
+    i32 a = table[ index ];
+    i32 b = table[ index + 1 ];
+    return a + (i32)( ( (i64)( b - a ) * frac ) >> 16 );
+}
+
+
+// Steps the move list of a sprite position forward by one frame. If the current move is easing towards its target, it
+// is added to the `tweens` arrays to be evaluated later, rather than being evaluated here.
+
+static void internal_pixie_step_sprite_moves( internal_pixie_t* pixie, int* value, 
+    internal_pixie_sprite_moves_t* moves ) {
+
+    if( moves->count <= 0 ) {
+        return;
+    }
+
+    ++moves->time;
+    internal_pixie_move_t* move = &moves->moves[ moves->index ];
+    if( moves->time <= move->duration ) {
+        if( move->type >= INTERNAL_PIXIE_MOVE_LINEAR ) {
+            int n = pixie->app_thread.tweens.count++;
+            pixie->app_thread.tweens.values[ n ] = value;
+            pixie->app_thread.tweens.starts[ n ] = moves->start;
+            pixie->app_thread.tweens.ranges[ n ] = move->target - moves->start;
+            pixie->app_thread.tweens.times[ n ] = 
+                (i32)( ( ( ( (i64) moves->time ) << 16 ) + move->duration / 2 ) / move->duration );
+            pixie->app_thread.tweens.tables[ n ] = pixie->app_thread.ease_tables[ move->type ];
+        }
+    } else {
+        if( move->type >= INTERNAL_PIXIE_MOVE_LINEAR ) {
+            *value = move->target;
+        }
+        ++moves->index;
+        if( moves->index >= moves->count ) {
+            if( !moves->loop ) {
+                moves->count = 0;
+                return;
+            }
+            moves->index = 0;
+        }
+        moves->time = 0;
+        moves->start = *value;
+    }
+}
+
+
+// Updates the movement of all sprites. This is done in two passes - first the move lists are stepped forward, which
+// gathers all moves in progress into the `tweens` arrays, and then all of those are evaluated in one go, using fixed
+// point lookups in the easing tables.
+
+void internal_pixie_update_sprite_moves( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data ) {
+    // Make sure there's room for both the x and y moves of every sprite
+    if( pixie->app_thread.tweens.capacity < data->sprites.sprite_count * 2 ) {
+        int capacity = data->sprites.sprite_count * 2;
+        pixie->app_thread.tweens.capacity = capacity;
+        pixie->app_thread.tweens.values = (int**) realloc( pixie->app_thread.tweens.values, sizeof( int* ) * capacity );
+        pixie->app_thread.tweens.starts = (i32*) realloc( pixie->app_thread.tweens.starts, sizeof( i32 ) * capacity );
+        pixie->app_thread.tweens.ranges = (i32*) realloc( pixie->app_thread.tweens.ranges, sizeof( i32 ) * capacity );
+        pixie->app_thread.tweens.times = (i32*) realloc( pixie->app_thread.tweens.times, sizeof( i32 ) * capacity );
+        pixie->app_thread.tweens.tables = (i32 const**) realloc( (void*) pixie->app_thread.tweens.tables, 
+            sizeof( i32 const* ) * capacity );
+    }
+
+    pixie->app_thread.tweens.count = 0;
+    for( int i = 0; i < data->sprites.sprite_count; ++i ) {    
+        internal_pixie_sprite_t* sprite = &data->sprites.sprites[ i ];
+        internal_pixie_step_sprite_moves( pixie, &sprite->x, &sprite->move_x );
+        internal_pixie_step_sprite_moves( pixie, &sprite->y, &sprite->move_y );
+    }
+
+    int count = pixie->app_thread.tweens.count;
+    i32 const* starts = pixie->app_thread.tweens.starts;
+    i32 const* ranges = pixie->app_thread.tweens.ranges;
+    i32* times = pixie->app_thread.tweens.times;
+    i32 const** tables = pixie->app_thread.tweens.tables;
+
+    // Look up the eased value and scale it to the range of the move. The result is written back into `times`, to be
+    // scattered to the sprites below.
+    for( int i = 0; i < count; ++i ) {
+        i32 t = internal_pixie_ease_fixed( tables[ i ], times[ i ] );
+        times[ i ] = starts[ i ] + (i32)( ( (i64) ranges[ i ] * t + 32768 ) >> 16 );
+    }
+
+    int** values = pixie->app_thread.tweens.values;
+    for( int i = 0; i < count; ++i ) {
+        *values[ i ] = times[ i ];
+    }
+}
+
+
+// Moves a sprite one frame further along its path, at constant speed along the curve (before easing is applied)
+
+void internal_pixie_update_sprite_path( internal_pixie_t* pixie, internal_pixie_sprite_t* sprite ) {
+    internal_pixie_sprite_path_t* path = sprite->path;
+    if( !path || !path->active ) {
+        return;
+    }
+
+    // Only looping paths are still active after the last frame, and start over from the beginning
+    if( ++path->time > path->duration ) {
+        path->time = 1;
+    }
+
+    // Find the distance along the path for this frame. Easings like back and elastic may overshoot, which wraps 
+    // around for looping paths, and stops at the ends otherwise.
+    i32 t = (i32)( ( ( ( (i64) path->time ) << 16 ) + path->duration / 2 ) / path->duration );
+    i32 eased = internal_pixie_ease_fixed( pixie->app_thread.ease_tables[ path->type ], t );
+    i32 length = path->samples[ path->count - 1 ].distance;
+    i32 distance = (i32)( ( (i64) eased * length ) >> 16 );
+    if( path->loop && length > 0 ) {
+        distance = ( ( distance % length ) + length ) % length;
+        if( eased >= 65536 && distance == 0 ) distance = length; // Land exactly on the end of each lap
+    } else {
+        distance = distance < 0 ? 0 : distance > length ? length : distance;
+    }
+
+    // Binary search for the first sample at or past the distance, and interpolate from the one before it
+    int low = 1;
+    int high = path->count - 1;
+    while( low < high ) {
+        int mid = ( low + high ) / 2;
+        if( path->samples[ mid ].distance < distance ) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    i32 x = path->samples[ low ].x;
+    i32 y = path->samples[ low ].y;
+    i32 from = path->samples[ low - 1 ].distance;
+    i32 span = path->samples[ low ].distance - from;
+    if( span > 0 ) {
+        i32 frac = (i32)( ( ( (i64)( distance - from ) ) << 16 ) / span );
+        x = path->samples[ low - 1 ].x + (i32)( ( (i64)( x - path->samples[ low - 1 ].x ) * frac ) >> 16 );
+        y = path->samples[ low - 1 ].y + (i32)( ( (i64)( y - path->samples[ low - 1 ].y ) * frac ) >> 16 );
+    }
+    sprite->x = ( x + 32768 ) >> 16;
+    sprite->y = ( y + 32768 ) >> 16;
+
+    if( !path->loop && path->time >= path->duration ) {
+        path->active = 0;
+    }
+}
+
+
+// Rotates palette entries `first` to `last` one step up, or one step down if `dir` is negative
+
+static void internal_pixie_rotate_palette( u32* palette, int first, int last, int dir ) {
+    if( dir > 0 ) {
+        u32 wrap = palette[ last ];
+        memmove( palette + first + 1, palette + first, sizeof( u32 ) * ( last - first ) );
+        palette[ first ] = wrap;
+    } else {
+        u32 wrap = palette[ first ];
+        memmove( palette + first, palette + first + 1, sizeof( u32 ) * ( last - first ) );
+        palette[ last ] = wrap;
+    }
+}
+
+
+// Advances fades and color cycling by one frame, writing the result to the palette. Cycling is applied to the start
+// and end palettes of a fade in progress as well, so that the two effects can be combined.
+
+void internal_pixie_update_palette_effects( u32* palette, internal_pixie_palette_effects_t* effects ) {
+    for( int i = 0; i < INTERNAL_PIXIE_PALETTE_CYCLES; ++i ) {
+        if( effects->cycles[ i ].speed == 0 ) continue;
+        int first = effects->cycles[ i ].first;
+        int last = effects->cycles[ i ].last;
+        int dir = effects->cycles[ i ].speed > 0 ? 1 : -1;
+        effects->cycles[ i ].accumulator += effects->cycles[ i ].speed * dir;
+        while( effects->cycles[ i ].accumulator >= 60 ) {
+            effects->cycles[ i ].accumulator -= 60;
+            internal_pixie_rotate_palette( palette, first, last, dir );
+            if( effects->fade.duration > 0 ) {
+                internal_pixie_rotate_palette( effects->fade.from, first, last, dir );
+                internal_pixie_rotate_palette( effects->fade.to, first, last, dir );
+            }
+        }
+    }
+
+    if( effects->fade.duration > 0 ) {
+        ++effects->fade.time;
+        if( effects->fade.time >= effects->fade.duration ) {
+            memcpy( palette, effects->fade.to, sizeof( effects->fade.to ) );
+            effects->fade.duration = 0;
+            return;
+        }
+
+        float t = internal_pixie_easefuncs[ effects->fade.type ]( (float) effects->fade.time / effects->fade.duration );
+        int f = (int)( t * 256.0f ); // 8.8 fixed point, may be outside 0-256 for the back and elastic easings
+        for( int i = 0; i < 256; ++i ) {
+            u32 from = effects->fade.from[ i ];
+            u32 to = effects->fade.to[ i ];
+            u32 color = 0;
+            for( int shift = 0; shift < 24; shift += 8 ) {
+                int a = (int)( ( from >> shift ) & 0xff );
+                int b = (int)( ( to >> shift ) & 0xff );
+                int c = a + ( ( ( b - a ) * f ) >> 8 );
+                color |= (u32)( c < 0 ? 0 : c > 255 ? 255 : c ) << shift;
+            }
+            palette[ i ] = color;
+        }
+    }
+}
+
+
+// Renders the part of a tilemap which is on screen. Only the tiles which overlap the screen are visited, and fully
+// opaque tiles are copied a row at a time, while the rest are drawn through their mask.
+
+static void internal_pixie_render_tilemap( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data, 
+    internal_pixie_sprite_t* sprite, int left, int top, u8* screen, int screen_height ) {
+
+    int asset = sprite->data.tilemap.asset;
+    if( asset < 1 || asset > pixie->assets.count || !sprite->data.tilemap.map ) return;
+    --asset;
+
+    // Find the tileset data in the memory mapped file
+    internal_pixie_tileset_t const* tileset = VOID_CAST( internal_pixie_find_asset( pixie, asset, NULL ) );
+    int tile_width = tileset->tile_width;
+    int tile_height = tileset->tile_height;
+    int tile_size = tile_width * tile_height;
+    u8 const* opaque = ( (u8 const*)( tileset + 1 ) ) + 
+        sizeof( u16 ) * tileset->map_width * tileset->map_height;
+    u8 const* tiles = opaque + tileset->tile_count;
+    int screen_width = data->screen.screen_width;
+
+    // Range of map cells which overlap the screen
+    int first_x = left < 0 ? -left / tile_width : 0;
+    int first_y = top < 0 ? -top / tile_height : 0;
+    int last_x = ( screen_width - left + tile_width - 1 ) / tile_width;
+    int last_y = ( screen_height - top + tile_height - 1 ) / tile_height;
+    if( last_x > sprite->data.tilemap.width ) last_x = sprite->data.tilemap.width;
+    if( last_y > sprite->data.tilemap.height ) last_y = sprite->data.tilemap.height;
+
+    for( int ty = first_y; ty < last_y; ++ty ) {
+        int tile_top = top + ty * tile_height;
+        int y_start = tile_top < 0 ? -tile_top : 0;
+        int y_end = tile_top + tile_height > screen_height ? screen_height - tile_top : tile_height;
+        u16 const* map_row = sprite->data.tilemap.map + ty * sprite->data.tilemap.width;
+        for( int tx = first_x; tx < last_x; ++tx ) {
+            int tile = map_row[ tx ];
+            if( tile >= tileset->tile_count ) continue; // Empty cell
+            
+            int tile_left = left + tx * tile_width;
+            int x_start = tile_left < 0 ? -tile_left : 0;
+            int x_end = tile_left + tile_width > screen_width ? screen_width - tile_left : tile_width;
+            u8 const* pixels = tiles + tile * tile_size * 2;
+            u8 const* mask = pixels + tile_size;
+            if( opaque[ tile ] ) {
+                for( int y = y_start; y < y_end; ++y ) {
+                    memcpy( screen + tile_left + x_start + ( tile_top + y ) * screen_width, 
+                        pixels + x_start + y * tile_width, (size_t)( x_end - x_start ) );
                 }
             } else {
-                moves->time = 0;
-                if( move->type >= INTERNAL_PIXIE_MOVE_LINEAR ) {
-                    *value = move->target;
+                for( int y = y_start; y < y_end; ++y ) {
+                    u8* out = screen + tile_left + ( tile_top + y ) * screen_width;
+                    for( int x = x_start; x < x_end; ++x ) {
+                        if( mask[ x + y * tile_width ] ) out[ x ] = pixels[ x + y * tile_width ];
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// Renders a surface sprite. Surfaces encoded with `surface_encode` are drawn from their RLE data, skipping over the
+// transparent parts, while the rest are drawn through their mask.
+
+static void internal_pixie_render_surface( internal_pixie_user_thread_data_t* data, internal_pixie_sprite_t* sprite, 
+    int left, int top, u8* screen, int screen_height ) {
+
+    int index = sprite->data.surface.surface;
+    if( index < 1 || index > data->surfaces.count ) return;
+    internal_pixie_surface_t const* surface = &data->surfaces.surfaces[ index - 1 ];
+    int screen_width = data->screen.screen_width;
+
+    if( surface->rle ) {
+        palrle_blit( surface->rle, left, top, screen, screen_width, screen_height );
+        return;
+    }
+    if( !surface->pixels ) return;
+
+    int x_start = left < 0 ? -left : 0;
+    int y_start = top < 0 ? -top : 0;
+    int x_end = left + surface->width > screen_width ? screen_width - left : surface->width;
+    int y_end = top + surface->height > screen_height ? screen_height - top : surface->height;
+    for( int y = y_start; y < y_end; ++y ) {
+        u8 const* pixels = surface->pixels + y * surface->width;
+        u8 const* mask = surface->mask + y * surface->width;
+        u8* out = screen + left + ( top + y ) * screen_width;
+        for( int x = x_start; x < x_end; ++x ) {
+            if( mask[ x ] ) out[ x ] = pixels[ x ];
+        }
+    }
+}
+
+
+// Screen position of the top left corner of a sprite, with the camera offset for its layer applied
+
+static void internal_pixie_sprite_screen_pos( internal_pixie_user_thread_data_t* data, 
+    internal_pixie_sprite_t const* sprite, int* left, int* top ) {
+
+    *left = sprite->x - sprite->origin_x - data->camera.x * data->camera.parallax_x[ sprite->layer ] / 100;
+    *top = sprite->y - sprite->origin_y - data->camera.y * data->camera.parallax_y[ sprite->layer ] / 100;
+}
+
+
+// Goes through the sprites from the front to the back, and marks the ones which don't need to be drawn: those which 
+// are off screen, and those which are completely covered by the opaque rectangle of a sprite in front of them. Only
+// unscaled bitmap sprites are culled, using the boxes stored for each cel, and only the unblended ones hide others.
+
+static void internal_pixie_cull_sprites( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data ) {
+    int occluders[ INTERNAL_PIXIE_OCCLUDERS ][ 4 ]; // Left, top, right and bottom (exclusive) of each rectangle
+    int occluder_count = 0;
+    int screen_width = data->screen.screen_width;
+    int screen_height = data->screen.screen_height;
+
+    for( int i = data->sprites.sprite_count - 1; i >= 0; --i ) {
+        internal_pixie_sprite_t const* sprite = &data->sprites.sprites[ i ];
+        pixie->app_thread.culled[ i ] = 0;
+        if( !sprite->visible || sprite->type != TYPE_SPRITE ) continue;
+        if( sprite->data.sprite.scale_x != 65536 || sprite->data.sprite.scale_y != 65536 ) continue;
+        int asset = sprite->data.sprite.asset;
+        if( asset < 1 || asset > pixie->assets.count ) continue;
+        u8 const* frames = (u8 const*) internal_pixie_find_asset( pixie, asset - 1, NULL );
+        int frame_count = *(int const*)frames;
+        if( frame_count <= 0 || sprite->data.sprite.cel < 0 ) continue;
+        internal_pixie_sprite_cel_t const* cel = 
+            (internal_pixie_sprite_cel_t const*)( frames + sizeof( int ) ) + sprite->data.sprite.cel % frame_count;
+
+        int left = 0;
+        int top = 0;
+        internal_pixie_sprite_screen_pos( data, sprite, &left, &top );
+        int flip_h = sprite->data.sprite.flip & FLIP_H;
+        int flip_v = sprite->data.sprite.flip & FLIP_V;
+        int x = left + ( flip_h ? cel->cel_width - cel->x - cel->width : cel->x );
+        int y = top + ( flip_v ? cel->cel_height - cel->y - cel->height : cel->y );
+        if( cel->width <= 0 || cel->height <= 0 || x >= screen_width || y >= screen_height || 
+            x + cel->width <= 0 || y + cel->height <= 0 ) {
+
+            pixie->app_thread.culled[ i ] = 1;
+            continue;
+        }
+
+        for( int j = 0; j < occluder_count; ++j ) {
+            if( x >= occluders[ j ][ 0 ] && y >= occluders[ j ][ 1 ] && x + cel->width <= occluders[ j ][ 2 ] && 
+                y + cel->height <= occluders[ j ][ 3 ] ) {
+
+                pixie->app_thread.culled[ i ] = 1;
+                break;
+            }
+        }
+        if( pixie->app_thread.culled[ i ] ) continue;
+
+        // Blended sprites let the sprites behind them show through, so they can't hide anything
+        int area = cel->opaque_width * cel->opaque_height;
+        if( area <= 0 || sprite->data.sprite.blend != BLEND_NONE ) continue;
+        
+        // When all slots are taken, the new rectangle replaces the smallest one, if it is bigger
+        int slot = occluder_count;
+        if( occluder_count == INTERNAL_PIXIE_OCCLUDERS ) {
+            slot = 0;
+            int smallest = INT_MAX;
+            for( int j = 0; j < occluder_count; ++j ) {
+                int occluder_area = ( occluders[ j ][ 2 ] - occluders[ j ][ 0 ] ) * 
+                    ( occluders[ j ][ 3 ] - occluders[ j ][ 1 ] );
+                if( occluder_area < smallest ) {
+                    smallest = occluder_area;
+                    slot = j;
                 }
-                moves->start = *value;
             }
+            if( area <= smallest ) continue;
+        } else {
+            ++occluder_count;
         }
+        occluders[ slot ][ 0 ] = left + 
+            ( flip_h ? cel->cel_width - cel->opaque_x - cel->opaque_width : cel->opaque_x );
+        occluders[ slot ][ 1 ] = top + 
+            ( flip_v ? cel->cel_height - cel->opaque_y - cel->opaque_height : cel->opaque_y );
+        occluders[ slot ][ 2 ] = occluders[ slot ][ 0 ] + cel->opaque_width;
+        occluders[ slot ][ 3 ] = occluders[ slot ][ 1 ] + cel->opaque_height;
     }
 }
 
 
+// Renders a sprite into a band of rows of the composite screen. `target` points to the first row of the band, which is
+// row `band_top` of the screen, and everything outside of the band is clipped away.
+
 void internal_pixie_render_sprite( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data, 
-    internal_pixie_sprite_t* sprite ) {
+    internal_pixie_sprite_t* sprite, u8* target, int band_top, int band_height ) {
 
     if( !sprite->visible ) return;
 
+    int left = 0;
+    int top = 0;
+    internal_pixie_sprite_screen_pos( data, sprite, &left, &top );
+    top -= band_top;
+
     if( sprite->type == TYPE_SPRITE ) {
         int asset = sprite->data.sprite.asset;
         if( asset < 1 || asset > pixie->assets.count ) return;
@@ -1462,13 +2884,36 @@ void internal_pixie_render_sprite( internal_pixie_t* pixie, internal_pixie_user_
         u8* frames = (u8*) internal_pixie_find_asset( pixie, asset, NULL );
         int frame_count = *(int*)frames;
         if( frame_count > 0 && cel >= 0 ) {
-            int* offsets = (int*)(frames + sizeof( int ) );
-            palrle_data_t* rledata = (palrle_data_t*)( frames + offsets[ cel % frame_count ] );
+            internal_pixie_sprite_cel_t* cels = (internal_pixie_sprite_cel_t*)( frames + sizeof( int ) );
+            palrle_data_t* rledata = (palrle_data_t*)( frames + cels[ cel % frame_count ].offset );
 
             // Render pixels
-            palrle_blit( rledata, sprite->x - sprite->origin_x, 
-                sprite->y  - sprite->origin_y, data->screen.pixels, 
-                data->screen.screen_width, data->screen.screen_height );
+            int flip = sprite->data.sprite.flip;
+            int remap = sprite->data.sprite.remap;
+
+            // Until the worker has built the first blend tables, blended sprites are drawn without blending
+            u8 const* blend = NULL;
+            if( sprite->data.sprite.blend != BLEND_NONE ) {
+                if( !pixie->app_thread.blend.used ) pixie->app_thread.blend.used = 1;
+                if( pixie->app_thread.blend.tables ) {
+                    blend = pixie->app_thread.blend.tables + 
+                        ( sprite->data.sprite.blend - BLEND_HALF ) * INTERNAL_PIXIE_BLEND_TABLE_SIZE;
+                }
+            }
+            u8 const* remap_table = remap > 0 ? data->screen.remap_tables[ remap - 1 ] : NULL;
+
+            int scale_x = sprite->data.sprite.scale_x;
+            int scale_y = sprite->data.sprite.scale_y;
+            if( scale_x == 65536 && scale_y == 65536 ) {
+                palrle_blit_blend( rledata, left, top, flip & FLIP_H, flip & FLIP_V, remap_table, blend, 
+                    target, data->screen.screen_width, band_height );
+            } else {
+                // Scaled sprites are scaled around their origin
+                int scaled_left = left + sprite->origin_x - (int)( ( (i64) sprite->origin_x * scale_x ) >> 16 );
+                int scaled_top = top + sprite->origin_y - (int)( ( (i64) sprite->origin_y * scale_y ) >> 16 );
+                palrle_blit_scaled( rledata, scaled_left, scaled_top, scale_x, scale_y, flip & FLIP_H, flip & FLIP_V, 
+                    remap_table, blend, target, data->screen.screen_width, band_height );
+            }
         }
 
     // Render labels
@@ -1498,18 +2943,18 @@ void internal_pixie_render_sprite( internal_pixie_t* pixie, internal_pixie_user_
 				    if( x == 0 && y == 0 ) continue;
 
 	                pixelfont_blit_u8( font, 
-                        sprite->x + shadow_offset_x + x - sprite->origin_x, 
-                        sprite->y + shadow_offset_y + y - sprite->origin_y, 
-                        sprite->data.label.text, (u8) shadow, data->screen.pixels, 
-                        data->screen.screen_width, data->screen.screen_height, pixelfont_align, wrap, 0, 0, -1,
+                        left + shadow_offset_x + x, 
+                        top + shadow_offset_y + y, 
+                        sprite->data.label.text, (u8) shadow, target, 
+                        data->screen.screen_width, band_height, pixelfont_align, wrap, 0, 0, -1,
                         PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, NULL );
                 }
             } else {
 	            pixelfont_blit_u8( font, 
-                    sprite->x + shadow_offset_x - sprite->origin_x, 
-                    sprite->y + shadow_offset_y - sprite->origin_y, 
-                    sprite->data.label.text, (u8) shadow, data->screen.pixels, 
-                    data->screen.screen_width, data->screen.screen_height, pixelfont_align, wrap, 0, 0, -1, 
+                    left + shadow_offset_x, 
+                    top + shadow_offset_y, 
+                    sprite->data.label.text, (u8) shadow, target, 
+                    data->screen.screen_width, band_height, pixelfont_align, wrap, 0, 0, -1, 
                     PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF,  NULL );
             }
         }
@@ -1519,10 +2964,10 @@ void internal_pixie_render_sprite( internal_pixie_t* pixie, internal_pixie_user_
 				if( x == 0 && y == 0 ) continue;
 
 	            pixelfont_blit_u8( font, 
-                    sprite->x + x - sprite->origin_x, 
-                    sprite->y + y - sprite->origin_y, 
-                    sprite->data.label.text, (u8) outline, data->screen.pixels, 
-                    data->screen.screen_width, data->screen.screen_height, pixelfont_align, wrap, 0, 0, -1, 
+                    left + x, 
+                    top + y, 
+                    sprite->data.label.text, (u8) outline, target, 
+                    data->screen.screen_width, band_height, pixelfont_align, wrap, 0, 0, -1, 
                     PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, NULL );
             }
         }
@@ -1530,13 +2975,173 @@ void internal_pixie_render_sprite( internal_pixie_t* pixie, internal_pixie_user_
         int color = sprite->data.label.color;
         if( color >= 0 && color < 256 ) {
 	        pixelfont_blit_u8( font, 
-                sprite->x - sprite->origin_x, 
-                sprite->y - sprite->origin_y, 
-                sprite->data.label.text, (u8) color, data->screen.pixels, 
-                data->screen.screen_width, data->screen.screen_height, pixelfont_align, wrap, 0, 0, -1, 
+                left, 
+                top, 
+                sprite->data.label.text, (u8) color, target, 
+                data->screen.screen_width, band_height, pixelfont_align, wrap, 0, 0, -1, 
                 PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, NULL );
         }
+
+    // Render tilemaps
+    } else if( sprite->type == TYPE_TILEMAP ) {
+        internal_pixie_render_tilemap( pixie, data, sprite, left, top, target, band_height );
+
+    // Render surfaces
+    } else if( sprite->type == TYPE_SURFACE ) {
+        internal_pixie_render_surface( data, sprite, left, top, target, band_height );
+    }
+}
+
+
+// Works out which rows of the screen a sprite covers, and fills in everything which affects how it is drawn. The rows
+// only need to include everything which might be drawn, and are exact for unscaled bitmap sprites.
+
+static void internal_pixie_sprite_render_state( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data, 
+    internal_pixie_sprite_t const* sprite, internal_pixie_render_state_t* state ) {
+
+    memset( state, 0, sizeof( *state ) );
+    if( !sprite->visible || sprite->type == TYPE_NONE ) return;
+
+    int left = 0;
+    int top = 0;
+    internal_pixie_sprite_screen_pos( data, sprite, &left, &top );
+    int* key = state->key;
+    *key++ = sprite->type;
+    *key++ = left;
+    *key++ = top;
+
+    if( sprite->type == TYPE_SPRITE ) {
+        int asset = sprite->data.sprite.asset;
+        if( asset < 1 || asset > pixie->assets.count ) return;
+        u8 const* frames = (u8 const*) internal_pixie_find_asset( pixie, asset - 1, NULL );
+        int frame_count = *(int const*)frames;
+        if( frame_count <= 0 || sprite->data.sprite.cel < 0 ) return;
+        int cel_index = sprite->data.sprite.cel % frame_count;
+        internal_pixie_sprite_cel_t const* cel = (internal_pixie_sprite_cel_t const*)( frames + sizeof( int ) ) + 
+            cel_index;
+
+        int scale_y = sprite->data.sprite.scale_y;
+        if( sprite->data.sprite.scale_x == 65536 && scale_y == 65536 ) {
+            state->top = top + ( sprite->data.sprite.flip & FLIP_V ? cel->cel_height - cel->y - cel->height : cel->y );
+            state->bottom = state->top + cel->height;
+        } else {
+            state->top = top + sprite->origin_y - (int)( ( (i64) sprite->origin_y * scale_y ) >> 16 );
+            state->bottom = state->top + (int)( ( (i64) cel->cel_height * scale_y ) >> 16 ) + 1;
+        }
+        *key++ = asset;
+        *key++ = cel_index;
+        *key++ = sprite->data.sprite.flip;
+        *key++ = sprite->data.sprite.remap;
+        *key++ = sprite->data.sprite.blend;
+        *key++ = sprite->data.sprite.scale_x;
+        *key++ = scale_y;
+
+    } else if( sprite->type == TYPE_LABEL ) {
+        int asset = sprite->data.label.font;
+        if( asset < 1 || asset > pixie->assets.count ) return;
+        pixelfont_t const* font = VOID_CAST( internal_pixie_find_asset( pixie, asset - 1, NULL ) );
+
+        // Measure the text by drawing it without a target. It is drawn from `top`, each line is `font->height` high, 
+        // and the outline and shadow add two more rows at the most
+        pixelfont_bounds_t bounds;
+        pixelfont_blit_u8( font, left, top, sprite->data.label.text, 0, NULL, 0, 0, PIXELFONT_ALIGN_LEFT, 
+            sprite->data.label.wrap, 0, 0, -1, PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, 
+            &bounds );
+        state->top = top - 1;
+        state->bottom = top + bounds.height + font->height + 2;
+
+        u32 hash = 2166136261u; // FNV-1a, to tell when the text changes
+        for( char const* text = sprite->data.label.text; *text; ++text ) hash = ( hash ^ (u8) *text ) * 16777619u;
+        *key++ = asset;
+        *key++ = (int) hash;
+        *key++ = sprite->data.label.align;
+        *key++ = sprite->data.label.color;
+        *key++ = sprite->data.label.outline;
+        *key++ = sprite->data.label.shadow;
+        *key++ = sprite->data.label.wrap;
+
+    } else if( sprite->type == TYPE_TILEMAP ) {
+        int asset = sprite->data.tilemap.asset;
+        if( asset < 1 || asset > pixie->assets.count ) return;
+        internal_pixie_tileset_t const* tileset = VOID_CAST( internal_pixie_find_asset( pixie, asset - 1, NULL ) );
+        state->top = top;
+        state->bottom = top + tileset->tile_height * sprite->data.tilemap.height;
+        *key++ = asset;
+        *key++ = sprite->data.tilemap.version;
+        *key++ = sprite->data.tilemap.width;
+
+    } else if( sprite->type == TYPE_SURFACE ) {
+        int index = sprite->data.surface.surface;
+        if( index < 1 || index > data->surfaces.count ) return;
+        internal_pixie_surface_t const* surface = &data->surfaces.surfaces[ index - 1 ];
+        state->top = top;
+        state->bottom = top + surface->height;
+        *key++ = index;
+        *key++ = surface->version;
+    }
+}
+
+
+// Marks a range of rows of the screen as needing to be redrawn, with `bottom` exclusive
+
+static void internal_pixie_damage_rows( internal_pixie_t* pixie, int top, int bottom ) {
+    int height = pixie->app_thread.damage.height;
+    if( top < 0 ) top = 0;
+    if( bottom > height ) bottom = height;
+    if( top < bottom ) memset( pixie->app_thread.damage.rows + top, 1, (size_t)( bottom - top ) );
+}
+
+
+// Finds the rows of the screen which need to be redrawn this frame: those covered by sprites before or after they 
+// changed, and those drawn to by the immediate mode drawing functions. Returns 1 if the palette has changed, in which
+// case every row needs converting to XBGR, even if none of them need to be recomposited.
+
+static int internal_pixie_find_damage( internal_pixie_t* pixie, internal_pixie_user_thread_data_t* data ) {
+    int screen_height = data->screen.screen_height;
+    int first_frame = pixie->app_thread.damage.width != data->screen.screen_width || 
+        pixie->app_thread.damage.height != screen_height;
+    if( first_frame ) {
+        free( pixie->app_thread.damage.rows );
+        pixie->app_thread.damage.rows = (u8*) malloc( sizeof( u8 ) * screen_height );
+        pixie->app_thread.damage.width = data->screen.screen_width;
+        pixie->app_thread.damage.height = screen_height;
+    }
+    memset( pixie->app_thread.damage.rows, first_frame ? 1 : 0, sizeof( u8 ) * screen_height );
+
+    internal_pixie_damage_rows( pixie, data->screen.damage_top, data->screen.damage_bottom );
+
+    // Sprites drawn through a remap or blend table need redrawing when the table changes
+    int remap_changed[ INTERNAL_PIXIE_REMAP_TABLES ];
+    for( int i = 0; i < INTERNAL_PIXIE_REMAP_TABLES; ++i ) {
+        remap_changed[ i ] = memcmp( pixie->app_thread.damage.remap_tables[ i ], data->screen.remap_tables[ i ], 
+            sizeof( data->screen.remap_tables[ i ] ) ) != 0;
+    }
+    memcpy( pixie->app_thread.damage.remap_tables, data->screen.remap_tables, sizeof( data->screen.remap_tables ) );
+    int blend_changed = pixie->app_thread.damage.blend_tables != pixie->app_thread.blend.tables;
+    pixie->app_thread.damage.blend_tables = pixie->app_thread.blend.tables;
+
+    for( int i = 0; i < data->sprites.sprite_count; ++i ) {
+        internal_pixie_sprite_t const* sprite = &data->sprites.sprites[ i ];
+        internal_pixie_render_state_t* previous = &pixie->app_thread.damage.states[ i ];
+        internal_pixie_render_state_t current;
+        internal_pixie_sprite_render_state( pixie, data, sprite, &current );
+        int changed = memcmp( &current, previous, sizeof( current ) ) != 0;
+        if( !changed && sprite->visible && sprite->type == TYPE_SPRITE ) {
+            int remap = sprite->data.sprite.remap;
+            changed = ( remap > 0 && remap <= INTERNAL_PIXIE_REMAP_TABLES && remap_changed[ remap - 1 ] ) || 
+                ( blend_changed && sprite->data.sprite.blend != BLEND_NONE );
+        }
+        if( changed ) {
+            internal_pixie_damage_rows( pixie, previous->top, previous->bottom );
+            internal_pixie_damage_rows( pixie, current.top, current.bottom );
+            *previous = current;
+        }
     }
+
+    int palette_changed = first_frame || 
+        memcmp( pixie->app_thread.damage.palette, data->screen.palette, sizeof( data->screen.palette ) ) != 0;
+    memcpy( pixie->app_thread.damage.palette, data->screen.palette, sizeof( data->screen.palette ) );
+    return palette_changed;
 }
 
 
@@ -1560,15 +3165,23 @@ static u32* internal_pixie_frame_update( internal_pixie_t* pixie, int* out_width
     ASSERT( sizeof( data_user->keyboard ) == sizeof( pixie->app_thread.keyboard ), "Keyboard struct mismatch" );
     memcpy( &data_user->keyboard, &pixie->app_thread.keyboard, sizeof( data_user->keyboard ) );
 
-    // Update sprite movement
+    // Update sprite movement and animation
+    internal_pixie_update_sprite_moves( pixie, data_user );
     for( int i = 0; i < data_user->sprites.sprite_count; ++i ) {    
         internal_pixie_sprite_t* sprite = &data_user->sprites.sprites[ i ];
-        internal_pixie_update_sprite_movement( &sprite->x, &sprite->move_x );
-        internal_pixie_update_sprite_movement( &sprite->y, &sprite->move_y );
+        internal_pixie_update_sprite_path( pixie, sprite );
+        if( sprite->type == TYPE_SPRITE ) {
+            internal_pixie_update_sprite_animation( &sprite->data.sprite.cel, &sprite->anim );
+        }
     }
 
+    // Update palette fades and cycling
+    internal_pixie_update_palette_effects( data_user->screen.palette, &data_user->palette_effects );
+
     // Copy user thread data to app thread
     internal_pixie_copy_user_thread_data( data_copy, data_user );
+    data_user->screen.damage_top = 0;
+    data_user->screen.damage_bottom = 0;
     data_user = NULL; // We should not touch user data after this point, only the copy
 
     // Release lock - we now have all data we need
@@ -1585,23 +3198,47 @@ static u32* internal_pixie_frame_update( internal_pixie_t* pixie, int* out_width
     if( out_crt_mode ) *out_crt_mode = data_copy->window.crt_mode;
 
     // Render sprites
-    for( int i = 0; i < data_copy->sprites.sprite_count; ++i ) {    
-        internal_pixie_render_sprite( pixie, data_copy, &data_copy->sprites.sprites[ i ] );       
-    }
+    internal_pixie_update_blend_tables( pixie, data_copy->screen.palette );
+    internal_pixie_cull_sprites( pixie, data_copy );
+    int palette_changed = internal_pixie_find_damage( pixie, data_copy );
 
-
-    // Convert palette based screen composite to 24-bit XBGR. Both `xbgr` and `composite` are only used from here
+    // Each band of damaged rows is restored from the screen, and the sprites which overlap it are drawn again
     int screen_width = data_copy->screen.screen_width;
     int screen_height = data_copy->screen.screen_height;
+    u8 const* rows = pixie->app_thread.damage.rows;
+    for( int band_top = 0; band_top < screen_height; ) {
+        if( !rows[ band_top ] ) {
+            ++band_top;
+            continue;
+        }
+        int band_bottom = band_top + 1;
+        while( band_bottom < screen_height && rows[ band_bottom ] ) ++band_bottom;
+
+        u8* target = pixie->app_thread.screen.composite + band_top * screen_width;
+        memcpy( target, data_copy->screen.pixels + band_top * screen_width, 
+            sizeof( u8 ) * screen_width * ( band_bottom - band_top ) );
+        for( int i = 0; i < data_copy->sprites.sprite_count; ++i ) {    
+            internal_pixie_render_state_t const* state = &pixie->app_thread.damage.states[ i ];
+            if( pixie->app_thread.culled[ i ] || state->bottom <= band_top || state->top >= band_bottom ) continue;
+            internal_pixie_render_sprite( pixie, data_copy, &data_copy->sprites.sprites[ i ], target, band_top, 
+                band_bottom - band_top );       
+        }
+        band_top = band_bottom;
+    }
+
+
+    // Convert palette based screen composite to 24-bit XBGR, for the rows which have changed (or all of them, if the 
+    // palette has changed). Both `xbgr` and `composite` are only used from here
     int border_width = data_copy->screen.border_width;
     int border_height = data_copy->screen.border_height;
     int full_width = screen_width + border_width * 2;
     int full_height = screen_height + border_height * 2;
 
     for( int y = 0; y < screen_height; ++y ) {
+        if( !palette_changed && !rows[ y ] ) continue;
         for( int x = 0; x < screen_width; ++x ) {
             pixie->app_thread.screen.xbgr[ x + border_width + ( y + border_height ) * full_width ] = 
-                    data_copy->screen.palette[ data_copy->screen.pixels[ x + y * screen_width ] ];
+                    data_copy->screen.palette[ pixie->app_thread.screen.composite[ x + y * screen_width ] ];
         }
     }
 
@@ -1611,23 +3248,374 @@ static u32* internal_pixie_frame_update( internal_pixie_t* pixie, int* out_width
     }
 
 
+// Returns the sample pair at `position` in the current pre-rendered song, decoding its ADPCM block if necessary. The
+// returned pointer is only valid until the next call. The pair after it can always be read through the same pointer, 
+// as long as `position + 1` is within the song - for ADPCM, it is taken from the header of the next block.
+
+static i16 const* internal_pixie_prerendered_frame( internal_pixie_t* pixie, int position ) {
+    internal_pixie_song_pcm_t const* song = pixie->audio.prerendered.song;
+    u8 const* data = (u8 const*)( song + 1 );
+    if( song->encoding != INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM ) {
+        return ( (i16 const*) data ) + position * 2;
+    }
+
+    int block = position / song->samples_per_block;
+    if( block != pixie->audio.prerendered.decoded_block ) {
+        adpcm_decode_block( data + block * song->block_size, 2, song->samples_per_block, 
+            pixie->audio.prerendered.decoded );
+        if( ( block + 1 ) * song->samples_per_block < song->length ) {
+            adpcm_block_first_frame( data + ( block + 1 ) * song->block_size, 2, 
+                pixie->audio.prerendered.decoded + song->samples_per_block * 2 );
+        }
+        pixie->audio.prerendered.decoded_block = block;
+    }
+    return pixie->audio.prerendered.decoded + ( position - block * song->samples_per_block ) * 2;
+}
+
+
+// Used instead of `internal_pixie_render_prerendered_song` when the song was rendered at a different rate than the 
+// sound device is running at. Steps through the song in 16.16 fixed point, interpolating linearly between samples.
+
+static void internal_pixie_resample_prerendered_song( internal_pixie_t* pixie, i16* sample_pairs, 
+    int sample_pairs_count ) {
+
+    internal_pixie_song_pcm_t const* song = pixie->audio.prerendered.song;
+    int looping = song->loop_start < song->loop_end;
+    u32 step = (u32)( ( ( (u64) song->sample_rate ) << 16 ) / (u64) pixie->audio.sample_rate );
+
+    int position = pixie->audio.prerendered.position;
+    u32 fraction = pixie->audio.prerendered.position_fraction;
+    for( int i = 0; i < sample_pairs_count; ++i ) {
+        if( position >= song->loop_end ) {
+            if( !looping ) {
+                // Not looping, so just pad with silence once the end is reached
+                memset( sample_pairs + i * 2, 0, sizeof( i16 ) * ( sample_pairs_count - i ) * 2 );
+                break;
+            }
+            position = song->loop_start + ( position - song->loop_end );
+        }
+
+        i16 const* frame = internal_pixie_prerendered_frame( pixie, position );
+        int left = frame[ 0 ];
+        int right = frame[ 1 ];
+        if( position + 1 < song->loop_end ) {
+            frame += 2; // The next pair is held together with this one, even across ADPCM blocks
+        } else if( looping ) {
+            frame = internal_pixie_prerendered_frame( pixie, song->loop_start ); 
+        }
+        int t = (int)( fraction >> 1 ); // Only 15 bits, so the multiplications below can't overflow
+        sample_pairs[ i * 2 + 0 ] = (i16)( left + ( ( ( frame[ 0 ] - left ) * t ) >> 15 ) );
+        sample_pairs[ i * 2 + 1 ] = (i16)( right + ( ( ( frame[ 1 ] - right ) * t ) >> 15 ) );
+
+        fraction += step;
+        position += (int)( fraction >> 16 );
+        fraction &= 0xffff;
+    }
+    pixie->audio.prerendered.position = position;
+    pixie->audio.prerendered.position_fraction = fraction;
+}
+
+
+// Copies the next samples of the current pre-rendered song straight out of the asset bundle, looping as necessary. For
+// ADPCM songs, one block at a time is decoded into `prerendered.decoded`. Called from `internal_pixie_render_samples` 
+// while holding the song mutex.
+
+static void internal_pixie_render_prerendered_song( internal_pixie_t* pixie, i16* sample_pairs, 
+    int sample_pairs_count ) {
+
+    internal_pixie_song_pcm_t const* song = pixie->audio.prerendered.song;
+    if( song->sample_rate != pixie->audio.sample_rate ) {
+        internal_pixie_resample_prerendered_song( pixie, sample_pairs, sample_pairs_count );
+        return;
+    }
+
+    int rendered = 0;
+    while( rendered < sample_pairs_count ) {
+        if( pixie->audio.prerendered.position >= song->loop_end ) {
+            if( song->loop_start >= song->loop_end ) {
+                // Not looping, so just pad with silence once the end is reached
+                memset( sample_pairs + rendered * 2, 0, sizeof( i16 ) * ( sample_pairs_count - rendered ) * 2 );
+                return;
+            }
+            pixie->audio.prerendered.position = song->loop_start;
+        }
+
+        int position = pixie->audio.prerendered.position;
+        int count = sample_pairs_count - rendered;
+        if( count > song->loop_end - position ) count = song->loop_end - position;
+
+        if( song->encoding == INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM ) {
+            int offset = position % song->samples_per_block;
+            if( count > song->samples_per_block - offset ) count = song->samples_per_block - offset;
+        }
+        memcpy( sample_pairs + rendered * 2, internal_pixie_prerendered_frame( pixie, position ), 
+            sizeof( i16 ) * count * 2 );
+
+        rendered += count;
+        pixie->audio.prerendered.position += count;
+    }
+}
+
+
+// Returns the sample frame at `position` of the sound playing on the specified channel, either straight from the fully
+// decoded samples, or by decoding the ADPCM block containing it. The returned pointer is only valid until the next 
+// call. The frame after it can always be read through the same pointer, as long as `position + 1` is within the 
+// sound - for ADPCM, it is taken from the header of the next block.
+
+static i16 const* internal_pixie_sound_frame( internal_pixie_sound_channel_t* channel, int position ) {
+    internal_pixie_sound_t const* sound = channel->sound;
+    if( channel->samples ) {
+        return channel->samples + position * sound->channels;
+    }
+
+    int block = position / sound->samples_per_block;
+    if( block != channel->decoded_block ) {
+        u8 const* data = (u8 const*)( sound + 1 );
+        adpcm_decode_block( data + block * sound->block_size, sound->channels, sound->samples_per_block, 
+            channel->decoded );
+        if( ( block + 1 ) * sound->samples_per_block < sound->length ) {
+            adpcm_block_first_frame( data + ( block + 1 ) * sound->block_size, sound->channels, 
+                channel->decoded + sound->samples_per_block * sound->channels );
+        }
+        channel->decoded_block = block;
+    }
+    return channel->decoded + ( position - block * sound->samples_per_block ) * sound->channels;
+}
+
+
+// Renders the next samples of the sound playing on the specified channel, resampling it to `sample_rate` if needed 
+// (in 16.16 fixed point, interpolating linearly between samples), and stops the channel once the sound has finished,
+// filling the rest with silence. Returns the number of sample pairs rendered before the sound finished.
+
+static int internal_pixie_render_sound( internal_pixie_sound_channel_t* channel, int sample_rate, 
+    i16* sample_pairs, int sample_pairs_count ) {
+
+    internal_pixie_sound_t const* sound = channel->sound;
+    u32 step = (u32)( ( ( (u64) sound->sample_rate ) << 16 ) / (u64) sample_rate );
+    int last = sound->channels - 1; // Mono sounds use the same sample for left and right
+
+    int position = channel->position;
+    u32 fraction = channel->position_fraction;
+    for( int i = 0; i < sample_pairs_count; ++i ) {
+        if( position >= sound->length ) {
+            memset( sample_pairs + i * 2, 0, sizeof( i16 ) * ( sample_pairs_count - i ) * 2 );
+            channel->sound = NULL;
+            channel->samples = NULL;
+            return i;
+        }
+
+        i16 const* frame = internal_pixie_sound_frame( channel, position );
+        int left = frame[ 0 ];
+        int right = frame[ last ];
+        if( fraction && position + 1 < sound->length ) {
+            frame += sound->channels; // The next frame is held together with this one, even across ADPCM blocks
+            int t = (int)( fraction >> 1 ); // Only 15 bits, so the multiplications below can't overflow
+            left += ( ( frame[ 0 ] - left ) * t ) >> 15;
+            right += ( ( frame[ last ] - right ) * t ) >> 15;
+        }
+        sample_pairs[ i * 2 + 0 ] = (i16) left;
+        sample_pairs[ i * 2 + 1 ] = (i16) right;
+
+        fraction += step;
+        position += (int)( fraction >> 16 );
+        fraction &= 0xffff;
+    }
+    channel->position = position;
+    channel->position_fraction = fraction;
+    return sample_pairs_count;
+}
+
+
+// Copies the samples the stream reader has decoded ahead of time. If the reader hasn't been able to keep up, the rest
+// is left silent and counted as an underrun, rather than blocking the audio thread. Right after a stream is started,
+// before the reader has filled the buffer once, running out is expected and not counted. Returns 0 if there is no 
+// stream playing, in which case nothing is copied. If the stream is being changed while its positions are read, this
+// callback is left silent, and the new stream is picked up by the next one.
+
+static int internal_pixie_read_stream( internal_pixie_t* pixie, i16* sample_pairs, int sample_pairs_count ) {
+    int const generation = thread_atomic_int_load( &pixie->audio.stream.generation );
+    u32 read_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.read_pos );
+    u32 start_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.start_pos );
+    int ended = thread_atomic_int_load( &pixie->audio.stream.ended );
+    u32 end_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.end_pos );
+    int filled = thread_atomic_int_load( &pixie->audio.stream.filled );
+    if( ( generation & 1 ) || thread_atomic_int_load( &pixie->audio.stream.generation ) != generation ) {
+        memset( sample_pairs, 0, sizeof( i16 ) * sample_pairs_count * 2 );
+        return 1;
+    }
+
+    if( (int)( start_pos - read_pos ) > 0 ) read_pos = start_pos;
+    if( ended && (int)( end_pos - read_pos ) <= 0 ) {
+        thread_atomic_int_store( &pixie->audio.stream.read_pos, (int) read_pos );
+        return 0;
+    }
+
+    int copied = 0;
+    int available = (int)( (u32) thread_atomic_int_load( &pixie->audio.stream.write_pos ) - read_pos );
+    while( copied < sample_pairs_count && available > 0 ) {
+        int offset = (int)( read_pos % (u32) pixie->audio.stream.capacity );
+        int count = sample_pairs_count - copied;
+        if( count > available ) count = available;
+        if( count > pixie->audio.stream.capacity - offset ) count = pixie->audio.stream.capacity - offset;
+        memcpy( sample_pairs + copied * 2, pixie->audio.stream.buffer + offset * 2, sizeof( i16 ) * count * 2 );
+        copied += count;
+        available -= count;
+        read_pos += (u32) count;
+    }
+    if( copied < sample_pairs_count ) {
+        memset( sample_pairs + copied * 2, 0, sizeof( i16 ) * ( sample_pairs_count - copied ) * 2 );
+        if( !ended && filled ) {
+            thread_atomic_int_inc( &pixie->audio.stream.underruns );
+        }
+    }
+
+    thread_atomic_int_store( &pixie->audio.stream.read_pos, (int) read_pos );
+    thread_signal_raise( &pixie->audio.stream.signal );
+    return 1;
+}
+
+
 // Called by audio thread (via `internal_pixie_app_sound_callback`) when it needs new audio samples
 
+#if PIXIE_SONG_WORKERS > 0
+
+// Adds the `count` samples of `source` to those of `target`, saturating the results to the 16-bit range
+
+static void internal_pixie_mix_samples( i16* target, i16 const* source, int count ) {
+    int i = 0;
+    #ifdef INTERNAL_PIXIE_SSE2
+        for( ; i + 8 <= count; i += 8 ) {
+            __m128i a = _mm_loadu_si128( (__m128i const*)( target + i ) );
+            __m128i b = _mm_loadu_si128( (__m128i const*)( source + i ) );
+            _mm_storeu_si128( (__m128i*)( target + i ), _mm_adds_epi16( a, b ) );
+        }
+    #endif
+    for( ; i < count; ++i ) {
+        int sample = target[ i ] + source[ i ];
+        target[ i ] = (i16)( sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample );
+    }
+}
+
+
+// Mixes the samples the song workers have rendered ahead of time. If a worker hasn't been able to keep up, the rest 
+// of its part is left silent and counted as an underrun, rather than blocking the audio thread. Its read position is
+// still moved on, so that its channels stay in time with the others once it catches up. Called from 
+// `internal_pixie_render_samples` while holding the song mutex.
+
+static void internal_pixie_mix_song_workers( internal_pixie_t* pixie, i16* sample_pairs, int sample_pairs_count ) {
+    memset( sample_pairs, 0, sizeof( i16 ) * sample_pairs_count * 2 );
+    for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+        internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+        u32 read_pos = (u32) thread_atomic_int_load( &worker->read_pos );
+        u32 valid_pos = (u32) thread_atomic_int_load( &worker->valid_pos );
+        if( (int)( valid_pos - read_pos ) > 0 ) read_pos = valid_pos;
+
+        int mixed = 0;
+        int available = (int)( (u32) thread_atomic_int_load( &worker->write_pos ) - read_pos );
+        while( mixed < sample_pairs_count && available > 0 ) {
+            int offset = (int)( read_pos % (u32) worker->capacity );
+            int count = sample_pairs_count - mixed;
+            if( count > available ) count = available;
+            if( count > worker->capacity - offset ) count = worker->capacity - offset;
+            internal_pixie_mix_samples( sample_pairs + mixed * 2, worker->buffer + offset * 2, count * 2 );
+            mixed += count;
+            available -= count;
+            read_pos += (u32) count;
+        }
+        if( mixed < sample_pairs_count ) {
+            thread_atomic_int_inc( &pixie->audio.song_underruns );
+            read_pos += (u32)( sample_pairs_count - mixed );
+        }
+
+        thread_atomic_int_store( &worker->read_pos, (int) read_pos );
+        thread_signal_raise( &worker->signal );
+    }
+    pixie->audio.current_song.playback_sample_pos += (u64) sample_pairs_count;
+}
+
+#endif /* PIXIE_SONG_WORKERS > 0 */
+
+
+// Sets up all song workers to play `current_song` from its current position, stopping them if it isn't playing. Does
+// nothing if PIXIE_SONG_WORKERS is 0. Called from the user thread while holding the song mutex.
+
+static void internal_pixie_sync_song_workers( internal_pixie_t* pixie ) {
+    #if PIXIE_SONG_WORKERS > 0
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+            internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+            thread_mutex_lock( &worker->mutex );
+            worker->song = pixie->audio.current_song;
+            if( worker->song.song.data ) {
+                u32 channel_mask = 0;
+                for( int j = i; j < 16; j += PIXIE_SONG_WORKERS ) channel_mask |= 1u << j;
+                mid_set_channel_mask( &worker->song, channel_mask );
+                // A worker which has fallen behind the audio callback starts that far back in the song, so that it is
+                // in time with the others once it has caught up
+                u64 position = pixie->audio.current_song.playback_sample_pos;
+                u32 read_pos = (u32) thread_atomic_int_load( &worker->read_pos );
+                int behind = (int)( read_pos - (u32) thread_atomic_int_load( &worker->write_pos ) );
+                if( behind > 0 ) position = position > (u64) behind ? position - (u64) behind : 0;
+                mid_seek( &worker->song, position, worker->sound_font );
+            } else if( worker->sound_font ) {
+                tsf_reset( worker->sound_font );
+            }
+            thread_atomic_int_store( &worker->valid_pos, thread_atomic_int_load( &worker->write_pos ) );
+            thread_mutex_unlock( &worker->mutex );
+            thread_signal_raise( &worker->signal );
+        }
+    #else
+        (void) pixie;
+    #endif
+}
+
+
 static void internal_pixie_render_samples( internal_pixie_t* pixie, i16* sample_pairs, int sample_pairs_count )
     {
-    // Render midi song to local buffer
+    // The device might ask for more samples than fit in the mix buffers, in which case they're rendered in parts
+    while( sample_pairs_count > pixie->audio.sound_buffer_size ) 
+        {
+        internal_pixie_render_samples( pixie, sample_pairs, pixie->audio.sound_buffer_size );
+        sample_pairs += pixie->audio.sound_buffer_size * 2;
+        sample_pairs_count -= pixie->audio.sound_buffer_size;
+        }
+
+    // Render midi song, or copy pre-rendered song, to local buffer
     i16* song = pixie->audio.mix_buffers;
     thread_mutex_lock( &pixie->audio.song_mutex ); 
-    if( !pixie->audio.current_song.song.event_count || !pixie->audio.current_song.song.events ) 
+    if( pixie->audio.prerendered.song )
+        internal_pixie_render_prerendered_song( pixie, song, sample_pairs_count );
+    else if( !pixie->audio.current_song.song.event_count || !pixie->audio.current_song.song.data ) 
         memset( song, 0, sizeof( i16 ) * sample_pairs_count * 2 );
     else    
-        mid_render_short( &pixie->audio.current_song, song, sample_pairs_count, pixie->audio.sound_font );
+        #if PIXIE_SONG_WORKERS > 0
+            internal_pixie_mix_song_workers( pixie, song, sample_pairs_count );
+        #else
+            mid_render_short( &pixie->audio.current_song, song, sample_pairs_count, pixie->audio.sound_font );
+        #endif
     thread_mutex_unlock( &pixie->audio.song_mutex );
 
+    // Render sound effects to their local buffers, keeping track of which ones are playing
+    i16* sounds[ INTERNAL_PIXIE_SOUND_CHANNELS + 1 ];
+    int sounds_count = 0;
+    thread_mutex_lock( &pixie->audio.sound_mutex ); 
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CHANNELS; ++i )
+        {
+        if( !pixie->audio.sounds[ i ].sound ) continue;
+        i16* buffer = pixie->audio.mix_buffers + pixie->audio.sound_buffer_size * 2 * ( 2 + i );
+        internal_pixie_render_sound( &pixie->audio.sounds[ i ], pixie->audio.sample_rate, buffer, sample_pairs_count );
+        sounds[ sounds_count++ ] = buffer;
+        }
+    thread_mutex_unlock( &pixie->audio.sound_mutex );
+
+    // Copy streamed audio to its local buffer, mixing it with the sound effects
+    i16* stream = pixie->audio.mix_buffers + pixie->audio.sound_buffer_size * 2;
+    if( internal_pixie_read_stream( pixie, stream, sample_pairs_count ) ) sounds[ sounds_count++ ] = stream;
+
     // Mix all local buffers
     for( int i = 0; i < sample_pairs_count * 2; ++i )
         {
         int sample = song[ i ];
+        for( int j = 0; j < sounds_count; ++j ) sample += sounds[ j ][ i ];
         sample = sample > 32767 ? 32767 : sample < -32727 ? -32727 : sample; // TODO: soft clip?
         sample_pairs[ i ] = (i16) sample;
         }
@@ -1691,13 +3679,14 @@ int internal_pixie_load_bundle( char const* filename, char const* time, char con
     size_t total_size = sizeof( *header ) + sizeof( *assets ) * header->assets_count;
     int offset = (int) total_size;
     for( int i = 0; i < header->assets_count; ++i ) {
+        offset = ( offset + 7 ) & ~7; // Each asset starts at an 8-byte aligned offset
         if( assets[ i ].size < 0 || assets[ i ].offset != offset || assets[ i ].id != i ) {
             mmap_close( bundle );
             return EXIT_FAILURE;
         }
         offset += assets[ i ].size;
-        total_size += assets[ i ].size;
     }
+    total_size = (size_t) offset;
 
     if( total_size != (size_t) s.st_size ) {
         mmap_close( bundle );
@@ -1739,6 +3728,7 @@ struct internal_pixie_run_context_t {
 struct internal_pixie_user_thread_context_t {
     struct internal_pixie_run_context_t* run_context; // The user supplied main function and arguments
     int sound_buffer_size; // The size of the streaming sound buffer, defined in `internal_pixie_app_proc`
+    int sample_rate; // The rate of the sound device, as reported when the sound stream is opened
     thread_signal_t user_thread_initialized; // Signals that user thread is running and pixie instance has been created
     thread_atomic_int_t user_thread_finished; // Flags that user thread is done executing and that app loop should stop
     thread_signal_t app_loop_finished; // Signals that app loop has finished, and it is safe to destroy pixie instance
@@ -1758,7 +3748,7 @@ static int internal_pixie_user_thread( void* user_data ) {
     struct internal_pixie_user_thread_context_t* context = (struct internal_pixie_user_thread_context_t*) user_data;
         
     // Create and initialize the main engine state used by all of pixie
-    internal_pixie_t* pixie = internal_pixie_create( context->sound_buffer_size );
+    internal_pixie_t* pixie = internal_pixie_create( context->sound_buffer_size, context->sample_rate );
 
     // A pointer to the `internal_pixie_t` instance needs to be stored in thread local storage, and before we do, we 
     // must create the TLS instance. But only if it is not already created, and as there's nothing stopping a user from 
@@ -1792,6 +3782,12 @@ static int internal_pixie_user_thread( void* user_data ) {
     else // Second time we save the result (`INT_MAX` is mapped to 0, as a jumpres of 0 would call main again)
         result = ( result == INT_MAX ? EXIT_SUCCESS : result );
 
+    // If the user code exited in the middle of a batch, the app thread would be locked out from the instance forever
+    if( pixie->batch.depth > 0 ) {
+        pixie->batch.depth = 0;
+        internal_pixie_release( pixie->batch.instance );
+    }
+
     // Signal to the app thread that user thread has completed its execution, and it should exit its main loop
     thread_atomic_int_store( &context->user_thread_finished, 1 );
     
@@ -1812,14 +3808,144 @@ static int internal_pixie_user_thread( void* user_data ) {
 -----------------
 */
 
-// Audio playback is started by `internal_pixie_app_proc`, and works with a streaming sound buffer. Every time the 
-// stream have played enough to need more samples, it calls this callback function, which just pass the call on to 
-// `internal_pixie_render_samples` which renders all currently playing sounds and mix all samples together for the 
-// sound buffer.
+// Updates the sound timing stats with the time between this callback and the previous one, and the time it took to
+// mix the samples. If more time has passed since the previous callback than it takes to play two callbacks worth of
+// samples, the sound device will have run out of samples to play, and this is counted as an underrun. If mixing takes
+// more than half the time it takes to play the samples, it is counted as an overrun.
 
-void internal_pixie_app_sound_callback( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ) {
-    internal_pixie_t* pixie = (internal_pixie_t*) user_data;
+static void internal_pixie_time_sound_callback( internal_pixie_t* pixie, APP_U64 start, APP_U64 end, 
+    int sample_pairs_count ) {
+
+    APP_U64 freq = app_time_freq( pixie->audio.app );
+    if( freq == 0 ) return; // No timer available
+
+    int duration_us = (int)( ( (i64) sample_pairs_count * 1000000 ) / pixie->audio.sample_rate );
+    int render_us = (int)( ( ( end - start ) * 1000000 ) / freq );
+    int render_avg_us = thread_atomic_int_load( &pixie->audio.timing.render_avg_us );
+    thread_atomic_int_store( &pixie->audio.timing.render_avg_us, render_avg_us + ( render_us - render_avg_us ) / 16 );
+    if( render_us > thread_atomic_int_load( &pixie->audio.timing.render_max_us ) ) {
+        thread_atomic_int_store( &pixie->audio.timing.render_max_us, render_us );
+    }
+    if( render_us > duration_us / 2 ) {
+        thread_atomic_int_inc( &pixie->audio.timing.overruns );
+    }
+
+    if( pixie->audio.timing.prev_callback ) {
+        int period_us = (int)( ( ( start - pixie->audio.timing.prev_callback ) * 1000000 ) / freq );
+        int period_avg_us = thread_atomic_int_load( &pixie->audio.timing.period_avg_us );
+        thread_atomic_int_store( &pixie->audio.timing.period_avg_us, 
+            period_avg_us + ( period_us - period_avg_us ) / 16 );
+        if( period_us > thread_atomic_int_load( &pixie->audio.timing.period_max_us ) ) {
+            thread_atomic_int_store( &pixie->audio.timing.period_max_us, period_us );
+        }
+        if( period_us > duration_us * 2 ) {
+            thread_atomic_int_inc( &pixie->audio.timing.underruns );
+        }
+    }
+    pixie->audio.timing.prev_callback = start;
+    thread_atomic_int_inc( &pixie->audio.timing.callbacks );
+}
+
+
+// Audio playback is started by `internal_pixie_app_proc`, and works with a streaming sound buffer. Every time the 
+// stream have played enough to need more samples, it calls this callback function, which just pass the call on to 
+// `internal_pixie_render_samples` which renders all currently playing sounds and mix all samples together for the 
+// sound buffer.
+
+void internal_pixie_app_sound_callback( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ) {
+    internal_pixie_t* pixie = (internal_pixie_t*) user_data;
+    APP_U64 start = app_time_count( pixie->audio.app );
     internal_pixie_render_samples( pixie, sample_pairs, sample_pairs_count ); 
+    internal_pixie_time_sound_callback( pixie, start, app_time_count( pixie->audio.app ), sample_pairs_count );
+}
+
+
+// Used while starting up, before there's a pixie instance to render samples from
+
+void internal_pixie_app_silence_callback( APP_S16* sample_pairs, int sample_pairs_count, void* user_data ) {
+    (void) user_data;
+    memset( sample_pairs, 0, sizeof( APP_S16 ) * sample_pairs_count * 2 );
+}
+
+
+// Called by the app thread after opening the sound device, with the rate it is running at. The device might pick a
+// different rate when it is reopened, in which case all sound is rendered at the new rate from then on, and a song
+// which is playing carries on from the same point in time.
+
+static void internal_pixie_set_sample_rate( internal_pixie_t* pixie, int sample_rate ) {
+    if( sample_rate <= 0 || sample_rate == pixie->audio.sample_rate ) return;
+
+    thread_mutex_lock( &pixie->audio.song_mutex );
+    thread_mutex_lock( &pixie->audio.sound_mutex );
+    thread_mutex_lock( &pixie->audio.stream.mutex );
+    int const previous_rate = pixie->audio.sample_rate;
+    pixie->audio.sample_rate = sample_rate;
+    thread_mutex_unlock( &pixie->audio.stream.mutex );
+    thread_mutex_unlock( &pixie->audio.sound_mutex );
+
+    mid_t* song = &pixie->audio.current_song;
+    if( song->song.data ) {
+        song->playback_sample_pos = ( song->playback_sample_pos * (u64) sample_rate ) / (u64) previous_rate;
+        mid_set_output_rate( song, sample_rate );
+    }
+    if( pixie->audio.sound_font ) {
+        tsf_set_output( pixie->audio.sound_font, TSF_STEREO_INTERLEAVED, sample_rate, 0.0f );
+    }
+    #if PIXIE_SONG_WORKERS > 0
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+            internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+            thread_mutex_lock( &worker->mutex );
+            if( worker->sound_font ) tsf_set_output( worker->sound_font, TSF_STEREO_INTERLEAVED, sample_rate, 0.0f );
+            thread_mutex_unlock( &worker->mutex );
+        }
+        internal_pixie_sync_song_workers( pixie );
+    #endif
+    thread_mutex_unlock( &pixie->audio.song_mutex );
+}
+
+
+// Called by the app thread once every frame, to grow the sound buffer by a frame if there has been any underruns or
+// overruns since the last call, or shrink it by a frame if there hasn't been any for a while. The sound stream is 
+// reopened to change its size, which means there will be a brief gap in playback, so it's not done very often, and
+// never to go below the size it started at.
+
+static void internal_pixie_adapt_sound_buffer( internal_pixie_t* pixie, app_t* app ) {
+    int const frame_size = pixie->audio.sample_rate / 60;
+    int const max_size = frame_size * PIXIE_SOUND_BUFFER_MAX_FRAMES;
+    int const max_shrink_delay = 60 * 60 * 10; // Ten minutes
+
+    int size = thread_atomic_int_load( &pixie->audio.timing.buffer_size );
+    int new_size = size;
+    int problems = thread_atomic_int_load( &pixie->audio.timing.underruns ) + 
+        thread_atomic_int_load( &pixie->audio.timing.overruns );
+    if( problems != pixie->audio.timing.problems ) {
+        pixie->audio.timing.problems = problems;
+        pixie->audio.timing.clean_frames = 0;
+        if( size < max_size ) {
+            new_size = size + frame_size;
+            int shrink_delay = pixie->audio.timing.shrink_delay * 2;
+            pixie->audio.timing.shrink_delay = shrink_delay > max_shrink_delay ? max_shrink_delay : shrink_delay;
+        }
+        // The smaller size didn't work out, so settle on the larger one rather than going back and forth
+        if( pixie->audio.timing.shrunk ) {
+            pixie->audio.timing.min_size = new_size;
+            pixie->audio.timing.shrunk = 0;
+        }
+    } else if( ++pixie->audio.timing.clean_frames >= pixie->audio.timing.shrink_delay && 
+        size - frame_size >= pixie->audio.timing.min_size ) {
+        pixie->audio.timing.clean_frames = 0;
+        pixie->audio.timing.shrunk = 1;
+        new_size = size - frame_size;
+    }
+
+    if( new_size != size ) {
+        app_sound( app, 0, NULL, NULL ); // Stop the stream first, so the callback is not running while reopening
+        pixie->audio.timing.prev_callback = 0;
+        thread_atomic_int_store( &pixie->audio.timing.buffer_size, new_size );
+        thread_atomic_int_inc( &pixie->audio.timing.buffer_changes );
+        app_sound( app, new_size * 2, internal_pixie_app_sound_callback, pixie );
+        internal_pixie_set_sample_rate( pixie, app_sound_sample_rate( app ) );
+    }
 }
 
 
@@ -1838,8 +3964,6 @@ void internal_pixie_app_sound_callback( APP_S16* sample_pairs, int sample_pairs_
 static int internal_pixie_app_proc( app_t* app, void* user_data ) {
     struct internal_pixie_run_context_t* run_context = (struct internal_pixie_run_context_t*) user_data;
 
-    int const SOUND_BUFFER_SIZE = 735 * 3; // Three frames worth of sound buffering
-
     int fullscreen = 1;
     int crt_mode = 1;
     
@@ -1855,10 +3979,17 @@ static int internal_pixie_app_proc( app_t* app, void* user_data ) {
     crtemu_frame( crtemu, frame, CRT_FRAME_WIDTH, CRT_FRAME_HEIGHT );
     free( frame );
 
+    // Open the sound stream, playing silence until the pixie instance has been created, to find out which rate the
+    // device is running at. Everything is rendered at that rate, and the sound buffer size is based on it.
+    app_sound( app, 735 * 3 * 2, internal_pixie_app_silence_callback, NULL );
+    int const sample_rate = app_sound_sample_rate( app );
+    int const SOUND_BUFFER_SIZE = ( sample_rate / 60 ) * PIXIE_SOUND_BUFFER_MIN_FRAMES; // Initial buffering
+
     // Set up the shared data between user thread and app thread
     struct internal_pixie_user_thread_context_t user_thread_context;
     user_thread_context.run_context = run_context;
     user_thread_context.sound_buffer_size = SOUND_BUFFER_SIZE;
+    user_thread_context.sample_rate = sample_rate;
     thread_signal_init( &user_thread_context.user_thread_initialized );
     thread_atomic_int_store( &user_thread_context.user_thread_finished, 0 );
     thread_signal_init( &user_thread_context.app_loop_finished );
@@ -1882,7 +4013,9 @@ static int internal_pixie_app_proc( app_t* app, void* user_data ) {
     internal_pixie_t* pixie = user_thread_context.out_pixie;
 
     // Start sound playback
+    pixie->audio.app = app;
     app_sound( app, SOUND_BUFFER_SIZE * 2, internal_pixie_app_sound_callback, pixie );
+    internal_pixie_set_sample_rate( pixie, app_sound_sample_rate( app ) ); // Reopening might have changed the rate
 
     // Create the frametimer instance, and set it to fixed 60hz update. This will ensure we never run faster than that,
     // even if the user have disabled vsync in their graphics card settings.
@@ -1923,6 +4056,9 @@ static int internal_pixie_app_proc( app_t* app, void* user_data ) {
             crt_mode = pixie_crt_mode;
         }
 
+        // Make the sound buffer larger if the sound device has been running out of samples, or smaller if it hasn't
+        internal_pixie_adapt_sound_buffer( pixie, app );
+
 
         // Present the screen buffer to the window
         APP_U64 time = app_time_count( app );
@@ -2002,6 +4138,13 @@ void end( int return_code ) {
 void wait_vbl( void ) {
     internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
 
+    // The app thread can't start the next frame while we hold the instance, so an open batch is suspended while waiting
+    int batch_depth = pixie->batch.depth;
+    if( batch_depth > 0 ) {
+        pixie->batch.depth = 0;
+        internal_pixie_release( pixie->batch.instance );
+    }
+
     // Get the vbl count before we start - we want to wait until it has changed
     int current_vbl_count = thread_atomic_int_load( &pixie->vbl.count );
 
@@ -2013,6 +4156,39 @@ void wait_vbl( void ) {
         // Call `internal_pixie_instance` again, to trigger the check for `force_exit`, so we can terminate if need be
         internal_pixie_instance();
     }
+
+    if( batch_depth > 0 ) {
+        pixie->batch.instance = internal_pixie_acquire();
+        pixie->batch.depth = batch_depth;
+    }
+}
+
+
+// Holds on to the engine state until the matching `pixie_batch_end`, so that all API calls in between can skip the 
+// synchronization with the app thread. The app thread can not start a new frame during a batch, so batches should be 
+// kept short - they are meant for updating many sprites or palette entries in one go. Batches may be nested, and are
+// suspended during `wait_vbl`.
+
+void pixie_batch_begin( void ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( pixie->batch.depth++ == 0 ) {
+        pixie->batch.instance = pixie;
+    }
+}
+
+
+void pixie_batch_end( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( pixie->batch.depth <= 0 ) {
+        return;
+    }
+
+    if( --pixie->batch.depth == 0 ) {
+        internal_pixie_release( pixie->batch.instance );
+        pixie->batch.instance = NULL;
+    }
 }
 
 
@@ -2084,20 +4260,73 @@ void crt_mode_off( void ) {
 
 
 
-// Prints the specified string to the screen using the default font.
+// Returns the pixels which drawing functions should draw to, as selected with `draw_target`. For a surface, its mask is
+// returned as well, and the surface is marked as changed, which drops its RLE data as it will no longer match.
+
+static u8* internal_pixie_draw_target( internal_pixie_t* pixie, u8** mask, int* width, int* height ) {
+    int target = pixie->user_thread.surfaces.draw_target;
+    if( target >= 1 && target <= pixie->user_thread.surfaces.count && 
+        pixie->user_thread.surfaces.surfaces[ target - 1 ].pixels ) {
+
+        internal_pixie_surface_t* surface = &pixie->user_thread.surfaces.surfaces[ target - 1 ];
+        if( surface->rle ) {
+            palrle_free( surface->rle, NULL );
+            surface->rle = NULL;
+        }
+        surface->version = ++pixie->user_thread.surfaces.version;
+        *mask = surface->mask;
+        *width = surface->width;
+        *height = surface->height;
+        return surface->pixels;
+    }
+
+    *mask = NULL;
+    *width = pixie->user_thread.screen.screen_width;
+    *height = pixie->user_thread.screen.screen_height;
+    return pixie->user_thread.screen.pixels;
+}
+
+
+// Records that rows of the screen have been drawn to, so the app thread copies and recomposites them on the next frame
+
+static void internal_pixie_damage_screen( internal_pixie_t* pixie, int y, int height ) {
+    int top = y < 0 ? 0 : y;
+    int bottom = y + height > pixie->user_thread.screen.screen_height ? 
+        pixie->user_thread.screen.screen_height : y + height;
+    if( top >= bottom ) return;
+
+    if( pixie->user_thread.screen.damage_top >= pixie->user_thread.screen.damage_bottom ) {
+        pixie->user_thread.screen.damage_top = top;
+        pixie->user_thread.screen.damage_bottom = bottom;
+    } else {
+        if( top < pixie->user_thread.screen.damage_top ) pixie->user_thread.screen.damage_top = top;
+        if( bottom > pixie->user_thread.screen.damage_bottom ) pixie->user_thread.screen.damage_bottom = bottom;
+    }
+}
+
+
+// Prints the specified string to the screen (or the current draw target) using the default font.
 
 void print( char const* str ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
 
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+
     // Very placeholder font rendering
     static int x = 32;
     static int y = 44;
     while( *str ) {
         unsigned long long chr = default_font()[ (u8) *str++ ];
+        if( !mask ) internal_pixie_damage_screen( pixie, y, 8 );
         for( int iy = 0; iy < 8; ++iy )
             for( int ix = 0; ix < 8; ++ix )
-                if( chr & ( 1ull << ( ix + iy * 8 ) ) )
-                    pixie->user_thread.screen.pixels[ x + ix + ( y + iy ) * pixie->user_thread.screen.screen_width ] = 10; 
+                if( ( chr & ( 1ull << ( ix + iy * 8 ) ) ) && x + ix < width && y + iy < height ) {
+                    pixels[ x + ix + ( y + iy ) * width ] = 10; 
+                    if( mask ) mask[ x + ix + ( y + iy ) * width ] = 255;
+                }
         x += 8;
         if( x - 32 >= 320 ) {
             x = 32;
@@ -2128,7 +4357,10 @@ void load_palette( asset_t asset ) {
 void setcol( int index, rgb_t rgb ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
 
-    if( index < 0 || index >= 256 ) return;
+    if( index < 0 || index >= 256 ) {
+        internal_pixie_release( pixie ); 
+        return;
+    }
     u32 r = (u32)( rgb.r < 0 ? 0 : rgb.r > 255 ? 255 : rgb.r );
     u32 g = (u32)( rgb.g < 0 ? 0 : rgb.g > 255 ? 255 : rgb.g );
     u32 b = (u32)( rgb.b < 0 ? 0 : rgb.b > 255 ? 255 : rgb.b );
@@ -2155,18 +4387,165 @@ rgb_t getcol( int index ) {
 }
 
 
+// Fades the whole palette towards a single color over the specified number of frames, using the specified easing. The
+// fade is performed on the app thread, replacing any fade already in progress, and starts from the current palette.
+// Colors set while a fade is in progress will be overwritten by it.
+
+void palette_fade( rgb_t target, int frames, easing_t easing ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u32 r = (u32)( target.r < 0 ? 0 : target.r > 255 ? 255 : target.r );
+    u32 g = (u32)( target.g < 0 ? 0 : target.g > 255 ? 255 : target.g );
+    u32 b = (u32)( target.b < 0 ? 0 : target.b > 255 ? 255 : target.b );
+    u32 color = ( b << 16 ) | ( g << 8 ) | r;
+
+    internal_pixie_palette_effects_t* effects = &pixie->user_thread.palette_effects;
+    memcpy( effects->fade.from, pixie->user_thread.screen.palette, sizeof( effects->fade.from ) );
+    for( int i = 0; i < 256; ++i ) effects->fade.to[ i ] = color;
+    effects->fade.type = easing >= EASING_LINEAR && easing <= EASING_IN_OUT_CIRCLE ? 
+        (internal_pixie_move_type_t)( INTERNAL_PIXIE_MOVE_LINEAR + easing ) : INTERNAL_PIXIE_MOVE_LINEAR;
+    effects->fade.time = 0;
+    effects->fade.duration = frames > 0 ? frames : 1;
+
+    internal_pixie_release( pixie ); 
+}
+
+
+// Cross-fades from the current palette to the one in the specified palette asset, over the specified number of frames
+
+void palette_crossfade( asset_t asset, int frames ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    internal_pixie_palette_effects_t* effects = &pixie->user_thread.palette_effects;
+    int size = 0;
+    void const* data = internal_pixie_find_asset( pixie, asset, &size );
+    if( size == sizeof( effects->fade.to ) ) {
+        memcpy( effects->fade.from, pixie->user_thread.screen.palette, sizeof( effects->fade.from ) );
+        memcpy( effects->fade.to, data, sizeof( effects->fade.to ) );
+        effects->fade.type = INTERNAL_PIXIE_MOVE_LINEAR;
+        effects->fade.time = 0;
+        effects->fade.duration = frames > 0 ? frames : 1;
+    }
+
+    internal_pixie_release( pixie ); 
+}
+
+
+// Returns 1 while a fade started by `palette_fade` or `palette_crossfade` is in progress, 0 when it has completed
+
+int palette_fading( void ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    int fading = pixie->user_thread.palette_effects.fade.duration > 0;
+
+    internal_pixie_release( pixie ); 
+    return fading;
+}
+
+
+// Rotates palette entries `first` to `last` (inclusive) by `speed` steps per second, towards higher entries for
+// positive speeds and lower entries for negative ones. Calling it again for the same range changes the speed, and a 
+// speed of 0 stops the cycling, leaving the entries as they are.
+
+void palette_cycle( int first, int last, int speed ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    first = first < 0 ? 0 : first > 255 ? 255 : first;
+    last = last < 0 ? 0 : last > 255 ? 255 : last;
+    if( first > last ) {
+        int t = first; first = last; last = t;
+    }
+
+    // Reuse the slot for the same range if there is one, otherwise the first free slot
+    internal_pixie_palette_effects_t* effects = &pixie->user_thread.palette_effects;
+    int slot = -1;
+    for( int i = 0; i < INTERNAL_PIXIE_PALETTE_CYCLES; ++i ) {
+        int used = effects->cycles[ i ].speed != 0;
+        if( used && effects->cycles[ i ].first == first && effects->cycles[ i ].last == last ) {
+            slot = i;
+            break;
+        }
+        if( slot < 0 && !used ) slot = i;
+    }
+
+    if( slot >= 0 && first < last ) {
+        if( effects->cycles[ slot ].speed == 0 ) effects->cycles[ slot ].accumulator = 0;
+        effects->cycles[ slot ].first = first;
+        effects->cycles[ slot ].last = last;
+        effects->cycles[ slot ].speed = speed;
+    }
+
+    internal_pixie_release( pixie ); 
+}
+
+
+// Sets `count` palette entries starting at `first`, with a single acquire of the instance. Entries outside of the
+// palette are skipped.
+
+void setcols( int first, int count, rgb_t const* rgb ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    for( int i = 0; i < count; ++i ) {
+        int index = first + i;
+        if( index < 0 || index >= 256 ) continue;
+        u32 r = (u32)( rgb[ i ].r < 0 ? 0 : rgb[ i ].r > 255 ? 255 : rgb[ i ].r );
+        u32 g = (u32)( rgb[ i ].g < 0 ? 0 : rgb[ i ].g > 255 ? 255 : rgb[ i ].g );
+        u32 b = (u32)( rgb[ i ].b < 0 ? 0 : rgb[ i ].b > 255 ? 255 : rgb[ i ].b );
+        pixie->user_thread.screen.palette[ index ] = ( b << 16 ) | ( g << 8 ) | r;
+    }
+
+    internal_pixie_release( pixie ); 
+}
+
+
+// Reads `count` palette entries starting at `first`. Entries outside of the palette are returned as black.
+
+void getcols( int first, int count, rgb_t* rgb ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    for( int i = 0; i < count; ++i ) {
+        int index = first + i;
+        u32 color = index >= 0 && index < 256 ? pixie->user_thread.screen.palette[ index ] : 0;
+        rgb[ i ].r = (int)( color & 0xff );
+        rgb[ i ].g = (int)( ( color >> 8 ) & 0xff );
+        rgb[ i ].b = (int)( ( color >> 16 ) & 0xff );
+    }
+
+    internal_pixie_release( pixie ); 
+}
+
+
+// Sets up one of the color remap tables (numbered 1 to 16), which maps each of the 256 palette indices to another one.
+// Sprites drawn with `sprite_remap` have their colors replaced through the table, for color variants or hit flashes
+// without needing extra bitmaps or palette changes.
+
+void remap_table( int table, u8 const* remap ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( table < 1 || table > INTERNAL_PIXIE_REMAP_TABLES ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    memcpy( pixie->user_thread.screen.remap_tables[ table - 1 ], remap, 
+        sizeof( pixie->user_thread.screen.remap_tables[ table - 1 ] ) );
+    internal_pixie_release( pixie ); 
+}
+
+
 void sprites_off( void ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
 
     for( int i = 0; i < pixie->user_thread.sprites.sprite_count; ++i ) {
         pixie->user_thread.sprites.sprites[ i ].move_x.count = 0;
         pixie->user_thread.sprites.sprites[ i ].move_y.count = 0;
-        if( pixie->user_thread.sprites.sprites[ i ].type == TYPE_LABEL ) {
-            if( pixie->user_thread.sprites.sprites[ i ].data.label.text ) {
-                free( pixie->user_thread.sprites.sprites[ i ].data.label.text );
-            }
+        pixie->user_thread.sprites.sprites[ i ].anim.active = 0;
+        if( pixie->user_thread.sprites.sprites[ i ].path ) {
+            pixie->user_thread.sprites.sprites[ i ].path->active = 0;
         }
+        internal_pixie_free_sprite_data( &pixie->user_thread.sprites.sprites[ i ] );
         pixie->user_thread.sprites.sprites[ i ].type = TYPE_NONE;
+        pixie->user_thread.sprites.sprites[ i ].layer = 0;
     }
 
 
@@ -2192,18 +4571,20 @@ int sprite( int spr_index, int x, int y, asset_t asset ) {
     }
     
     --spr_index;
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type == TYPE_LABEL ) {
-        if( !pixie->user_thread.sprites.sprites[ spr_index ].data.label.text ) {
-            free( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text );
-        }
-    }
+    internal_pixie_free_sprite_data( &pixie->user_thread.sprites.sprites[ spr_index ] );
     pixie->user_thread.sprites.sprites[ spr_index ].type = TYPE_SPRITE;
     pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.asset = asset + 1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.scale_x = 65536;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.scale_y = 65536;
     pixie->user_thread.sprites.sprites[ spr_index ].x = x;
     pixie->user_thread.sprites.sprites[ spr_index ].y = y;
     pixie->user_thread.sprites.sprites[ spr_index ].origin_x = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].origin_y = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].visible = 1;
+    pixie->user_thread.sprites.sprites[ spr_index ].anim.active = 0;
+    if( pixie->user_thread.sprites.sprites[ spr_index ].path ) {
+        pixie->user_thread.sprites.sprites[ spr_index ].path->active = 0;
+    }
 
     internal_pixie_release( pixie );
     return spr_index + 1;
@@ -2222,6 +4603,7 @@ void sprite_bitmap( int spr_index, asset_t asset ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2288,6 +4670,7 @@ void sprite_pos( int spr_index, int x, int y ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2332,6 +4715,7 @@ void sprite_origin( int spr_index, int x, int y ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2376,6 +4760,7 @@ void sprite_cel( int spr_index, int cel ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2386,231 +4771,1144 @@ void sprite_cel( int spr_index, int cel ) {
     }
 
     pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.cel = cel;
+    pixie->user_thread.sprites.sprites[ spr_index ].anim.active = 0; // Setting the cel manually stops any animation
     internal_pixie_release( pixie );
 }
 
 
-int label( int spr_index, int x, int y, char const* text, int color, asset_t font ) {
+// Mirrors a sprite horizontally (FLIP_H), vertically (FLIP_V) or both (FLIP_H | FLIP_V), within the size of its bitmap.
+// The flip is done while drawing, so it costs nothing extra, and is kept when the sprite is given a new bitmap.
+
+void sprite_flip( int spr_index, int flip ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
-    if( font < 0 || font >= pixie->assets.count ) {
-        internal_pixie_release( pixie );
-        return 0;
-    }
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
-    
+
     --spr_index;
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type == TYPE_LABEL ) {
-        if( !pixie->user_thread.sprites.sprites[ spr_index ].data.label.text ) {
-            free( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text );
-        }
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_SPRITE ) {
+        internal_pixie_release( pixie );
+        return;
     }
-    pixie->user_thread.sprites.sprites[ spr_index ].type = TYPE_LABEL;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.text = strdup( text ? text : "" );
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.font = font + 1;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.color = color;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.outline = -1;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.shadow = -1;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.wrap = -1;
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.align = TEXT_ALIGN_LEFT;
-    pixie->user_thread.sprites.sprites[ spr_index ].x = x;
-    pixie->user_thread.sprites.sprites[ spr_index ].y = y;
-    pixie->user_thread.sprites.sprites[ spr_index ].origin_x = 0;
-    pixie->user_thread.sprites.sprites[ spr_index ].origin_y = 0;
-    pixie->user_thread.sprites.sprites[ spr_index ].visible = 1;
 
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.flip = flip & ( FLIP_H | FLIP_V );
     internal_pixie_release( pixie );
-    return spr_index + 1;
 }
 
 
-int label_text( int spr_index, char const* text ) {
+// Draws a sprite with its colors replaced through one of the tables set up by `remap_table`, or with its original 
+// colors if `table` is 0. Like the flip, it is kept when the sprite is given a new bitmap.
+
+void sprite_remap( int spr_index, int table ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
+
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
-    
+
     --spr_index;
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_SPRITE || table < 0 || 
+        table > INTERNAL_PIXIE_REMAP_TABLES ) {
+
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text ) {
-        free( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text );
-    }
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.text = strdup( text ? text : "" );
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.remap = table;
     internal_pixie_release( pixie );
-    return spr_index + 1;
 }
 
 
-int label_align( int spr_index, text_align_t align ) {
+// Draws a sprite translucently, combining each of its pixels with the screen pixel behind it. BLEND_SHADOW darkens 
+// what is behind the sprite, ignoring the colors of the sprite itself. Like the flip, it is kept when the sprite is 
+// given a new bitmap.
+
+void sprite_blend( int spr_index, blend_t mode ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
+
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
-    
+
     --spr_index;
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_SPRITE || mode < BLEND_NONE || 
+        mode > BLEND_SHADOW ) {
+
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
 
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.align = align;
-
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.blend = mode;
     internal_pixie_release( pixie );
-    return spr_index + 1;
 }
 
 
-int label_color( int spr_index, int color ) {
+// Scales a sprite around its origin, with `scale_x` and `scale_y` in 16.16 fixed point (65536 is the original size).
+// Like the flip, it is kept when the sprite is given a new bitmap.
+
+void sprite_scale( int spr_index, int scale_x, int scale_y ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
+
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
-    
+
     --spr_index;
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_SPRITE ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
     }
 
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.color = color;
-
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.scale_x = scale_x < 0 ? 0 : scale_x;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.scale_y = scale_y < 0 ? 0 : scale_y;
     internal_pixie_release( pixie );
-    return spr_index + 1;
 }
 
 
-int label_outline( int spr_index, int color ) {
+// Returns the cel currently displayed for the sprite, which is updated every frame while it is being animated
+
+int sprite_current_cel( int spr_index ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
+
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
         return 0;
     }
-    
+
     --spr_index;
+    int cel = pixie->user_thread.sprites.sprites[ spr_index ].type == TYPE_SPRITE ? 
+        pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.cel : 0;
+    internal_pixie_release( pixie );
+    return cel;
+}
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+
+// Plays the cels from `first_cel` to `last_cel` (inclusive), showing each for `frames_per_cel` frames. The animation
+// is advanced by the app thread, so it needs no calls from user code once started. ANIM_LOOP restarts from the first
+// cel after the last, ANIM_PINGPONG plays back and forth, and ANIM_ONCE stops at the last cel.
+
+void sprite_animate( int spr_index, int first_cel, int last_cel, int frames_per_cel, anim_mode_t mode ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
-        return 0;
+        return;
+    }
+
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_SPRITE ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    internal_pixie_sprite_anim_t* anim = &pixie->user_thread.sprites.sprites[ spr_index ].anim;
+    anim->active = 1;
+    anim->first = first_cel;
+    anim->last = last_cel;
+    anim->frames_per_cel = frames_per_cel > 0 ? frames_per_cel : 1;
+    anim->mode = mode;
+    anim->time = 0;
+    anim->dir = 1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.sprite.cel = first_cel;
+    internal_pixie_release( pixie );
+}
+
+
+// Updates the positions of `count` sprites with a single acquire of the instance. Invalid sprite indices are skipped.
+
+void sprites_pos( int const* spr_indices, int const* xs, int const* ys, int count ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    for( int i = 0; i < count; ++i ) {
+        int spr_index = spr_indices[ i ];
+        if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) continue;
+        pixie->user_thread.sprites.sprites[ spr_index - 1 ].x = xs[ i ];
+        pixie->user_thread.sprites.sprites[ spr_index - 1 ].y = ys[ i ];
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
+// Updates the origins of `count` sprites with a single acquire of the instance. Invalid sprite indices are skipped.
+
+void sprites_origin( int const* spr_indices, int const* xs, int const* ys, int count ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    for( int i = 0; i < count; ++i ) {
+        int spr_index = spr_indices[ i ];
+        if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) continue;
+        pixie->user_thread.sprites.sprites[ spr_index - 1 ].origin_x = xs[ i ];
+        pixie->user_thread.sprites.sprites[ spr_index - 1 ].origin_y = ys[ i ];
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
+// Sets the scroll position. Sprites are drawn offset by the camera position, scaled by the parallax factor of the layer
+// they are on, so a whole scene can be scrolled with a single call.
+
+void camera( int x, int y ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    pixie->user_thread.camera.x = x;
+    pixie->user_thread.camera.y = y;
+    internal_pixie_release( pixie );
+}
+
+
+int camera_x( void ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    int x = pixie->user_thread.camera.x;
+    internal_pixie_release( pixie );
+    return x;
+}
+
+
+int camera_y( void ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    int y = pixie->user_thread.camera.y;
+    internal_pixie_release( pixie );
+    return y;
+}
+
+
+// Sets how much a layer moves with the camera, in percent. Layer 0 defaults to 0 (sprites stay in place on screen), 
+// and layers 1 to 7 default to 100 (sprites move with the camera). Lower values make for distant backgrounds.
+
+void layer_parallax( int layer, int percent_x, int percent_y ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( layer < 0 || layer >= INTERNAL_PIXIE_LAYER_COUNT ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    pixie->user_thread.camera.parallax_x[ layer ] = percent_x;
+    pixie->user_thread.camera.parallax_y[ layer ] = percent_y;
+    internal_pixie_release( pixie );
+}
+
+
+// Assigns a sprite to one of the camera layers. The layer is kept if the sprite is later given a new bitmap or label.
+
+void sprite_layer( int spr_index, int layer ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    if( layer < 0 || layer >= INTERNAL_PIXIE_LAYER_COUNT ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    --spr_index;
+    pixie->user_thread.sprites.sprites[ spr_index ].layer = layer;
+    internal_pixie_release( pixie );
+}
+
+
+int label( int spr_index, int x, int y, char const* text, int color, asset_t font ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( font < 0 || font >= pixie->assets.count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+    internal_pixie_free_sprite_data( &pixie->user_thread.sprites.sprites[ spr_index ] );
+    pixie->user_thread.sprites.sprites[ spr_index ].type = TYPE_LABEL;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.text = strdup( text ? text : "" );
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.font = font + 1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.color = color;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.outline = -1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.shadow = -1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.wrap = -1;
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.align = TEXT_ALIGN_LEFT;
+    pixie->user_thread.sprites.sprites[ spr_index ].x = x;
+    pixie->user_thread.sprites.sprites[ spr_index ].y = y;
+    pixie->user_thread.sprites.sprites[ spr_index ].origin_x = 0;
+    pixie->user_thread.sprites.sprites[ spr_index ].origin_y = 0;
+    pixie->user_thread.sprites.sprites[ spr_index ].visible = 1;
+    pixie->user_thread.sprites.sprites[ spr_index ].anim.active = 0;
+    if( pixie->user_thread.sprites.sprites[ spr_index ].path ) {
+        pixie->user_thread.sprites.sprites[ spr_index ].path->active = 0;
+    }
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_text( int spr_index, char const* text ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text ) {
+        free( pixie->user_thread.sprites.sprites[ spr_index ].data.label.text );
+    }
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.text = strdup( text ? text : "" );
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_align( int spr_index, text_align_t align ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.align = align;
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_color( int spr_index, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.color = color;
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_outline( int spr_index, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.outline = color;
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_shadow( int spr_index, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.shadow = color;
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+int label_wrap( int spr_index, int wrap ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+
+    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    pixie->user_thread.sprites.sprites[ spr_index ].data.label.wrap = wrap;
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+// Turns a sprite into a tilemap, drawn with the tiles of a TILESET asset, and starting out with the map from the same
+// asset. Only the tiles which are on screen are drawn, so the map can be a lot bigger than the screen.
+
+// Returns the header of a tileset asset, or NULL if the asset is not a tileset, or is too small to hold the map and 
+// tiles its header says it has
+
+static internal_pixie_tileset_t const* internal_pixie_find_tileset( internal_pixie_t* pixie, int asset ) {
+    int size = 0;
+    internal_pixie_tileset_t const* tileset = VOID_CAST( internal_pixie_find_asset( pixie, asset, &size ) );
+    if( !tileset || size < (int) sizeof( *tileset ) || 
+        memcmp( tileset->id, INTERNAL_PIXIE_TILESET_ID, sizeof( tileset->id ) ) != 0 ) {
+        return NULL;
+    }
+    if( tileset->tile_width < 1 || tileset->tile_height < 1 || tileset->tile_count < 0 || tileset->map_width < 0 ||
+        tileset->map_height < 0 ) {
+        return NULL;
+    }
+
+    u64 tile_size = (u64) tileset->tile_width * (u64) tileset->tile_height;
+    u64 cell_count = (u64) tileset->map_width * (u64) tileset->map_height;
+    if( tile_size > (u64) size || cell_count > (u64) size ) return NULL;
+    u64 needed = sizeof( *tileset ) + sizeof( u16 ) * cell_count + (u64) tileset->tile_count * ( 1 + tile_size * 2 );
+    return needed <= (u64) size ? tileset : NULL;
+}
+
+
+int tilemap( int spr_index, int x, int y, asset_t tileset ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    internal_pixie_tileset_t const* data = internal_pixie_find_tileset( pixie, tileset );
+    if( !data ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    internal_pixie_free_sprite_data( sprite );
+
+    size_t map_size = sizeof( u16 ) * data->map_width * data->map_height;
+    sprite->type = TYPE_TILEMAP;
+    sprite->data.tilemap.asset = tileset + 1;
+    sprite->data.tilemap.width = data->map_width;
+    sprite->data.tilemap.height = data->map_height;
+    sprite->data.tilemap.version = ++pixie->user_thread.sprites.tilemap_version;
+    sprite->data.tilemap.map = (u16*) malloc( map_size + sizeof( u16 ) );
+    memcpy( sprite->data.tilemap.map, data + 1, map_size );
+    sprite->x = x;
+    sprite->y = y;
+    sprite->origin_x = 0;
+    sprite->origin_y = 0;
+    sprite->visible = 1;
+    sprite->anim.active = 0;
+    if( sprite->path ) {
+        sprite->path->active = 0;
+    }
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+// Changes the size of a tilemap, keeping the tiles which are inside both the old and the new size. Any new cells are
+// left empty.
+
+void tilemap_resize( int spr_index, int width, int height ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count || width < 0 || height < 0 ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+    
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    if( sprite->type != TYPE_TILEMAP ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    u16* map = (u16*) malloc( sizeof( u16 ) * width * height + sizeof( u16 ) );
+    for( int y = 0; y < height; ++y ) {
+        for( int x = 0; x < width; ++x ) {
+            map[ x + y * width ] = x < sprite->data.tilemap.width && y < sprite->data.tilemap.height ? 
+                sprite->data.tilemap.map[ x + y * sprite->data.tilemap.width ] : INTERNAL_PIXIE_TILE_EMPTY;
+        }
+    }
+    free( sprite->data.tilemap.map );
+    sprite->data.tilemap.map = map;
+    sprite->data.tilemap.width = width;
+    sprite->data.tilemap.height = height;
+    sprite->data.tilemap.version = ++pixie->user_thread.sprites.tilemap_version;
+    internal_pixie_release( pixie );
+}
+
+
+// Sets the tile to display in one cell of a tilemap, or -1 to leave the cell empty
+
+void tilemap_set( int spr_index, int tile_x, int tile_y, int tile ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+    
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    if( sprite->type != TYPE_TILEMAP || tile_x < 0 || tile_y < 0 || tile_x >= sprite->data.tilemap.width || 
+        tile_y >= sprite->data.tilemap.height ) {
+
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    sprite->data.tilemap.map[ tile_x + tile_y * sprite->data.tilemap.width ] = 
+        (u16)( tile < 0 || tile >= INTERNAL_PIXIE_TILE_EMPTY ? INTERNAL_PIXIE_TILE_EMPTY : tile );
+    sprite->data.tilemap.version = ++pixie->user_thread.sprites.tilemap_version;
+    internal_pixie_release( pixie );
+}
+
+
+// Returns the tile displayed in one cell of a tilemap, or -1 if the cell is empty
+
+int tilemap_get( int spr_index, int tile_x, int tile_y ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+    
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return -1;
+    }
+    
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    if( sprite->type != TYPE_TILEMAP || tile_x < 0 || tile_y < 0 || tile_x >= sprite->data.tilemap.width || 
+        tile_y >= sprite->data.tilemap.height ) {
+
+        internal_pixie_release( pixie );
+        return -1;
+    }
+
+    int tile = sprite->data.tilemap.map[ tile_x + tile_y * sprite->data.tilemap.width ];
+    internal_pixie_release( pixie );
+    return tile == INTERNAL_PIXIE_TILE_EMPTY ? -1 : tile;
+}
+
+
+// Creates an offscreen surface, which starts out fully transparent. Returns the surface number (from 1 and up) to pass
+// to `draw_target` and `sprite_surface`, or 0 if the size is invalid.
+
+int surface_create( int width, int height ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( width < 1 || height < 1 ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    // Reuse the slot of a destroyed surface if there is one, otherwise add a new one
+    int index = 0;
+    while( index < pixie->user_thread.surfaces.count && pixie->user_thread.surfaces.surfaces[ index ].pixels ) {
+        ++index;
+    }
+    if( index == pixie->user_thread.surfaces.count ) {
+        pixie->user_thread.surfaces.surfaces = (internal_pixie_surface_t*) realloc( 
+            pixie->user_thread.surfaces.surfaces, sizeof( internal_pixie_surface_t ) * ( index + 1 ) );
+        ++pixie->user_thread.surfaces.count;
+    }
+
+    internal_pixie_surface_t* surface = &pixie->user_thread.surfaces.surfaces[ index ];
+    memset( surface, 0, sizeof( *surface ) );
+    surface->width = width;
+    surface->height = height;
+    surface->version = ++pixie->user_thread.surfaces.version;
+    surface->pixels = (u8*) malloc( sizeof( u8 ) * width * height );
+    surface->mask = (u8*) malloc( sizeof( u8 ) * width * height );
+    memset( surface->pixels, 0, sizeof( u8 ) * width * height );
+    memset( surface->mask, 0, sizeof( u8 ) * width * height );
+
+    internal_pixie_release( pixie );
+    return index + 1;
+}
+
+
+// Destroys a surface. Sprites still displaying it will show nothing, and if it was the draw target, drawing goes back
+// to the screen.
+
+void surface_destroy( int surface ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( surface < 1 || surface > pixie->user_thread.surfaces.count ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    internal_pixie_free_surface( &pixie->user_thread.surfaces.surfaces[ surface - 1 ] );
+    if( pixie->user_thread.surfaces.draw_target == surface ) pixie->user_thread.surfaces.draw_target = 0;
+    internal_pixie_release( pixie );
+}
+
+
+// Fills a surface with a single color, or makes it fully transparent if the color is outside of the 0-255 range
+
+void surface_clear( int surface, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( surface < 1 || surface > pixie->user_thread.surfaces.count || 
+        !pixie->user_thread.surfaces.surfaces[ surface - 1 ].pixels ) {
+
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    internal_pixie_surface_t* data = &pixie->user_thread.surfaces.surfaces[ surface - 1 ];
+    int opaque = color >= 0 && color < 256;
+    memset( data->pixels, opaque ? color : 0, sizeof( u8 ) * data->width * data->height );
+    memset( data->mask, opaque ? 255 : 0, sizeof( u8 ) * data->width * data->height );
+    if( data->rle ) {
+        palrle_free( data->rle, NULL );
+        data->rle = NULL;
+    }
+    data->version = ++pixie->user_thread.surfaces.version;
+    internal_pixie_release( pixie );
+}
+
+
+// Encodes the current contents of a surface as RLE data, so sprites draw it by skipping over the transparent parts 
+// instead of testing every pixel, and only the encoded data has to be passed to the app thread. Worthwhile for mostly
+// transparent surfaces which are not redrawn every frame. Drawing to the surface again drops the encoding.
+
+void surface_encode( int surface ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( surface < 1 || surface > pixie->user_thread.surfaces.count || 
+        !pixie->user_thread.surfaces.surfaces[ surface - 1 ].pixels ) {
+
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    internal_pixie_surface_t* data = &pixie->user_thread.surfaces.surfaces[ surface - 1 ];
+    if( !data->rle ) {
+        data->rle = palrle_encode_mask( data->pixels, data->mask, data->width, data->height, NULL, 0, NULL );
+        data->version = ++pixie->user_thread.surfaces.version;
+    }
+    internal_pixie_release( pixie );
+}
+
+
+// Selects what the drawing functions draw to - the surface with the specified number, or the screen if it is 0
+
+void draw_target( int surface ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( surface < 0 || surface > pixie->user_thread.surfaces.count || 
+        ( surface > 0 && !pixie->user_thread.surfaces.surfaces[ surface - 1 ].pixels ) ) {
+
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    pixie->user_thread.surfaces.draw_target = surface;
+    internal_pixie_release( pixie );
+}
+
+
+// Turns a sprite into one displaying a surface, keeping its position and origin, but stopping any animation or move 
+// it had, like `sprite` does. The surface is shown as it looks when each frame is displayed, so it can be drawn to at
+// any time.
+
+int sprite_surface( int spr_index, int surface ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( surface < 1 || surface > pixie->user_thread.surfaces.count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+    
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    internal_pixie_free_sprite_data( sprite );
+    sprite->type = TYPE_SURFACE;
+    sprite->data.surface.surface = surface;
+    sprite->visible = 1;
+    sprite->anim.active = 0;
+    if( sprite->path ) {
+        sprite->path->active = 0;
+    }
+
+    internal_pixie_release( pixie );
+    return spr_index + 1;
+}
+
+
+// Replaces the synth used for midi songs, closing the previous one. Called while holding the song mutex.
+
+static void internal_pixie_replace_sound_font( internal_pixie_t* pixie, tsf* sound_font ) {
+    #if PIXIE_SONG_WORKERS > 0
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) thread_mutex_lock( &pixie->audio.song_workers[ i ].mutex );
+    #endif
+
+    tsf_close( pixie->audio.sound_font );
+    pixie->audio.sound_font = sound_font;
+    if( sound_font ) {
+        tsf_channel_set_bank_preset( sound_font, 9, 128, 0 );
+        tsf_set_output( sound_font, TSF_STEREO_INTERLEAVED, pixie->audio.sample_rate, 0.0f );
+    }
+
+    #if PIXIE_SONG_WORKERS > 0
+        // The worker synths share the soundfont data, so they need to be recreated from the new one
+        for( int i = 0; i < PIXIE_SONG_WORKERS; ++i ) {
+            internal_pixie_song_worker_t* worker = &pixie->audio.song_workers[ i ];
+            tsf_close( worker->sound_font );
+            worker->sound_font = tsf_copy( sound_font );
+            thread_mutex_unlock( &worker->mutex );
+        }
+
+        // The new synths have no programs set up, so any song which is playing is restarted on them at its position
+        internal_pixie_sync_song_workers( pixie );
+    #endif
+}
+
+
+// Returns the synth used for midi songs, loading the default soundfont if no soundfont has been loaded yet. Called 
+// while holding the song mutex.
+
+static tsf* internal_pixie_sound_font( internal_pixie_t* pixie ) {
+    if( !pixie->audio.sound_font ) {
+        int soundfont_size = 0;
+        u8 const* soundfont = default_soundfont( &soundfont_size );
+        internal_pixie_replace_sound_font( pixie, tsf_load_memory( soundfont, soundfont_size ) );
+    }
+    return pixie->audio.sound_font;
+}
+
+
+void set_soundfont( asset_t asset ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( asset < 0 || asset >= pixie->assets.count ) {
+        return;
+    }
+
+    int soundfont_size = 0;
+    void const* soundfont = internal_pixie_find_asset( pixie, asset, &soundfont_size );
+
+    // Soundfonts are built as ready-to-use images (see `build_soundfont`), which are used in place from the bundle,
+    // but plain .sf2 data (as included with ASSET_BINARY) is also accepted
+    tsf* sound_font = tsf_load_image( soundfont, soundfont_size );
+    if( !sound_font ) {
+        sound_font = tsf_load_memory( soundfont, soundfont_size );
+    }
+    if( !sound_font ) {
+        return;
+    }
+
+    thread_mutex_lock( &pixie->audio.song_mutex );
+    internal_pixie_replace_sound_font( pixie, sound_font );
+    thread_mutex_unlock( &pixie->audio.song_mutex );
+}
+
+
+// Sets up the specified song asset for playback. Called from `play_song` while holding the song mutex.
+
+static void internal_pixie_start_song( internal_pixie_t* pixie, asset_t asset ) {
+    memset( &pixie->audio.current_song, 0, sizeof( pixie->audio.current_song ) );
+    pixie->audio.prerendered.song = NULL;
+
+    int mid_size = 0;
+    void const* mid_data = internal_pixie_find_asset( pixie, asset, &mid_size );
+    if( !mid_data ) {
+        return;
+    }
+
+    // Pre-rendered songs are streamed directly from the bundle, and don't use the soundfont at all
+    internal_pixie_song_pcm_t const* pcm = (internal_pixie_song_pcm_t const*) mid_data;
+    if( mid_size >= (int) sizeof( *pcm ) && memcmp( pcm->id, INTERNAL_PIXIE_SONG_PCM_ID, sizeof( pcm->id ) ) == 0 ) {
+        if( pcm->encoding != INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM || 
+            pcm->samples_per_block <= INTERNAL_PIXIE_SONG_PCM_ADPCM_BLOCK ) {
+
+            if( pixie->audio.sound_font ) tsf_reset( pixie->audio.sound_font );
+            pixie->audio.prerendered.song = pcm;
+            pixie->audio.prerendered.position = 0;
+            pixie->audio.prerendered.position_fraction = 0;
+            pixie->audio.prerendered.decoded_block = -1;
+        }
+        return;
+    }
+
+    if( !mid_init_raw( &pixie->audio.current_song, mid_data, (size_t) mid_size ) ) {
+        return;
+    }
+    mid_set_output_rate( &pixie->audio.current_song, pixie->audio.sample_rate );
+
+    tsf* sound_font = internal_pixie_sound_font( pixie );
+    if( !sound_font ) {
+        memset( &pixie->audio.current_song, 0, sizeof( pixie->audio.current_song ) );
+        return;
+    }
+    tsf_reset( sound_font );
+    tsf_channel_set_bank_preset( sound_font, 9, 128, 0 );
+    tsf_set_output( sound_font, TSF_STEREO_INTERLEAVED, pixie->audio.sample_rate, 0.0f );
+    mid_skip_leading_silence( &pixie->audio.current_song, sound_font );
+}
+
+
+void play_song( asset_t asset ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( asset < 0 || asset >= pixie->assets.count ) {
+        return;
+    }
+
+    thread_mutex_lock( &pixie->audio.song_mutex );
+    internal_pixie_start_song( pixie, asset );
+    internal_pixie_sync_song_workers( pixie );
+    thread_mutex_unlock( &pixie->audio.song_mutex );
+}
+
+
+// Moves playback of the current song to the specified time (in seconds from the start of the song). For midi songs, 
+// this restores the nearest keyframe recorded when the song was built, and only replays the events after it.
+void song_seek( float seconds ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    thread_mutex_lock( &pixie->audio.song_mutex );
+
+    internal_pixie_song_pcm_t const* pcm = pixie->audio.prerendered.song;
+    if( pcm ) {
+        int position = (int)( seconds * pcm->sample_rate ) - pcm->start;
+        position = position < 0 ? 0 : position > pcm->length ? pcm->length : position;
+        pixie->audio.prerendered.position = position;
+        pixie->audio.prerendered.position_fraction = 0;
+    } else if( pixie->audio.current_song.song.data ) {
+        mid_t* song = &pixie->audio.current_song;
+        double sample_pos = seconds < 0.0f ? 0.0 : (double) seconds * song->output_sample_rate;
+        #if PIXIE_SONG_WORKERS > 0
+            // The main synth is not rendered when using workers, so only the position is recorded, and the workers
+            // seek their own synths to it
+            song->playback_sample_pos = (unsigned long long) sample_pos;
+        #else
+            mid_seek( song, (unsigned long long) sample_pos, pixie->audio.sound_font );
+        #endif
+        internal_pixie_sync_song_workers( pixie );
+    }
+
+    thread_mutex_unlock( &pixie->audio.song_mutex );
+}
+
+
+// Returns the current playback time of the current song, in seconds from the start of the song, or 0 if no song is 
+// playing.
+float song_position( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    float position = 0.0f;
+    thread_mutex_lock( &pixie->audio.song_mutex );
+
+    internal_pixie_song_pcm_t const* pcm = pixie->audio.prerendered.song;
+    if( pcm ) {
+        position = (float)( pixie->audio.prerendered.position + pcm->start ) / (float) pcm->sample_rate;
+    } else if( pixie->audio.current_song.song.data ) {
+        mid_t* song = &pixie->audio.current_song;
+        position = (float)( (double) song->playback_sample_pos / song->output_sample_rate );
+    }
+
+    thread_mutex_unlock( &pixie->audio.song_mutex );
+    return position;
+}
+
+
+// Decodes all the ADPCM blocks of a sound, for storing in the sound cache
+
+static i16* internal_pixie_decode_sound( internal_pixie_sound_t const* sound ) {
+    i16* samples = (i16*) malloc( sizeof( i16 ) * sound->length * sound->channels );
+    i16* block = (i16*) malloc( sizeof( i16 ) * sound->samples_per_block * sound->channels );
+    u8 const* data = (u8 const*)( sound + 1 );
+    for( int position = 0; position < sound->length; position += sound->samples_per_block ) {
+        adpcm_decode_block( data, sound->channels, sound->samples_per_block, block );
+        data += sound->block_size;
+        int count = sound->length - position;
+        count = count > sound->samples_per_block ? sound->samples_per_block : count;
+        memcpy( samples + position * sound->channels, block, sizeof( i16 ) * count * sound->channels );
+    }
+    free( block );
+    return samples;
+}
+
+
+// Returns the decoded samples for the specified sound if it is in the sound cache, marking it as recently used, or NULL
+// if it is not. Called while holding the sound mutex.
+
+static i16 const* internal_pixie_find_cached_sound( internal_pixie_t* pixie, internal_pixie_sound_t const* sound ) {
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CACHE_ENTRIES; ++i ) {
+        if( pixie->audio.sound_cache.entries[ i ].sound == sound ) {
+            pixie->audio.sound_cache.entries[ i ].last_used = ++pixie->audio.sound_cache.counter;
+            return pixie->audio.sound_cache.entries[ i ].samples;
+        }
+    }
+    return NULL;
+}
+
+
+// Adds samples decoded by `internal_pixie_decode_sound` to the sound cache, which takes ownership of them, and returns
+// the cached samples for the sound. If the sound has been cached in the meantime, the new samples are freed and the 
+// cached ones returned instead. Least recently used entries are evicted to make room, but never ones which are still 
+// playing. Returns NULL if the sound could not be cached, in which case it will be decoded as it plays instead. Called
+// while holding the sound mutex, but the decoding is done before taking it, so the audio thread is not held up.
+
+static i16 const* internal_pixie_cache_sound( internal_pixie_t* pixie, internal_pixie_sound_t const* sound, 
+    i16* samples ) {
+
+    int size = (int)( sizeof( i16 ) * sound->length * sound->channels );
+    i16 const* cached = internal_pixie_find_cached_sound( pixie, sound );
+    if( cached ) {
+        free( samples );
+        return cached;
+    }
+
+    int free_entry = -1;
+    for( int i = 0; i < INTERNAL_PIXIE_SOUND_CACHE_ENTRIES; ++i ) {
+        if( !pixie->audio.sound_cache.entries[ i ].sound ) {
+            free_entry = i;
+        }
     }
 
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.outline = color;
+    // Evict the least recently used entries until there's enough room, and a free entry to use
+    while( free_entry < 0 || pixie->audio.sound_cache.size + size > PIXIE_SOUND_CACHE_SIZE ) {
+        int evict = -1;
+        for( int i = 0; i < INTERNAL_PIXIE_SOUND_CACHE_ENTRIES; ++i ) {
+            if( !pixie->audio.sound_cache.entries[ i ].sound ) continue;
+            int playing = 0;
+            for( int j = 0; j < INTERNAL_PIXIE_SOUND_CHANNELS; ++j ) {
+                if( pixie->audio.sounds[ j ].samples == pixie->audio.sound_cache.entries[ i ].samples ) playing = 1;
+            }
+            if( !playing && ( evict < 0 || pixie->audio.sound_cache.entries[ i ].last_used < 
+                pixie->audio.sound_cache.entries[ evict ].last_used ) ) {
+                evict = i;
+            }
+        }
+        if( evict < 0 ) {
+            free( samples );
+            return NULL;
+        }
+        pixie->audio.sound_cache.size -= pixie->audio.sound_cache.entries[ evict ].size;
+        free( pixie->audio.sound_cache.entries[ evict ].samples );
+        memset( &pixie->audio.sound_cache.entries[ evict ], 0, sizeof( pixie->audio.sound_cache.entries[ evict ] ) );
+        free_entry = evict;
+    }
 
-    internal_pixie_release( pixie );
-    return spr_index + 1;
+    pixie->audio.sound_cache.entries[ free_entry ].sound = sound;
+    pixie->audio.sound_cache.entries[ free_entry ].samples = samples;
+    pixie->audio.sound_cache.entries[ free_entry ].size = size;
+    pixie->audio.sound_cache.entries[ free_entry ].last_used = ++pixie->audio.sound_cache.counter;
+    pixie->audio.sound_cache.size += size;
+    return pixie->audio.sound_cache.entries[ free_entry ].samples;
 }
 
 
-int label_shadow( int spr_index, int color ) {
-    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
-    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
-        internal_pixie_release( pixie );
-        return 0;
-    }
-    
-    --spr_index;
+// Returns the header of the specified sound asset, or NULL if it is not a valid sound
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
-        internal_pixie_release( pixie );
-        return 0;
+static internal_pixie_sound_t const* internal_pixie_find_sound( internal_pixie_t* pixie, asset_t asset ) {
+    if( asset < 0 || asset >= pixie->assets.count ) {
+        return NULL;
     }
 
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.shadow = color;
-
-    internal_pixie_release( pixie );
-    return spr_index + 1;
+    int size = 0;
+    internal_pixie_sound_t const* sound = (internal_pixie_sound_t const*) internal_pixie_find_asset( pixie, asset, 
+        &size );
+    if( !sound || size < (int) sizeof( *sound ) || memcmp( sound->id, INTERNAL_PIXIE_SOUND_ID, sizeof( sound->id ) ) ||
+        ( sound->channels != 1 && sound->channels != 2 ) || 
+        sound->samples_per_block > INTERNAL_PIXIE_SOUND_ADPCM_BLOCK ) {
+        return NULL;
+    }
+    return sound;
 }
 
 
-int label_wrap( int spr_index, int wrap ) {
-    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
-    
-    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
-        internal_pixie_release( pixie );
-        return 0;
+void play_sound( int channel, asset_t asset ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( channel < 0 || channel >= INTERNAL_PIXIE_SOUND_CHANNELS ) {
+        return;
     }
-    
-    --spr_index;
 
-    if( pixie->user_thread.sprites.sprites[ spr_index ].type != TYPE_LABEL ) {
-        internal_pixie_release( pixie );
-        return 0;
+    internal_pixie_sound_t const* sound = internal_pixie_find_sound( pixie, asset );
+    if( !sound ) {
+        return;
     }
 
-    pixie->user_thread.sprites.sprites[ spr_index ].data.label.wrap = wrap;
+    // Sounds which are not cached yet are decoded without holding the sound mutex, as the audio thread needs it
+    thread_mutex_lock( &pixie->audio.sound_mutex );
+    i16 const* samples = internal_pixie_find_cached_sound( pixie, sound );
+    thread_mutex_unlock( &pixie->audio.sound_mutex );
+    i16* decoded = NULL;
+    if( !samples && (int)( sizeof( i16 ) * sound->length * sound->channels ) <= PIXIE_SOUND_CACHE_SIZE ) {
+        decoded = internal_pixie_decode_sound( sound );
+    }
 
-    internal_pixie_release( pixie );
-    return spr_index + 1;
+    thread_mutex_lock( &pixie->audio.sound_mutex );
+    pixie->audio.sounds[ channel ].sound = NULL;
+    pixie->audio.sounds[ channel ].samples = NULL;
+    // Looked up again, as the cache may have changed while the mutex was not held
+    samples = decoded ? internal_pixie_cache_sound( pixie, sound, decoded ) : 
+        internal_pixie_find_cached_sound( pixie, sound );
+    pixie->audio.sounds[ channel ].samples = samples;
+    pixie->audio.sounds[ channel ].sound = sound;
+    pixie->audio.sounds[ channel ].position = 0;
+    pixie->audio.sounds[ channel ].position_fraction = 0;
+    pixie->audio.sounds[ channel ].decoded_block = -1;
+    thread_mutex_unlock( &pixie->audio.sound_mutex );
 }
 
 
-void set_soundfont( asset_t asset ) {
+void stop_sound( int channel ) {
     internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
 
-    if( asset < 0 || asset >= pixie->assets.count ) {
+    if( channel < 0 || channel >= INTERNAL_PIXIE_SOUND_CHANNELS ) {
         return;
     }
 
-    thread_mutex_lock( &pixie->audio.song_mutex );
+    thread_mutex_lock( &pixie->audio.sound_mutex );
+    pixie->audio.sounds[ channel ].sound = NULL;
+    pixie->audio.sounds[ channel ].samples = NULL;
+    thread_mutex_unlock( &pixie->audio.sound_mutex );
+}
 
-    int soundfont_size = 0;
-    void const* soundfont = internal_pixie_find_asset( pixie, asset, &soundfont_size );
 
-    tsf_close( pixie->audio.sound_font );
-    pixie->audio.sound_font = tsf_load_memory( soundfont, soundfont_size );
-    tsf_channel_set_bank_preset( pixie->audio.sound_font, 9, 128, 0 );
-    tsf_set_output( pixie->audio.sound_font, TSF_STEREO_INTERLEAVED, 44100, 0.0f );
-    thread_mutex_unlock( &pixie->audio.song_mutex );
+// Changes the sound the stream reader is decoding. Samples already in the ring buffer are skipped by the audio
+// callback, as the new stream starts at the current write position.
+
+static void internal_pixie_start_stream( internal_pixie_t* pixie, internal_pixie_sound_t const* sound ) {
+    thread_mutex_lock( &pixie->audio.stream.mutex );
+    thread_atomic_int_inc( &pixie->audio.stream.generation );
+    pixie->audio.stream.channel.sound = sound;
+    pixie->audio.stream.channel.samples = NULL; // Streams are never cached, they're decoded one block at a time
+    pixie->audio.stream.channel.position = 0;
+    pixie->audio.stream.channel.position_fraction = 0;
+    pixie->audio.stream.channel.decoded_block = -1;
+    int write_pos = thread_atomic_int_load( &pixie->audio.stream.write_pos );
+    thread_atomic_int_store( &pixie->audio.stream.start_pos, write_pos );
+    thread_atomic_int_store( &pixie->audio.stream.end_pos, write_pos );
+    thread_atomic_int_store( &pixie->audio.stream.ended, sound ? 0 : 1 );
+    thread_atomic_int_store( &pixie->audio.stream.filled, 0 );
+    thread_atomic_int_inc( &pixie->audio.stream.generation );
+    thread_mutex_unlock( &pixie->audio.stream.mutex );
+    thread_signal_raise( &pixie->audio.stream.signal );
 }
 
 
-void play_song( asset_t asset ) {
+void play_stream( asset_t asset ) {
     internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
 
-    if( asset < 0 || asset >= pixie->assets.count ) {
+    internal_pixie_sound_t const* sound = internal_pixie_find_sound( pixie, asset );
+    if( !sound ) {
         return;
     }
 
-    thread_mutex_lock( &pixie->audio.song_mutex );
+    internal_pixie_start_stream( pixie, sound );
+}
 
-    memset( &pixie->audio.current_song, 0, sizeof( pixie->audio.current_song ) );
 
-    int mid_size = 0;
-    void const* mid_data = internal_pixie_find_asset( pixie, asset, &mid_size );
-    if( !mid_data ) {
-        thread_mutex_unlock( &pixie->audio.song_mutex );
-        return;
-    }
+void stop_stream( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
 
-    if( !mid_init_raw( &pixie->audio.current_song, mid_data, (size_t) mid_size ) ) {
-        thread_mutex_unlock( &pixie->audio.song_mutex );
-        return;
-    }
+    internal_pixie_start_stream( pixie, NULL );
+}
 
-    tsf_reset( pixie->audio.sound_font );
-    tsf_channel_set_bank_preset( pixie->audio.sound_font, 9, 128, 0 );
-    tsf_set_output( pixie->audio.sound_font, TSF_STEREO_INTERLEAVED, 44100, 0.0f );
-    mid_skip_leading_silence( &pixie->audio.current_song, pixie->audio.sound_font );
 
-    thread_mutex_unlock( &pixie->audio.song_mutex );
+float stream_position( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    u32 read_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.read_pos );
+    u32 start_pos = (u32) thread_atomic_int_load( &pixie->audio.stream.start_pos );
+    int played = (int)( read_pos - start_pos );
+    return played > 0 ? (float) played / (float) pixie->audio.sample_rate : 0.0f;
+}
+
+
+int stream_underruns( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    return thread_atomic_int_load( &pixie->audio.stream.underruns );
+}
+
+
+sound_stats_t sound_stats( void ) {
+    internal_pixie_t* pixie = internal_pixie_instance(); // Get `internal_pixie_t` instance from thread local storage
+
+    sound_stats_t stats;
+    stats.buffer_size = thread_atomic_int_load( &pixie->audio.timing.buffer_size );
+    stats.latency = ( stats.buffer_size * 1000.0f ) / (float) pixie->audio.sample_rate;
+    stats.buffer_changes = thread_atomic_int_load( &pixie->audio.timing.buffer_changes );
+    stats.callbacks = thread_atomic_int_load( &pixie->audio.timing.callbacks );
+    stats.callback_period = thread_atomic_int_load( &pixie->audio.timing.period_avg_us ) / 1000.0f;
+    stats.callback_period_max = thread_atomic_int_load( &pixie->audio.timing.period_max_us ) / 1000.0f;
+    stats.render_time = thread_atomic_int_load( &pixie->audio.timing.render_avg_us ) / 1000.0f;
+    stats.render_time_max = thread_atomic_int_load( &pixie->audio.timing.render_max_us ) / 1000.0f;
+    stats.underruns = thread_atomic_int_load( &pixie->audio.timing.underruns );
+    stats.overruns = thread_atomic_int_load( &pixie->audio.timing.overruns );
+    stats.stream_underruns = thread_atomic_int_load( &pixie->audio.stream.underruns );
+    stats.song_underruns = thread_atomic_int_load( &pixie->audio.song_underruns );
+    return stats;
 }
 
 
@@ -2847,6 +6145,7 @@ void sprite_move_x( int spr_index, move_t moves, ... ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2902,6 +6201,9 @@ void sprite_move_x( int spr_index, move_t moves, ... ) {
     va_end( args );
 
     pixie->user_thread.sprites.sprites[ spr_index ].move_x.count = count;
+    if( pixie->user_thread.sprites.sprites[ spr_index ].path ) {
+        pixie->user_thread.sprites.sprites[ spr_index ].path->active = 0; // Moving along an axis cancels any path
+    }
     pixie->user_thread.sprites.sprites[ spr_index ].move_x.index = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].move_x.time = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].move_x.start = pixie->user_thread.sprites.sprites[ spr_index ].x;
@@ -2915,6 +6217,7 @@ void sprite_move_y( int spr_index, move_t moves, ... ) {
 
     if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
         internal_pixie_release( pixie );
+        return;
     }
 
     --spr_index;
@@ -2969,6 +6272,9 @@ void sprite_move_y( int spr_index, move_t moves, ... ) {
     va_end( args );
 
     pixie->user_thread.sprites.sprites[ spr_index ].move_y.count = count;
+    if( pixie->user_thread.sprites.sprites[ spr_index ].path ) {
+        pixie->user_thread.sprites.sprites[ spr_index ].path->active = 0; // Moving along an axis cancels any path
+    }
     pixie->user_thread.sprites.sprites[ spr_index ].move_y.index = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].move_y.time = 0;
     pixie->user_thread.sprites.sprites[ spr_index ].move_y.start = pixie->user_thread.sprites.sprites[ spr_index ].y;
@@ -2977,6 +6283,159 @@ void sprite_move_y( int spr_index, move_t moves, ... ) {
 }
 
 
+// Integer square root, used for measuring path segments without depending on the math library
+
+static u32 internal_pixie_isqrt( u64 x ) {
+    u64 result = 0;
+    u64 bit = 1ull << 62;
+    while( bit > x ) bit >>= 2;
+    while( bit ) {
+        if( x >= result + bit ) {
+            x -= result + bit;
+            result = ( result >> 1 ) + bit;
+        } else {
+            result >>= 1;
+        }
+        bit >>= 2;
+    }
+    return (u32) result;
+}
+
+
+// Returns the point at `t` (0 to 1) along segment `segment` of the path, in pixels
+
+static void internal_pixie_path_point( path_type_t type, path_point_t const* points, int count, int loop, 
+    int segment, float t, float* x, float* y ) {
+    
+    if( type == PATH_BEZIER ) {
+        path_point_t const* p = points + segment * 3;
+        float u = 1.0f - t;
+        float a = u * u * u;
+        float b = 3.0f * u * u * t;
+        float c = 3.0f * u * t * t;
+        float d = t * t * t;
+        *x = a * p[ 0 ].x + b * p[ 1 ].x + c * p[ 2 ].x + d * p[ 3 ].x;
+        *y = a * p[ 0 ].y + b * p[ 1 ].y + c * p[ 2 ].y + d * p[ 3 ].y;
+        return;
+    }
+
+    // Polylines and Catmull-Rom splines go through every point. Looping paths wrap around to the first point, and 
+    // non-looping Catmull-Rom splines repeat the end points for the tangents of the first and last segments.
+    int i1 = segment;
+    int i2 = loop ? ( segment + 1 ) % count : segment + 1;
+    if( type == PATH_POLYLINE ) {
+        *x = points[ i1 ].x + ( points[ i2 ].x - points[ i1 ].x ) * t;
+        *y = points[ i1 ].y + ( points[ i2 ].y - points[ i1 ].y ) * t;
+        return;
+    }
+
+    int i0 = loop ? ( segment + count - 1 ) % count : ( segment > 0 ? segment - 1 : 0 );
+    int i3 = loop ? ( segment + 2 ) % count : ( segment + 2 < count ? segment + 2 : count - 1 );
+    float t2 = t * t;
+    float t3 = t2 * t;
+    float a = -0.5f * t3 + t2 - 0.5f * t;
+    float b = 1.5f * t3 - 2.5f * t2 + 1.0f;
+    float c = -1.5f * t3 + 2.0f * t2 + 0.5f * t;
+    float d = 0.5f * t3 - 0.5f * t2;
+    *x = a * points[ i0 ].x + b * points[ i1 ].x + c * points[ i2 ].x + d * points[ i3 ].x;
+    *y = a * points[ i0 ].y + b * points[ i1 ].y + c * points[ i2 ].y + d * points[ i3 ].y;
+}
+
+
+// Moves the sprite along a path through the specified points, over `duration` frames. The path can be a polyline, a 
+// Catmull-Rom spline passing through all the points, or a series of cubic Bezier segments, where each segment takes
+// two control points followed by an end point (so `count` should be a multiple of three, plus one). Looping polylines
+// and splines are closed back to the first point, while looping Bezier paths should end on their first point. The
+// speed along the path is constant, before `easing` is applied. Cancels any `sprite_move_x` and `sprite_move_y` moves, 
+// and a `count` less than 2 just stops the current path.
+
+void sprite_move_path( int spr_index, path_type_t type, path_point_t const* points, int count, int duration, 
+    easing_t easing, int loop ) {
+
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    free( sprite->path );
+    sprite->path = NULL;
+
+    int segments = 0;
+    int steps = INTERNAL_PIXIE_PATH_STEPS;
+    if( type == PATH_BEZIER ) {
+        segments = ( count - 1 ) / 3;
+    } else if( type == PATH_POLYLINE || type == PATH_CATMULL_ROM ) {
+        segments = loop ? count : count - 1;
+        steps = type == PATH_POLYLINE ? 1 : steps;
+    }
+    if( !points || count < 2 || segments < 1 ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    // Flatten the path and measure the distance to each sample. This is only done once, here on the user thread, so
+    // the app thread only needs to look up positions.
+    int samples_count = segments * steps + 1;
+    size_t path_size = sizeof( internal_pixie_sprite_path_t ) + sizeof( *sprite->path->samples ) * samples_count;
+    internal_pixie_sprite_path_t* path = (internal_pixie_sprite_path_t*) malloc( path_size );
+    path->samples = VOID_CAST( (void*)( path + 1 ) );
+    path->count = samples_count;
+    i64 distance = 0;
+    for( int i = 0; i < samples_count; ++i ) {
+        int segment = i < samples_count - 1 ? i / steps : segments - 1;
+        float t = i < samples_count - 1 ? (float)( i % steps ) / (float) steps : 1.0f;
+        float x = 0.0f;
+        float y = 0.0f;
+        internal_pixie_path_point( type, points, count, loop, segment, t, &x, &y );
+        path->samples[ i ].x = (i32)( x * 65536.0f );
+        path->samples[ i ].y = (i32)( y * 65536.0f );
+        if( i > 0 ) {
+            // Measured in 1/256 pixels, so the squared length fits comfortably in 64 bits
+            i64 dx = ( (i64) path->samples[ i ].x - path->samples[ i - 1 ].x ) >> 8;
+            i64 dy = ( (i64) path->samples[ i ].y - path->samples[ i - 1 ].y ) >> 8;
+            distance += ( (i64) internal_pixie_isqrt( (u64)( dx * dx + dy * dy ) ) ) << 8;
+        }
+        path->samples[ i ].distance = (i32)( distance < INT_MAX ? distance : INT_MAX );
+    }
+
+    path->active = 1;
+    path->duration = duration > 0 ? duration : 1;
+    path->time = 0;
+    path->loop = loop ? 1 : 0;
+    path->type = easing >= EASING_LINEAR && easing <= EASING_IN_OUT_CIRCLE ? 
+        (internal_pixie_move_type_t)( INTERNAL_PIXIE_MOVE_LINEAR + easing ) : INTERNAL_PIXIE_MOVE_LINEAR;
+    sprite->path = path;
+    sprite->move_x.count = 0;
+    sprite->move_y.count = 0;
+    sprite->x = ( path->samples[ 0 ].x + 32768 ) >> 16;
+    sprite->y = ( path->samples[ 0 ].y + 32768 ) >> 16;
+
+    internal_pixie_release( pixie );
+}
+
+
+// Returns 1 if the sprite is moving along a path, or has `sprite_move_x` or `sprite_move_y` moves in progress
+
+int sprite_moving( int spr_index ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    if( spr_index < 1 || spr_index > pixie->user_thread.sprites.sprite_count ) {
+        internal_pixie_release( pixie );
+        return 0;
+    }
+
+    --spr_index;
+    internal_pixie_sprite_t* sprite = &pixie->user_thread.sprites.sprites[ spr_index ];
+    int moving = ( sprite->path && sprite->path->active ) || sprite->move_x.count > 0 || sprite->move_y.count > 0;
+    internal_pixie_release( pixie );
+    return moving;
+}
+
+
 void text( int x, int y, char const* str, int color, asset_t font
 	/*, text_align align, int wrap_width, int hspacing, int vspacing, int limit, bool bold, bool italic, 
     bool underline */ ) {
@@ -2991,12 +6450,24 @@ void text( int x, int y, char const* str, int color, asset_t font
 	pixelfont_bounds.width = 0;
 	pixelfont_bounds.height = 0;
 
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+
     pixelfont_t* pixelfont = (pixelfont_t*) internal_pixie_find_asset( pixie, font, NULL );
-	pixelfont_blit_u8( pixelfont, x, y, str, (u8) color, 
-        pixie->user_thread.screen.pixels, pixie->user_thread.screen.screen_width, pixie->user_thread.screen.screen_height,
+	pixelfont_blit_u8( pixelfont, x, y, str, (u8) color, pixels, width, height,
         pixelfont_align, -1, 0, 0, -1, PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, 
         &pixelfont_bounds );
 
+    // On a surface, the text is drawn into the mask as well, to make it opaque
+    if( !mask ) {
+        internal_pixie_damage_screen( pixie, y, pixelfont_bounds.height + pixelfont->height );
+    } else {
+	    pixelfont_blit_u8( pixelfont, x, y, str, 255, mask, width, height,
+            pixelfont_align, -1, 0, 0, -1, PIXELFONT_BOLD_OFF, PIXELFONT_ITALIC_OFF, PIXELFONT_UNDERLINE_OFF, NULL );
+    }
+
 		//pixelfont_align, wrap_width, hspacing, vspacing, limit, bold ? PIXELFONT_BOLD_ON : PIXELFONT_BOLD_OFF, 
 		//italic ? PIXELFONT_ITALIC_ON : PIXELFONT_ITALIC_OFF, 
         // underline ? PIXELFONT_UNDERLINE_ON : PIXELFONT_UNDERLINE_OFF, 
@@ -3013,6 +6484,320 @@ void text( int x, int y, char const* str, int color, asset_t font
 }
 
 
+// Fills a rectangle of the draw target, clipped once up front so each row is a single memset (and one more for the 
+// mask, when drawing to a surface)
+
+static void internal_pixie_fill_rect( u8* pixels, u8* mask, int target_width, int target_height, int x, int y, 
+    int width, int height, u8 color ) {
+
+    int x_end = x + width > target_width ? target_width : x + width;
+    int y_end = y + height > target_height ? target_height : y + height;
+    if( x < 0 ) x = 0;
+    if( y < 0 ) y = 0;
+    if( x >= x_end || y >= y_end ) return;
+
+    for( int iy = y; iy < y_end; ++iy ) {
+        memset( pixels + x + iy * target_width, color, (size_t)( x_end - x ) );
+        if( mask ) memset( mask + x + iy * target_width, 255, (size_t)( x_end - x ) );
+    }
+}
+
+
+// Fills the whole draw target with a single color
+
+void cls( int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+    memset( pixels, (u8) color, sizeof( u8 ) * width * height );
+    if( mask ) memset( mask, 255, sizeof( u8 ) * width * height );
+    if( !mask ) internal_pixie_damage_screen( pixie, 0, height );
+
+    internal_pixie_release( pixie );
+}
+
+
+void fill_rect( int x, int y, int width, int height, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int target_width = 0;
+    int target_height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &target_width, &target_height );
+    internal_pixie_fill_rect( pixels, mask, target_width, target_height, x, y, width, height, (u8) color );
+    if( !mask ) internal_pixie_damage_screen( pixie, y, height );
+
+    internal_pixie_release( pixie );
+}
+
+
+void hline( int x, int y, int length, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+    internal_pixie_fill_rect( pixels, mask, width, height, x, y, length, 1, (u8) color );
+    if( !mask && length > 0 ) internal_pixie_damage_screen( pixie, y, 1 );
+
+    internal_pixie_release( pixie );
+}
+
+
+void vline( int x, int y, int length, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+    internal_pixie_fill_rect( pixels, mask, width, height, x, y, 1, length, (u8) color );
+    if( !mask ) internal_pixie_damage_screen( pixie, y, length );
+
+    internal_pixie_release( pixie );
+}
+
+
+// Position along the minor axis of a line, `step` pixels along the major axis from its start. This is the same point
+// Bresenham's algorithm arrives at, but can be calculated for any step, so clipped lines can start part way in.
+
+static int internal_pixie_line_minor( int step, int major_delta, int minor_delta ) {
+    return (int)( ( 2 * (i64) step * minor_delta + major_delta ) / ( 2 * (i64) major_delta ) );
+}
+
+
+// Draws a line using Bresenham's algorithm. It is clipped once, by finding the range of steps which is inside the draw 
+// target (the minor axis position only ever moves in one direction, so the range can be binary searched for), and the
+// pixels in that range are drawn without any further checks.
+
+void line( int x1, int y1, int x2, int y2, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+    if( !mask ) internal_pixie_damage_screen( pixie, y1 < y2 ? y1 : y2, ( y1 < y2 ? y2 - y1 : y1 - y2 ) + 1 );
+
+    // Set up in terms of major and minor axis, so both the mostly-horizontal and mostly-vertical cases work the same
+    int dx = x2 > x1 ? x2 - x1 : x1 - x2;
+    int dy = y2 > y1 ? y2 - y1 : y1 - y2;
+    int major_start = dx >= dy ? x1 : y1;
+    int minor_start = dx >= dy ? y1 : x1;
+    int major_delta = dx >= dy ? dx : dy;
+    int minor_delta = dx >= dy ? dy : dx;
+    int major_dir = ( dx >= dy ? x2 >= x1 : y2 >= y1 ) ? 1 : -1;
+    int minor_dir = ( dx >= dy ? y2 >= y1 : x2 >= x1 ) ? 1 : -1;
+    int major_size = dx >= dy ? width : height;
+    int minor_size = dx >= dy ? height : width;
+    int major_stride = dx >= dy ? major_dir : major_dir * width;
+    int minor_stride = dx >= dy ? minor_dir * width : minor_dir;
+
+    if( major_delta == 0 ) {
+        if( x1 >= 0 && y1 >= 0 && x1 < width && y1 < height ) {
+            pixels[ x1 + y1 * width ] = (u8) color;
+            if( mask ) mask[ x1 + y1 * width ] = 255;
+        }
+        internal_pixie_release( pixie );
+        return;
+    }
+
+    // Steps which are inside the target along the major axis
+    int first = major_dir > 0 ? -major_start : major_start - ( major_size - 1 );
+    int last = major_dir > 0 ? major_size - 1 - major_start : major_start;
+    if( first < 0 ) first = 0;
+    if( last > major_delta ) last = major_delta;
+
+    // Narrow it down to the steps which are inside along the minor axis as well
+    int low = first;
+    int high = last + 1;
+    while( low < high ) { // First step which is not before the target
+        int mid = low + ( high - low ) / 2;
+        int minor = minor_start + minor_dir * internal_pixie_line_minor( mid, major_delta, minor_delta );
+        if( minor_dir > 0 ? minor >= 0 : minor < minor_size ) high = mid; else low = mid + 1;
+    }
+    first = low;
+    high = last + 1;
+    while( low < high ) { // First step which is past the target
+        int mid = low + ( high - low ) / 2;
+        int minor = minor_start + minor_dir * internal_pixie_line_minor( mid, major_delta, minor_delta );
+        if( minor_dir > 0 ? minor >= minor_size : minor < 0 ) high = mid; else low = mid + 1;
+    }
+    last = low - 1;
+    
+    if( first <= last ) {
+        int minor_offset = internal_pixie_line_minor( first, major_delta, minor_delta );
+        int error = (int)( ( 2 * (i64) first * minor_delta + major_delta ) % ( 2 * (i64) major_delta ) );
+        int major = major_start + major_dir * first;
+        int minor = minor_start + minor_dir * minor_offset;
+        int offset = dx >= dy ? major + minor * width : minor + major * width;
+        for( int i = first; i <= last; ++i ) {
+            pixels[ offset ] = (u8) color;
+            if( mask ) mask[ offset ] = 255;
+            offset += major_stride;
+            error += 2 * minor_delta;
+            if( error >= 2 * major_delta ) {
+                error -= 2 * major_delta;
+                offset += minor_stride;
+            }
+        }
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
+// Plots the two points of a circle outline which are `offset` pixels left and right of the center on row `y`. Used for
+// circles which are clipped, so that each row is only checked once.
+
+static void internal_pixie_circle_points( u8* pixels, u8* mask, int width, int height, int x, int y, int offset, 
+    u8 color ) {
+
+    if( y < 0 || y >= height ) return;
+    u8* row = pixels + y * width;
+    u8* mask_row = mask ? mask + y * width : NULL;
+    if( x - offset >= 0 && x - offset < width ) {
+        row[ x - offset ] = color;
+        if( mask_row ) mask_row[ x - offset ] = 255;
+    }
+    if( x + offset >= 0 && x + offset < width ) {
+        row[ x + offset ] = color;
+        if( mask_row ) mask_row[ x + offset ] = 255;
+    }
+}
+
+
+// Draws the outline of a circle using the midpoint algorithm. Circles which are completely inside the screen are drawn 
+// straight from the center, without checking each pixel, and clipped ones check each row and column only once.
+
+void circle( int x, int y, int radius, int color ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* mask = NULL;
+    int width = 0;
+    int height = 0;
+    u8* pixels = internal_pixie_draw_target( pixie, &mask, &width, &height );
+
+    if( radius < 0 || x + radius < 0 || y + radius < 0 || x - radius >= width || y - radius >= height ) {
+        internal_pixie_release( pixie );
+        return;
+    }
+    if( !mask ) internal_pixie_damage_screen( pixie, y - radius, radius * 2 + 1 );
+
+    int inside = x - radius >= 0 && y - radius >= 0 && x + radius < width && y + radius < height;
+    int px = radius;
+    int py = 0;
+    int error = 1 - radius;
+    while( px >= py ) {
+        if( inside && !mask ) {
+            u8* center = pixels + x + y * width;
+            center[ px + py * width ] = (u8) color;
+            center[ -px + py * width ] = (u8) color;
+            center[ px - py * width ] = (u8) color;
+            center[ -px - py * width ] = (u8) color;
+            center[ py + px * width ] = (u8) color;
+            center[ -py + px * width ] = (u8) color;
+            center[ py - px * width ] = (u8) color;
+            center[ -py - px * width ] = (u8) color;
+        } else {
+            internal_pixie_circle_points( pixels, mask, width, height, x, y + py, px, (u8) color );
+            internal_pixie_circle_points( pixels, mask, width, height, x, y - py, px, (u8) color );
+            internal_pixie_circle_points( pixels, mask, width, height, x, y + px, py, (u8) color );
+            internal_pixie_circle_points( pixels, mask, width, height, x, y - px, py, (u8) color );
+        }
+        ++py;
+        if( error < 0 ) {
+            error += 2 * py + 1;
+        } else {
+            --px;
+            error += 2 * ( py - px ) + 1;
+        }
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
+// Copies a bitmap of palette indices to the draw target, one memcpy per row after clipping
+
+void blit_raw( int x, int y, u8 const* pixels, int width, int height ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* target_mask = NULL;
+    int target_width = 0;
+    int target_height = 0;
+    u8* target = internal_pixie_draw_target( pixie, &target_mask, &target_width, &target_height );
+    if( !target_mask ) internal_pixie_damage_screen( pixie, y, height );
+
+    int x_start = x < 0 ? -x : 0;
+    int y_start = y < 0 ? -y : 0;
+    int x_end = x + width > target_width ? target_width - x : width;
+    int y_end = y + height > target_height ? target_height - y : height;
+    for( int iy = y_start; iy < y_end && x_start < x_end; ++iy ) {
+        memcpy( target + x + x_start + ( y + iy ) * target_width, pixels + x_start + iy * width, 
+            (size_t)( x_end - x_start ) );
+        if( target_mask ) memset( target_mask + x + x_start + ( y + iy ) * target_width, 255, 
+            (size_t)( x_end - x_start ) );
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
+// Copies the pixels of a bitmap which have a non-zero mask value to the draw target. The mask is tested eight bytes at
+// a time, so fully transparent and fully opaque stretches are skipped or copied whole.
+
+void blit_masked( int x, int y, u8 const* pixels, u8 const* mask, int width, int height ) {
+    internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
+
+    u8* target_mask = NULL;
+    int target_width = 0;
+    int target_height = 0;
+    u8* target = internal_pixie_draw_target( pixie, &target_mask, &target_width, &target_height );
+    if( !target_mask ) internal_pixie_damage_screen( pixie, y, height );
+
+    int x_start = x < 0 ? -x : 0;
+    int y_start = y < 0 ? -y : 0;
+    int x_end = x + width > target_width ? target_width - x : width;
+    int y_end = y + height > target_height ? target_height - y : height;
+    for( int iy = y_start; iy < y_end; ++iy ) {
+        u8 const* in = pixels + iy * width;
+        u8 const* in_mask = mask + iy * width;
+        u8* out = target + x + ( y + iy ) * target_width;
+        u8* out_mask = target_mask ? target_mask + x + ( y + iy ) * target_width : NULL;
+        int ix = x_start;
+        for( ; ix + 8 <= x_end; ix += 8 ) {
+            u64 bits;
+            memcpy( &bits, in_mask + ix, sizeof( bits ) );
+            if( bits == 0 ) continue;
+            if( bits == ~0ull ) {
+                memcpy( out + ix, in + ix, 8 );
+                if( out_mask ) memset( out_mask + ix, 255, 8 );
+                continue;
+            }
+            for( int i = ix; i < ix + 8; ++i ) {
+                if( in_mask[ i ] ) {
+                    out[ i ] = in[ i ];
+                    if( out_mask ) out_mask[ i ] = 255;
+                }
+            }
+        }
+        for( ; ix < x_end; ++ix ) {
+            if( in_mask[ ix ] ) {
+                out[ ix ] = in[ ix ];
+                if( out_mask ) out_mask[ ix ] = 255;
+            }
+        }
+    }
+
+    internal_pixie_release( pixie );
+}
+
+
 int key_is_down( keys_t key ) {
     internal_pixie_t* pixie = internal_pixie_acquire(); // Get `internal_pixie_t` instance from thread local storage
 
@@ -3302,6 +7087,9 @@ u32 hash_string( string str ) {
 ---------------------------------
 */
       
+#define ADPCM_IMPLEMENTATION
+#include "adpcm.h"
+
 #define APP_IMPLEMENTATION
 #ifdef _WIN32
     #ifndef PIXIE_WIN_SDL
@@ -44,9 +44,14 @@ void free_text_file( char* text );
 void* build_palette( const char* filenames[], int count, int* out_size );
 void* build_sprite( const char* filenames[], int count, int* out_size );
 void* build_song( char const* filenames[], int count, int* out_size );
+void* build_song_rendered( char const* filenames[], int count, int* out_size );
+void* build_song_rendered_adpcm( char const* filenames[], int count, int* out_size );
+void* build_soundfont( char const* filenames[], int count, int* out_size );
+void* build_sound( char const* filenames[], int count, int* out_size );
 void* build_text( char const* filenames[], int count, int* out_size );
 void* build_binary( char const* filenames[], int count, int* out_size );
 void* build_font( char const* filenames[], int count, int* out_size );
+void* build_tileset( char const* filenames[], int count, int* out_size );
 
 #endif /* pixie_build_h */
 
@@ -123,6 +128,8 @@ struct item_t {
     int id;
     char filename[ 256 ];
     char type[ 64 ];
+    int params[ 4 ]; // Optional integer arguments following the filename, like the tile size for ASSET_TILESET
+    int params_count;
 };
 
 static struct item_t* internal_pixie_read_asset_definitions( char const* asset_definitions_file, int* count, 
@@ -204,7 +211,7 @@ static struct item_t* internal_pixie_read_asset_definitions( char const* asset_d
         }
         ptr += strlen( "ASSET_" );
         char const* asset_type_start = ptr;
-        while( ptr < end && isalnum( *ptr ) ) ++ptr;
+        while( ptr < end && ( isalnum( *ptr ) || *ptr == '_' ) ) ++ptr;
         while( ptr < end && *ptr <= ' ' ) ++ptr;
         if( *ptr != '(' ) {
             printf( "Asset definition file '%s': expected '(' after ASSET_...\n", asset_definitions_file );
@@ -248,7 +255,26 @@ static struct item_t* internal_pixie_read_asset_definitions( char const* asset_d
         char const* asset_filename_end = ptr;
         ++ptr;
 
+        int params[ 4 ] = { 0 };
+        int params_count = 0;
         while( ptr < end && *ptr <= ' ' ) ++ptr;
+        while( ptr < end && *ptr == ',' ) {
+            ++ptr;
+            while( ptr < end && *ptr <= ' ' ) ++ptr;
+            char* param_end = NULL;
+            long param = strtol( ptr, &param_end, 0 );
+            if( param_end == ptr || params_count >= (int)( sizeof( params ) / sizeof( *params ) ) ) {
+                printf( "Asset definition file '%s': expected at most 4 integer arguments after asset filename\n", 
+                    asset_definitions_file );
+                free( items );
+                free( file );
+                return NULL;;
+            }
+            params[ params_count++ ] = (int) param;
+            ptr = param_end;
+            while( ptr < end && *ptr <= ' ' ) ++ptr;
+        }
+
         if( *ptr != ')' ) {
             printf( "Asset definition file '%s': expected ')' at the end of ASSET definition\n", 
                 asset_definitions_file );
@@ -279,6 +305,8 @@ static struct item_t* internal_pixie_read_asset_definitions( char const* asset_d
         items[ index ].id = index;
         strcpy( items[ index ].filename, asset_filename );
         strcpy( items[ index ].type, asset_type );
+        memcpy( items[ index ].params, params, sizeof( params ) );
+        items[ index ].params_count = params_count;
         ++index;
     }
     while( ptr < end && *ptr <= ' ' ) ++ptr;
@@ -298,6 +326,10 @@ u32 internal_pixie_palette_for_build_sprite[ 256 ]; // TODO: handle this properl
 int internal_pixie_palette_for_build_sprite_count = 256;
 paldither_palette_t* internal_pixie_paldither_palette_for_build_sprite = NULL;
 
+// The integer arguments given after the filename in the ASSET_... definition of the asset currently being built
+int internal_pixie_params_for_build[ 4 ];
+int internal_pixie_params_count_for_build = 0;
+
 
 void* build_palette( char const* filenames[], int count, int* out_size ) {
     if( count != 1 ) return 0;
@@ -342,12 +374,55 @@ void* build_palette( char const* filenames[], int count, int* out_size ) {
 }
 
 
+// Finds the largest rectangle of a mask which is fully opaque. Each row is treated as a histogram of how many opaque
+// pixels are stacked up above it, and the largest rectangle under that histogram is found using a stack of the bars
+// which are still rising, so the whole search is linear in the number of pixels.
+
+static void internal_pixie_largest_opaque_rect( u8 const* mask, int width, int height, int* out_x, int* out_y, 
+    int* out_width, int* out_height ) {
+
+    *out_x = 0;
+    *out_y = 0;
+    *out_width = 0;
+    *out_height = 0;
+    int best_area = 0;
+    int* heights = (int*) malloc( sizeof( int ) * ( width + 1 ) ); // Last entry is always zero, to empty the stack
+    int* stack = (int*) malloc( sizeof( int ) * ( width + 1 ) );
+    memset( heights, 0, sizeof( int ) * ( width + 1 ) );
+    for( int y = 0; y < height; ++y ) {
+        for( int x = 0; x < width; ++x ) {
+            heights[ x ] = mask[ x + y * width ] ? heights[ x ] + 1 : 0;
+        }
+        int top = 0;
+        for( int x = 0; x <= width; ++x ) {
+            while( top > 0 && heights[ stack[ top - 1 ] ] >= heights[ x ] ) {
+                int bar_height = heights[ stack[ --top ] ];
+                int left = top > 0 ? stack[ top - 1 ] + 1 : 0;
+                if( bar_height * ( x - left ) > best_area ) {
+                    best_area = bar_height * ( x - left );
+                    *out_x = left;
+                    *out_y = y - bar_height + 1;
+                    *out_width = x - left;
+                    *out_height = bar_height;
+                }
+            }
+            stack[ top++ ] = x;
+        }
+    }
+    free( stack );
+    free( heights );
+}
+
+
+// Builds a sprite asset from one or more images, one for each cel. Along with the RLE data of each cel, the bounding
+// box of its visible pixels and its largest fully opaque rectangle are stored, for culling at render time.
+
 void* build_sprite( char const* filenames[], int count, int* out_size ) {
     int capacity = 16 * 1024;
     u8* data = (u8*) malloc( (size_t) capacity );
     *(int*) data = count;
-    int* offsets = (int*)( data + sizeof( int ) );
-    int pos = (int)( sizeof( int ) + sizeof( int ) * count );
+    internal_pixie_sprite_cel_t* cels = (internal_pixie_sprite_cel_t*)( data + sizeof( int ) );
+    int pos = (int)( sizeof( int ) + sizeof( internal_pixie_sprite_cel_t ) * count );
     for( int j = 0; j < count; ++j ) {
         int w, h, c;
         stbi_uc* img = stbi_load( filenames[ j ], &w, &h, &c, 4 );
@@ -375,6 +450,9 @@ void* build_sprite( char const* filenames[], int count, int* out_size ) {
 
         palrle_data_t* rle = palrle_encode_mask( pixels, mask, w, h, internal_pixie_palette_for_build_sprite, 256, 
             NULL );
+        internal_pixie_sprite_cel_t cel;
+        internal_pixie_largest_opaque_rect( mask, w, h, &cel.opaque_x, &cel.opaque_y, &cel.opaque_width, 
+            &cel.opaque_height );
         free( mask );
         free( pixels );
     
@@ -385,9 +463,16 @@ void* build_sprite( char const* filenames[], int count, int* out_size ) {
                 capacity = pos + (int) rle->size;
             }
             data = (u8*) realloc( data, (size_t) capacity );
-            offsets = (int*)( data + sizeof( int ) );
+            cels = (internal_pixie_sprite_cel_t*)( data + sizeof( int ) );
         }
-        offsets[ j ] = pos;
+        cel.offset = pos;
+        cel.x = rle->xoffset;
+        cel.y = rle->yoffset;
+        cel.width = rle->hpitch;
+        cel.height = rle->vpitch;
+        cel.cel_width = w;
+        cel.cel_height = h;
+        cels[ j ] = cel;
         memcpy( data + pos, rle, (size_t) rle->size );
         pos += (int) rle->size;
         palrle_free( rle, NULL );
@@ -397,6 +482,135 @@ void* build_sprite( char const* filenames[], int count, int* out_size ) {
 }
 
 
+// Slices an image into tiles of the size given in the asset definition, as in `ASSET_TILESET( id, "map.png", 16, 16 )`,
+// and stores each distinct tile only once, together with a map of which tile goes in which cell. Cells which are fully
+// transparent are left empty in the map, rather than referencing a tile. Tiles are looked up by the hash of their
+// contents, in an open addressing table with at least twice as many slots as there are cells.
+
+void* build_tileset( char const* filenames[], int count, int* out_size ) {
+    if( count != 1 ) return NULL;
+
+    int tile_width = internal_pixie_params_count_for_build > 0 ? internal_pixie_params_for_build[ 0 ] : 16;
+    int tile_height = internal_pixie_params_count_for_build > 1 ? internal_pixie_params_for_build[ 1 ] : tile_width;
+    if( tile_width < 1 || tile_height < 1 ) return NULL;
+
+    int w, h, c;
+    stbi_uc* img = stbi_load( filenames[ 0 ], &w, &h, &c, 4 );
+    if( !img ) return NULL;
+
+    if( !internal_pixie_paldither_palette_for_build_sprite ) {
+        internal_pixie_paldither_palette_for_build_sprite = paldither_palette_create( 
+            internal_pixie_palette_for_build_sprite, internal_pixie_palette_for_build_sprite_count, NULL, NULL );
+    }
+
+    u8* pixels = (u8*) malloc( sizeof( u8 ) * w * h );
+    memset( pixels, 0, sizeof( u8 ) * w * h ); 
+    paldither_palettize( (PALDITHER_U32*) img, w, h, internal_pixie_paldither_palette_for_build_sprite, 
+        PALDITHER_TYPE_DEFAULT, pixels );
+
+    u8* mask = (u8*) malloc( (size_t) w * h );
+    for( int i = 0; i < w * h; ++i ) mask[ i ] = (u8)(( (PALETTIZE_U32*) img )[ i ] >> 24 );
+    stbi_image_free( img );     
+
+    // Every tile might be unique, so allocate for the worst case, with each tile stored as pixels followed by mask
+    int map_width = ( w + tile_width - 1 ) / tile_width;
+    int map_height = ( h + tile_height - 1 ) / tile_height;
+    int cell_count = map_width * map_height;
+    int tile_size = tile_width * tile_height;
+    u16* map = (u16*) malloc( sizeof( u16 ) * cell_count );
+    u8* opaque = (u8*) malloc( (size_t) cell_count );
+    u32* hashes = (u32*) malloc( sizeof( u32 ) * cell_count );
+    u8* tiles = (u8*) malloc( (size_t) cell_count * tile_size * 2 );
+    int tile_count = 0;
+    u32 slot_count = 1;
+    while( slot_count < (u32) cell_count * 2 ) slot_count *= 2;
+    int* slots = (int*) malloc( sizeof( int ) * slot_count ); // Tile index + 1 for each slot, 0 for unused slots
+    memset( slots, 0, sizeof( int ) * slot_count );
+
+    for( int ty = 0; ty < map_height; ++ty ) {
+        for( int tx = 0; tx < map_width; ++tx ) {
+            // Cut out the tile, making pixels outside the image, or under a transparent mask, all the same
+            u8* tile = tiles + tile_count * tile_size * 2;
+            int visible = 0;
+            for( int y = 0; y < tile_height; ++y ) {
+                for( int x = 0; x < tile_width; ++x ) {
+                    int ix = tx * tile_width + x;
+                    int iy = ty * tile_height + y;
+                    int inside = ix < w && iy < h && mask[ ix + iy * w ];
+                    tile[ x + y * tile_width ] = inside ? pixels[ ix + iy * w ] : 0;
+                    tile[ tile_size + x + y * tile_width ] = inside ? 255 : 0;
+                    visible += inside;
+                }
+            }
+            if( visible == 0 ) {
+                map[ tx + ty * map_width ] = INTERNAL_PIXIE_TILE_EMPTY;
+                continue;
+            }
+
+            u32 hash = crc32( tile, (size_t) tile_size * 2, 0 );
+            u32 slot = hash & ( slot_count - 1 );
+            int found = -1;
+            while( slots[ slot ] ) {
+                int i = slots[ slot ] - 1;
+                if( hashes[ i ] == hash && memcmp( tiles + i * tile_size * 2, tile, (size_t) tile_size * 2 ) == 0 ) {
+                    found = i;
+                    break;
+                }
+                slot = ( slot + 1 ) & ( slot_count - 1 );
+            }
+            if( found < 0 ) {
+                if( tile_count >= INTERNAL_PIXIE_TILE_EMPTY ) {
+                    printf( "\nTileset '%s' has too many unique tiles\n", filenames[ 0 ] );
+                    free( slots );
+                    free( tiles );
+                    free( hashes );
+                    free( opaque );
+                    free( map );
+                    free( mask );
+                    free( pixels );
+                    return NULL;
+                }
+                found = tile_count++;
+                hashes[ found ] = hash;
+                slots[ slot ] = found + 1;
+                opaque[ found ] = (u8)( visible == tile_size );
+            }
+            map[ tx + ty * map_width ] = (u16) found;
+        }
+    }
+    free( slots );
+    free( hashes );
+    free( mask );
+    free( pixels );
+
+    internal_pixie_tileset_t header;
+    memcpy( header.id, INTERNAL_PIXIE_TILESET_ID, sizeof( header.id ) );
+    header.tile_width = tile_width;
+    header.tile_height = tile_height;
+    header.tile_count = tile_count;
+    header.map_width = map_width;
+    header.map_height = map_height;
+
+    size_t size = sizeof( header ) + sizeof( u16 ) * cell_count + (size_t) tile_count + 
+        (size_t) tile_count * tile_size * 2;
+    u8* data = (u8*) malloc( size );
+    u8* out = data;
+    memcpy( out, &header, sizeof( header ) );
+    out += sizeof( header );
+    memcpy( out, map, sizeof( u16 ) * cell_count );
+    out += sizeof( u16 ) * cell_count;
+    memcpy( out, opaque, (size_t) tile_count );
+    out += tile_count;
+    memcpy( out, tiles, (size_t) tile_count * tile_size * 2 );
+    free( tiles );
+    free( opaque );
+    free( map );
+
+    *out_size = (int) size;
+    return data;
+}
+
+
 void* build_song( char const* filenames[], int count, int* out_size ) {
     if( count != 1 ) return 0;
 
@@ -415,6 +629,226 @@ void* build_song( char const* filenames[], int count, int* out_size ) {
 }
 
 
+char internal_pixie_soundfont_for_build_song[ 256 ] = ""; // Filename of most recent SOUNDFONT asset, if any
+u32 internal_pixie_soundfont_hash_for_build_song = 0;
+
+
+// Renders a midi file, using the most recent SOUNDFONT asset (or the default soundfont if there is none), to a 
+// `internal_pixie_song_pcm_t` header followed by the sample data. The song is started from the first note, just like
+// `play_song` does for midi songs, and if the midi file contains a controller 111 event (a common convention for 
+// marking loop points) the loop will restart from there instead of from the beginning.
+
+static void* internal_pixie_build_song_rendered( char const* filenames[], int count, int* out_size, 
+    internal_pixie_song_pcm_encoding_t encoding ) {
+
+    if( count != 1 ) return 0;
+
+    int in_size = 0;
+    void* in_data = load_binary_file( filenames[ 0 ], &in_size );
+    if( !in_data ) return NULL;
+
+    mid_t* mid = mid_create( in_data, (size_t) in_size, NULL ); 
+    free_binary_file( in_data );
+    if( !mid ) return NULL;
+
+    int soundfont_size = 0;
+    void* soundfont_file = NULL;
+    void const* soundfont = NULL;
+    if( *internal_pixie_soundfont_for_build_song ) {
+        soundfont_file = load_binary_file( internal_pixie_soundfont_for_build_song, &soundfont_size );
+        soundfont = soundfont_file;
+    } else {
+        soundfont = default_soundfont( &soundfont_size );
+    }
+    tsf* sound_font = soundfont ? tsf_load_memory( soundfont, soundfont_size ) : NULL;
+    if( soundfont_file ) free_binary_file( soundfont_file );
+    if( !sound_font ) {
+        mid_destroy( mid );
+        return NULL;
+    }
+    int const sample_rate = mid->song.sample_rate;
+    tsf_channel_set_bank_preset( sound_font, 9, 128, 0 );
+    tsf_set_output( sound_font, TSF_STEREO_INTERLEAVED, sample_rate, 0.0f );
+
+    u64 loop_pos = 0;
+    size_t data_pos = 0;
+    mid_event_t event = { 0 };
+    for( int i = 0; i < mid->song.event_count; ++i ) {
+        data_pos = mid_read_event( &mid->song, data_pos, event.sample_pos, &event );
+        if( !data_pos ) break;
+        if( event.type == TML_CONTROL_CHANGE && event.data.control_change.control == 111 ) {
+            loop_pos = event.sample_pos;
+            break;
+        }
+    }
+
+    mid_skip_leading_silence( mid, sound_font );
+    int start = (int) mid->playback_sample_pos;
+    int length = (int) mid->song.length - start;
+    int loop_start = (int) loop_pos - start;
+    length = length < 0 ? 0 : length;
+    loop_start = loop_start < 0 ? 0 : loop_start;
+
+    // Round up to whole ADPCM blocks, so the encoder never reads outside of the buffer
+    int const samples_per_block = INTERNAL_PIXIE_SONG_PCM_ADPCM_BLOCK;
+    int block_count = ( length + samples_per_block - 1 ) / samples_per_block;
+    i16* samples = (i16*) malloc( sizeof( i16 ) * 2 * ( (size_t) block_count * samples_per_block + 1 ) );
+    mid_render_short( mid, samples, length, sound_font );
+    tsf_close( sound_font );
+    mid_destroy( mid );
+
+    internal_pixie_song_pcm_t header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.id, INTERNAL_PIXIE_SONG_PCM_ID, sizeof( header.id ) );
+    header.sample_rate = sample_rate;
+    header.encoding = encoding;
+    header.length = length;
+    header.loop_start = loop_start;
+    header.loop_end = length;
+    header.start = start;
+
+    size_t data_size = sizeof( i16 ) * 2 * (size_t) length;
+    if( encoding == INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM ) {
+        header.samples_per_block = samples_per_block;
+        header.block_size = adpcm_block_size( 2, samples_per_block );
+        data_size = (size_t) header.block_size * block_count;
+    }
+
+    u8* out_data = (u8*) malloc( sizeof( header ) + data_size );
+    memcpy( out_data, &header, sizeof( header ) );
+    if( encoding == INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM ) {
+        int step_indices[ 2 ] = { 0, 0 };
+        for( int i = 0; i < block_count; ++i ) {
+            int block_samples = length - i * samples_per_block;
+            block_samples = block_samples > samples_per_block ? samples_per_block : block_samples;
+            adpcm_encode_block( samples + i * samples_per_block * 2, block_samples, 2, samples_per_block, 
+                step_indices, out_data + sizeof( header ) + i * header.block_size );
+        }
+    } else {
+        memcpy( out_data + sizeof( header ), samples, data_size );
+    }
+    free( samples );
+
+    *out_size = (int)( sizeof( header ) + data_size );
+    return out_data;
+}
+
+
+void* build_song_rendered( char const* filenames[], int count, int* out_size ) {
+    return internal_pixie_build_song_rendered( filenames, count, out_size, INTERNAL_PIXIE_SONG_PCM_ENCODING_PCM16 );
+}
+
+
+void* build_song_rendered_adpcm( char const* filenames[], int count, int* out_size ) {
+    return internal_pixie_build_song_rendered( filenames, count, out_size, INTERNAL_PIXIE_SONG_PCM_ENCODING_ADPCM );
+}
+
+
+// Parses an .sf2 file and saves it as a tsf image, which `set_soundfont` can use straight from the bundle without any 
+// parsing or sample conversion
+
+void* build_soundfont( char const* filenames[], int count, int* out_size ) {
+    if( count != 1 ) return 0;
+
+    int in_size = 0;
+    void* in_data = load_binary_file( filenames[ 0 ], &in_size );
+    if( !in_data ) return NULL;
+
+    tsf* sound_font = tsf_load_memory( in_data, in_size );
+    free_binary_file( in_data );
+    if( !sound_font ) return NULL;
+
+    int size = tsf_save_image( sound_font, NULL, 0 );
+    void* out_data = malloc( (size_t) size );
+    tsf_save_image( sound_font, out_data, size );
+    tsf_close( sound_font );
+    *out_size = size;
+    return out_data;
+}
+
+
+// Loads an uncompressed 8- or 16-bit, mono or stereo, .wav file and encodes it to a `internal_pixie_sound_t` header
+// followed by IMA ADPCM blocks. Sounds are played at their own sample rate, resampled to the rate of the sound device.
+
+void* build_sound( char const* filenames[], int count, int* out_size ) {
+    if( count != 1 ) return 0;
+
+    int in_size = 0;
+    u8* in_data = (u8*) load_binary_file( filenames[ 0 ], &in_size );
+    if( !in_data ) return NULL;
+
+    if( in_size < 12 || memcmp( in_data, "RIFF", 4 ) != 0 || memcmp( in_data + 8, "WAVE", 4 ) != 0 ) {
+        free_binary_file( in_data );
+        return NULL;
+    }
+
+    int format = 0;
+    int channels = 0;
+    int sample_rate = 0;
+    int bits = 0;
+    u8 const* data = NULL;
+    int data_size = 0;
+    int pos = 12;
+    while( pos + 8 <= in_size ) {
+        u8 const* chunk = in_data + pos;
+        int chunk_size = (int)( chunk[ 4 ] | ( chunk[ 5 ] << 8 ) | ( chunk[ 6 ] << 16 ) | ( (u32) chunk[ 7 ] << 24 ) );
+        if( chunk_size < 0 || chunk_size > in_size - pos - 8 ) chunk_size = in_size - pos - 8;
+        if( memcmp( chunk, "fmt ", 4 ) == 0 && chunk_size >= 16 ) {
+            format = chunk[ 8 ] | ( chunk[ 9 ] << 8 );
+            channels = chunk[ 10 ] | ( chunk[ 11 ] << 8 );
+            sample_rate = (int)( chunk[ 12 ] | ( chunk[ 13 ] << 8 ) | ( chunk[ 14 ] << 16 ) | 
+                ( (u32) chunk[ 15 ] << 24 ) );
+            bits = chunk[ 22 ] | ( chunk[ 23 ] << 8 );
+        } else if( memcmp( chunk, "data", 4 ) == 0 ) {
+            data = chunk + 8;
+            data_size = chunk_size;
+        }
+        pos += 8 + chunk_size + ( chunk_size & 1 ); // Chunks are padded to even sizes
+    }
+
+    if( format != 1 || ( channels != 1 && channels != 2 ) || ( bits != 8 && bits != 16 ) || sample_rate <= 0 || 
+        !data ) {
+        free_binary_file( in_data );
+        return NULL;
+    }
+
+    // Convert to 16-bit, rounded up to whole ADPCM blocks so the encoder never reads outside of the buffer
+    int const samples_per_block = INTERNAL_PIXIE_SOUND_ADPCM_BLOCK;
+    int length = data_size / ( channels * bits / 8 );
+    int block_count = ( length + samples_per_block - 1 ) / samples_per_block;
+    i16* samples = (i16*) malloc( sizeof( i16 ) * channels * ( (size_t) block_count * samples_per_block + 1 ) );
+    for( int i = 0; i < length * channels; ++i ) {
+        samples[ i ] = bits == 8 ? (i16)( ( data[ i ] - 128 ) << 8 ) : 
+            (i16)( data[ i * 2 ] | ( data[ i * 2 + 1 ] << 8 ) );
+    }
+    free_binary_file( in_data );
+
+    internal_pixie_sound_t header;
+    memset( &header, 0, sizeof( header ) );
+    memcpy( header.id, INTERNAL_PIXIE_SOUND_ID, sizeof( header.id ) );
+    header.sample_rate = sample_rate;
+    header.channels = channels;
+    header.samples_per_block = samples_per_block;
+    header.block_size = adpcm_block_size( channels, samples_per_block );
+    header.length = length;
+
+    size_t data_out_size = (size_t) header.block_size * block_count;
+    u8* out_data = (u8*) malloc( sizeof( header ) + data_out_size );
+    memcpy( out_data, &header, sizeof( header ) );
+    int step_indices[ 2 ] = { 0, 0 };
+    for( int i = 0; i < block_count; ++i ) {
+        int block_samples = length - i * samples_per_block;
+        block_samples = block_samples > samples_per_block ? samples_per_block : block_samples;
+        adpcm_encode_block( samples + i * samples_per_block * channels, block_samples, channels, samples_per_block, 
+            step_indices, out_data + sizeof( header ) + i * header.block_size );
+    }
+    free( samples );
+
+    *out_size = (int)( sizeof( header ) + data_out_size );
+    return out_data;
+}
+
+
 void* build_text( char const* filenames[], int count, int* out_size ) {
     if( count != 1 ) return 0;
 
@@ -630,6 +1064,19 @@ void internal_pixie_free_file_list( char** filenames, int count ) {
 
 int internal_pixie_load_bundle( char const* filename, char const* time, char const* definitions, int count );
 
+// Bump this whenever the output of any of the built-in asset build functions change
+static int const internal_pixie_build_format_version = 6;
+
+
+int internal_pixie_asset_type_equal( char const* a, char const* b ) {
+    #ifdef _WIN32
+        return stricmp( a, b ) == 0;
+    #else
+        return strcasecmp( a, b ) == 0;
+    #endif
+}
+
+
 int internal_pixie_calculate_hash( char const* filenames[], int count, u32* out_crc ) {
     u32 crc = 0;
     for( int i = 0; i < count; ++i ) {
@@ -675,7 +1122,12 @@ int internal_pixie_build_and_load_assets( char const* bundle_filename, char cons
     register_asset_type( "PALETTE", build_palette );
     register_asset_type( "SPRITE", build_sprite );
     register_asset_type( "SONG", build_song );
+    register_asset_type( "SONG_PRERENDERED", build_song_rendered );
+    register_asset_type( "SONG_PRERENDERED_ADPCM", build_song_rendered_adpcm );
+    register_asset_type( "SOUNDFONT", build_soundfont );
+    register_asset_type( "SOUND", build_sound );
     register_asset_type( "FONT", build_font );
+    register_asset_type( "TILESET", build_tileset );
 
     char parsed_bundle_filename[ 256 ];
 
@@ -722,6 +1174,8 @@ int internal_pixie_build_and_load_assets( char const* bundle_filename, char cons
 
     memcpy( internal_pixie_palette_for_build_sprite, default_palette(), 
         sizeof( internal_pixie_palette_for_build_sprite ) );
+    *internal_pixie_soundfont_for_build_song = '\0';
+    internal_pixie_soundfont_hash_for_build_song = 0;
 
     int running_offset = (int) ftell( bundle );
     for( int i = 0; i < count; ++i ) {
@@ -731,11 +1185,7 @@ int internal_pixie_build_and_load_assets( char const* bundle_filename, char cons
         void* data = NULL;
         asset_build_function_t build_function = NULL;
         for( int j = 0; j < pixie->build.count; ++j ) {
-            #ifdef _WIN32
-            if( stricmp( items[ i ].type, pixie->build.types[ j ].name ) == 0 ) {
-            #else
-            if( strcasecmp( items[ i ].type, pixie->build.types[ j ].name ) == 0 ) {
-            #endif
+            if( internal_pixie_asset_type_equal( items[ i ].type, pixie->build.types[ j ].name ) ) {
                 build_function = pixie->build.types[ j ].func;
                 break;
             }
@@ -751,6 +1201,37 @@ int internal_pixie_build_and_load_assets( char const* bundle_filename, char cons
                 free( file_list );
                 return EXIT_FAILURE;
             }
+            // The same source file can be built as different asset types, so the type is part of the hash too, as
+            // is the format version, so that assets built by an older version of pixie gets rebuilt
+            source_hash = crc32( (uint8_t const*) items[ i ].type, strlen( items[ i ].type ), source_hash );
+            source_hash = crc32( (uint8_t const*) &internal_pixie_build_format_version, 
+                sizeof( internal_pixie_build_format_version ), source_hash );
+            memcpy( internal_pixie_params_for_build, items[ i ].params, sizeof( internal_pixie_params_for_build ) );
+            internal_pixie_params_count_for_build = items[ i ].params_count;
+            if( items[ i ].params_count > 0 ) {
+                source_hash = crc32( (uint8_t const*) items[ i ].params, sizeof( int ) * items[ i ].params_count, 
+                    source_hash );
+            }
+
+            // Pre-rendered songs are synthesized with the most recent SOUNDFONT asset, so they need rebuilding when it
+            // changes. It is tracked here rather than in `build_soundfont`, as that is not called for cached assets.
+            if( internal_pixie_asset_type_equal( items[ i ].type, "SOUNDFONT" ) && files_count == 1 ) {
+                if( strlen( filenames[ 0 ] ) >= sizeof( internal_pixie_soundfont_for_build_song ) ) {
+                    printf( "\n\nSoundfont path '%s' is too long (max %d characters)\n", filenames[ 0 ], 
+                        (int) sizeof( internal_pixie_soundfont_for_build_song ) - 1 );
+                    internal_pixie_free_file_list( (char**)filenames, files_count );
+                    free( items );
+                    free( file_list );
+                    return EXIT_FAILURE;
+                }
+                strncpy( internal_pixie_soundfont_for_build_song, filenames[ 0 ], 
+                    sizeof( internal_pixie_soundfont_for_build_song ) - 1 );
+                internal_pixie_soundfont_hash_for_build_song = source_hash;
+            } else if( internal_pixie_asset_type_equal( items[ i ].type, "SONG_PRERENDERED" ) || 
+                internal_pixie_asset_type_equal( items[ i ].type, "SONG_PRERENDERED_ADPCM" ) ) {
+                source_hash = crc32( (uint8_t const*) &internal_pixie_soundfont_hash_for_build_song, 
+                    sizeof( internal_pixie_soundfont_hash_for_build_song ), source_hash );
+            }
             if( !rebuild_all ) {
                 for( int j = 0; j < pixie->assets.count; ++j ) {
                     if( pixie->assets.assets[ j ].crc == source_hash ) {
@@ -781,6 +1262,12 @@ int internal_pixie_build_and_load_assets( char const* bundle_filename, char cons
             return EXIT_FAILURE;
         }
 
+        // Each asset starts at an 8-byte aligned offset, so that assets like soundfont images can be used in place
+        static u8 const padding[ 8 ] = { 0 };
+        int aligned_offset = ( running_offset + 7 ) & ~7;
+        fwrite( padding, 1, (size_t)( aligned_offset - running_offset ), bundle );
+        running_offset = aligned_offset;
+
         file_list[ i ].id = i;
         file_list[ i ].crc = source_hash;
         file_list[ i ].offset = running_offset;
@@ -11,7 +11,7 @@
 
    [OPTIONAL] #define TSF_NO_STDIO to remove stdio dependency
    [OPTIONAL] #define TSF_MALLOC, TSF_REALLOC, and TSF_FREE to avoid stdlib.h
-   [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET to avoid string.h
+   [OPTIONAL] #define TSF_MEMCPY, TSF_MEMSET, TSF_MEMCMP to avoid string.h
    [OPTIONAL] #define TSF_POW, TSF_POWF, TSF_EXPF, TSF_LOG, TSF_TAN, TSF_LOG10, TSF_SQRT to avoid math.h
 
    NOT YET IMPLEMENTED
@@ -89,6 +89,22 @@ struct tsf_stream
 // Generic SoundFont loading method using the stream structure above
 TSFDEF tsf* tsf_load(struct tsf_stream* stream);
 
+// Save a loaded SoundFont as a flat image, which can be loaded with tsf_load_image without any parsing.
+// Returns the size of the image in bytes, and only writes it to buffer if it is not NULL and size is large enough.
+// The image holds structures as laid out in memory, so it can only be loaded by code built the same way.
+TSFDEF int tsf_save_image(const tsf* f, void* buffer, int size);
+
+// Load a SoundFont image created by tsf_save_image. Preset regions and samples are used directly from the image
+// rather than copied (unless the image is not 4-byte aligned), so the image must stay valid until the tsf instance
+// and all copies of it are closed. Returns NULL if the data is not a valid image.
+TSFDEF tsf* tsf_load_image(const void* image, int size);
+
+// Copy a tsf instance from an existing one, use tsf_close to close it as well.
+// All copied tsf instances and their original instance are linked, and share the underlying soundfont.
+// This allows loading a soundfont only once, but using it for multiple independent playbacks.
+// (This function isn't thread-safe without locking.)
+TSFDEF tsf* tsf_copy(tsf* f);
+
 // Free the memory related to this tsf instance
 TSFDEF void tsf_close(tsf* f);
 
@@ -232,10 +248,11 @@ TSFDEF float tsf_channel_get_tuning(tsf* f, int channel);
 #  define TSF_REALLOC realloc
 #endif
 
-#if !defined(TSF_MEMCPY) || !defined(TSF_MEMSET)
+#if !defined(TSF_MEMCPY) || !defined(TSF_MEMSET) || !defined(TSF_MEMCMP)
 #  include <string.h>
 #  define TSF_MEMCPY  memcpy
 #  define TSF_MEMSET  memset
+#  define TSF_MEMCMP  memcmp
 #endif
 
 #if !defined(TSF_POW) || !defined(TSF_POWF) || !defined(TSF_EXPF) || !defined(TSF_LOG) || !defined(TSF_TAN) || !defined(TSF_LOG10) || !defined(TSF_SQRT)
@@ -285,8 +302,14 @@ struct tsf
 	struct tsf_voice* voices;
 	struct tsf_channels* channels;
 	float* outputSamples;
+	int* refCount;
+	unsigned short* presetHash; // Preset index + 1 for each bank/preset hash slot, 0 for empty slots
+	void* image; // Set when loaded with tsf_load_image, and only owned (freed on close) if it had to be copied
+	TSF_BOOL imageOwned;
 
 	int presetNum;
+	int presetHashSize;
+	unsigned int fontSampleCount;
 	int voiceNum;
 	int outputSampleSize;
 	unsigned int voicePlayIndex;
@@ -1090,6 +1113,32 @@ static void tsf_voice_render(tsf* f, struct tsf_voice* v, float* outputBuffer, i
 	if (tmpLowpass.active || dynamicLowpass) v->lowpass = tmpLowpass;
 }
 
+static unsigned int tsf_preset_hash(int bank, int preset_number, int hashSize)
+{
+	return ((((unsigned int)bank << 8) ^ (unsigned int)preset_number) * 2654435761u >> 16) & (unsigned int)(hashSize - 1);
+}
+
+static void tsf_build_preset_hash(tsf* f)
+{
+	int i;
+	f->presetHashSize = 16;
+	while (f->presetHashSize < f->presetNum * 2) f->presetHashSize *= 2;
+	f->presetHash = (unsigned short*)TSF_MALLOC(f->presetHashSize * sizeof(unsigned short));
+	if (!f->presetHash) { f->presetHashSize = 0; return; }
+	TSF_MEMSET(f->presetHash, 0, f->presetHashSize * sizeof(unsigned short));
+	for (i = 0; i < f->presetNum && i < 0xffff; i++)
+	{
+		unsigned int slot = tsf_preset_hash(f->presets[i].bank, f->presets[i].preset, f->presetHashSize);
+		for (;; slot = (slot + 1) & (f->presetHashSize - 1))
+		{
+			const struct tsf_preset* other;
+			if (!f->presetHash[slot]) { f->presetHash[slot] = (unsigned short)(i + 1); break; }
+			other = &f->presets[f->presetHash[slot] - 1];
+			if (other->bank == f->presets[i].bank && other->preset == f->presets[i].preset) break; // keep the first one
+		}
+	}
+}
+
 TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 {
 	tsf* res = TSF_NULL;
@@ -1162,9 +1211,11 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 		res->presetNum = hydra.phdrNum - 1;
 		res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetNum * sizeof(struct tsf_preset));
 		res->fontSamples = fontSamples;
+		res->fontSampleCount = fontSampleCount;
 		res->outSampleRate = 44100.0f;
 		fontSamples = TSF_NULL; //don't free below
 		tsf_load_presets(res, &hydra, fontSampleCount);
+		tsf_build_preset_hash(res);
 	}
 	TSF_FREE(hydra.phdrs); TSF_FREE(hydra.pbags); TSF_FREE(hydra.pmods);
 	TSF_FREE(hydra.pgens); TSF_FREE(hydra.insts); TSF_FREE(hydra.ibags);
@@ -1173,14 +1224,178 @@ TSFDEF tsf* tsf_load(struct tsf_stream* stream)
 	return res;
 }
 
+struct tsf_image_header
+{
+	char id[8];
+	int presetSize, regionSize, presetNum, regionNum, presetHashSize;
+	unsigned int fontSampleCount;
+};
+
+struct tsf_image_preset
+{
+	tsf_char20 presetName;
+	tsf_u16 preset, bank;
+	int regionOffset, regionNum;
+};
+
+#define TSF_IMAGE_ID "TSFIMG01"
+
+static int tsf_image_layout(const struct tsf_image_header* header, int* regionsPos, int* hashPos, int* samplesPos)
+{
+	*regionsPos = (int)sizeof(struct tsf_image_header) + header->presetNum * (int)sizeof(struct tsf_image_preset);
+	*hashPos = *regionsPos + header->regionNum * (int)sizeof(struct tsf_region);
+	*samplesPos = *hashPos + ((header->presetHashSize * (int)sizeof(unsigned short) + 3) & ~3);
+	return *samplesPos + (int)(header->fontSampleCount * sizeof(float));
+}
+
+TSFDEF int tsf_save_image(const tsf* f, void* buffer, int size)
+{
+	struct tsf_image_header header;
+	int i, regionNum = 0, regionsPos, hashPos, samplesPos, imageSize;
+	for (i = 0; i < f->presetNum; i++) regionNum += f->presets[i].regionNum;
+	TSF_MEMSET(&header, 0, sizeof(header));
+	TSF_MEMCPY(header.id, TSF_IMAGE_ID, sizeof(header.id));
+	header.presetSize = (int)sizeof(struct tsf_image_preset);
+	header.regionSize = (int)sizeof(struct tsf_region);
+	header.presetNum = f->presetNum;
+	header.regionNum = regionNum;
+	header.presetHashSize = f->presetHash ? f->presetHashSize : 0;
+	header.fontSampleCount = f->fontSampleCount;
+	imageSize = tsf_image_layout(&header, &regionsPos, &hashPos, &samplesPos);
+	if (buffer && size >= imageSize)
+	{
+		char* out = (char*)buffer;
+		struct tsf_image_preset* presets = (struct tsf_image_preset*)(out + sizeof(header));
+		TSF_MEMSET(out, 0, imageSize);
+		TSF_MEMCPY(out, &header, sizeof(header));
+		for (i = 0, regionNum = 0; i < f->presetNum; i++)
+		{
+			TSF_MEMCPY(presets[i].presetName, f->presets[i].presetName, sizeof(tsf_char20));
+			presets[i].preset = f->presets[i].preset;
+			presets[i].bank = f->presets[i].bank;
+			presets[i].regionOffset = regionNum;
+			presets[i].regionNum = f->presets[i].regionNum;
+			TSF_MEMCPY(out + regionsPos + regionNum * sizeof(struct tsf_region), f->presets[i].regions, f->presets[i].regionNum * sizeof(struct tsf_region));
+			regionNum += f->presets[i].regionNum;
+		}
+		if (header.presetHashSize) TSF_MEMCPY(out + hashPos, f->presetHash, header.presetHashSize * sizeof(unsigned short));
+		TSF_MEMCPY(out + samplesPos, f->fontSamples, f->fontSampleCount * sizeof(float));
+	}
+	return imageSize;
+}
+
+// The preset hash of an image is used as-is, so every slot must refer to an existing preset, and there must be at least
+// one empty slot for lookups of missing presets to stop at
+static int tsf_image_preset_hash_valid(const unsigned short* hash, int hashSize, int presetNum)
+{
+	int i, empty = 0;
+	for (i = 0; i < hashSize; i++)
+	{
+		if (hash[i] > presetNum) return TSF_FALSE;
+		if (!hash[i]) empty = 1;
+	}
+	return empty;
+}
+
+TSFDEF tsf* tsf_load_image(const void* image, int size)
+{
+	struct tsf_image_header header;
+	const struct tsf_image_preset* presets;
+	char* data;
+	tsf* res;
+	int i, regionsPos, hashPos, samplesPos;
+	if (!image || size < (int)sizeof(header)) return TSF_NULL;
+	TSF_MEMCPY(&header, image, sizeof(header));
+	if (TSF_MEMCMP(header.id, TSF_IMAGE_ID, sizeof(header.id)) || header.presetSize != (int)sizeof(struct tsf_image_preset)
+		|| header.regionSize != (int)sizeof(struct tsf_region) || header.presetNum < 0 || header.regionNum < 0
+		|| (header.presetHashSize & (header.presetHashSize - 1)) || header.presetHashSize > 0xffff
+		|| tsf_image_layout(&header, &regionsPos, &hashPos, &samplesPos) > size) return TSF_NULL;
+
+	res = (tsf*)TSF_MALLOC(sizeof(tsf));
+	if (!res) return TSF_NULL;
+	TSF_MEMSET(res, 0, sizeof(tsf));
+
+	// The regions and samples are used in place, which requires them to be aligned
+	data = (char*)image;
+	if (((size_t)image) & 3)
+	{
+		data = (char*)TSF_MALLOC(size);
+		if (!data) { TSF_FREE(res); return TSF_NULL; }
+		TSF_MEMCPY(data, image, size);
+		res->imageOwned = TSF_TRUE;
+	}
+	res->image = data;
+
+	res->presetNum = header.presetNum;
+	res->presets = (struct tsf_preset*)TSF_MALLOC(res->presetNum * sizeof(struct tsf_preset) + 1);
+	if (!res->presets) { tsf_close(res); return TSF_NULL; }
+	presets = (const struct tsf_image_preset*)(data + sizeof(header));
+	for (i = 0; i < res->presetNum; i++)
+	{
+		if (presets[i].regionOffset < 0 || presets[i].regionNum < 0 || presets[i].regionOffset + presets[i].regionNum > header.regionNum)
+		{
+			res->presetNum = i;
+			tsf_close(res);
+			return TSF_NULL;
+		}
+		TSF_MEMCPY(res->presets[i].presetName, presets[i].presetName, sizeof(tsf_char20));
+		res->presets[i].preset = presets[i].preset;
+		res->presets[i].bank = presets[i].bank;
+		res->presets[i].regions = (struct tsf_region*)(data + regionsPos) + presets[i].regionOffset;
+		res->presets[i].regionNum = presets[i].regionNum;
+	}
+	// If the hash is damaged, fall back to searching the presets linearly
+	if (header.presetHashSize && tsf_image_preset_hash_valid((unsigned short*)(data + hashPos), header.presetHashSize, res->presetNum))
+	{
+		res->presetHashSize = header.presetHashSize;
+		res->presetHash = (unsigned short*)(data + hashPos);
+	}
+	res->fontSamples = (float*)(data + samplesPos);
+	res->fontSampleCount = header.fontSampleCount;
+	res->outSampleRate = 44100.0f;
+	return res;
+}
+
+TSFDEF tsf* tsf_copy(tsf* f)
+{
+	tsf* res;
+	if (!f) return TSF_NULL;
+	if (!f->refCount)
+	{
+		f->refCount = (int*)TSF_MALLOC(sizeof(int));
+		if (!f->refCount) return TSF_NULL;
+		*f->refCount = 1;
+	}
+	res = (tsf*)TSF_MALLOC(sizeof(tsf));
+	if (!res) return TSF_NULL;
+	TSF_MEMCPY(res, f, sizeof(tsf));
+	res->voices = TSF_NULL;
+	res->voiceNum = 0;
+	res->channels = TSF_NULL;
+	res->outputSamples = TSF_NULL;
+	res->outputSampleSize = 0;
+	(*res->refCount)++;
+	return res;
+}
+
 TSFDEF void tsf_close(tsf* f)
 {
 	struct tsf_preset *preset, *presetEnd;
 	if (!f) return;
-	for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
-		TSF_FREE(preset->regions);
-	TSF_FREE(f->presets);
-	TSF_FREE(f->fontSamples);
+	if (!f->refCount || !--(*f->refCount))
+	{
+		// For instances loaded from an image, the regions, samples and hash live in the image memory
+		if (!f->image)
+		{
+			for (preset = f->presets, presetEnd = preset + f->presetNum; preset != presetEnd; preset++)
+				TSF_FREE(preset->regions);
+			TSF_FREE(f->fontSamples);
+			TSF_FREE(f->presetHash);
+		}
+		else if (f->imageOwned) TSF_FREE(f->image);
+		TSF_FREE(f->presets);
+		TSF_FREE(f->refCount);
+	}
 	TSF_FREE(f->voices);
 	if (f->channels) { TSF_FREE(f->channels->channels); TSF_FREE(f->channels); }
 	TSF_FREE(f->outputSamples);
@@ -1200,6 +1415,17 @@ TSFDEF int tsf_get_presetindex(const tsf* f, int bank, int preset_number)
 {
 	const struct tsf_preset *presets;
 	int i, iMax;
+	if (f->presetHash)
+	{
+		unsigned int slot = tsf_preset_hash(bank, preset_number, f->presetHashSize);
+		for (; f->presetHash[slot]; slot = (slot + 1) & (f->presetHashSize - 1))
+		{
+			i = f->presetHash[slot] - 1;
+			if (f->presets[i].preset == preset_number && f->presets[i].bank == bank)
+				return i;
+		}
+		if (f->presetNum < 0xffff) return -1;
+	}
 	for (presets = f->presets, i = 0, iMax = f->presetNum; i < iMax; i++)
 		if (presets[i].preset == preset_number && presets[i].bank == bank)
 			return i;
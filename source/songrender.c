@@ -0,0 +1,276 @@
+/*
+    Song render tool
+    ----------------
+
+    Renders a song asset from a built bundle to a WAV file, through the same mid/tsf synthesis path that the engine
+    uses for playback, but as fast as the CPU allows and without opening a window or an audio device. It reports the
+    time spent per second of audio, the peak number of active voices and the cost of the most expensive block, and
+    prints a checksum of the rendered samples, so it can be used both as a synthesis benchmark and as a bit-exact
+    regression test for music.
+
+    Run it from the `runtime` folder, on a bundle built by a pixie program:
+
+        songrender data.dat                     lists the song assets in the bundle
+        songrender data.dat 2 song.wav          renders asset 2 to song.wav
+        songrender data.dat 2 song.wav 48000    renders asset 2 at 48000 Hz instead of the rate of the song
+
+    Songs are rendered with the first soundfont asset found in the bundle, or the default soundfont if there is none.
+    Audio is generated in blocks of one 60 Hz frame, and the checksum is only comparable between renders with the same
+    sample rate.
+*/
+
+#define PIXIE_NO_MAIN
+#include "pixie.h"
+
+#define PIXIE_IMPLEMENTATION
+#include "pixie.h"
+
+
+// Once all song events have been processed, voices are allowed to ring out for at most this many seconds
+#define SONGRENDER_MAX_TAIL_SECONDS 10
+
+
+// Same layout as the bundle header written by `internal_pixie_build_bundle` and read by `internal_pixie_load_bundle`
+
+typedef struct songrender_bundle_header_t {
+    char file_id[ 20 ];
+    int header_size;
+    int assets_count;
+    char bundle_file[ 256 ];
+    char definitions_file[ 256 ];
+    char build_time[ 64 ];
+} songrender_bundle_header_t;
+
+typedef struct songrender_bundle_asset_t { int id; u32 crc; int offset; int size; } songrender_bundle_asset_t;
+
+
+typedef struct songrender_bundle_t {
+    mmap_t* mmap;
+    int count;
+    songrender_bundle_asset_t const* assets;
+} songrender_bundle_t;
+
+
+// Maps the bundle file into memory, checking that the header and asset table are consistent with the file size
+
+static int songrender_open_bundle( songrender_bundle_t* bundle, char const* filename ) {
+    struct stat s;
+    if( stat( filename, &s ) ) return EXIT_FAILURE;
+
+    bundle->mmap = mmap_open_read_only( filename, (size_t) s.st_size );
+    if( !bundle->mmap ) return EXIT_FAILURE;
+
+    songrender_bundle_header_t const* header = (songrender_bundle_header_t const*) mmap_data( bundle->mmap );
+    if( mmap_size( bundle->mmap ) < sizeof( *header ) || header->header_size != sizeof( *header ) ||
+        strcmp( header->file_id, "PIXIE_ASSETS_BUNDLE" ) != 0 || header->assets_count < 0 ||
+        sizeof( *header ) + sizeof( songrender_bundle_asset_t ) * header->assets_count > mmap_size( bundle->mmap ) ) {
+        mmap_close( bundle->mmap );
+        return EXIT_FAILURE;
+    }
+
+    bundle->count = header->assets_count;
+    bundle->assets = (songrender_bundle_asset_t const*)( header + 1 );
+    for( int i = 0; i < bundle->count; ++i ) {
+        if( bundle->assets[ i ].offset < 0 || bundle->assets[ i ].size < 0 ||
+            (size_t) bundle->assets[ i ].offset + bundle->assets[ i ].size > mmap_size( bundle->mmap ) ) {
+            mmap_close( bundle->mmap );
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+
+static void const* songrender_find_asset( songrender_bundle_t* bundle, int id, int* size ) {
+    *size = bundle->assets[ id ].size;
+    return (void const*)( ( (uintptr_t) mmap_data( bundle->mmap ) ) + bundle->assets[ id ].offset );
+}
+
+
+// Loads the first soundfont in the bundle, the same way `set_soundfont` does, or the default one if there is none
+
+static tsf* songrender_load_soundfont( songrender_bundle_t* bundle ) {
+    for( int i = 0; i < bundle->count; ++i ) {
+        int size = 0;
+        void const* data = songrender_find_asset( bundle, i, &size );
+        tsf* sound_font = tsf_load_image( data, size );
+        if( sound_font ) {
+            printf( "Using soundfont asset %d\n", i );
+            return sound_font;
+        }
+    }
+
+    int soundfont_size = 0;
+    u8 const* soundfont = default_soundfont( &soundfont_size );
+    printf( "Using default soundfont\n" );
+    return tsf_load_memory( soundfont, soundfont_size );
+}
+
+
+static int songrender_is_song( void const* data, int size ) {
+    internal_pixie_song_pcm_t const* pcm = (internal_pixie_song_pcm_t const*) data;
+    if( size >= (int) sizeof( *pcm ) && memcmp( pcm->id, INTERNAL_PIXIE_SONG_PCM_ID, sizeof( pcm->id ) ) == 0 ) {
+        return 2;
+    }
+    mid_t mid;
+    return mid_init_raw( &mid, data, (size_t) size ) ? 1 : 0;
+}
+
+
+static void songrender_list_songs( songrender_bundle_t* bundle ) {
+    for( int i = 0; i < bundle->count; ++i ) {
+        int size = 0;
+        void const* data = songrender_find_asset( bundle, i, &size );
+        int song = songrender_is_song( data, size );
+        if( song == 1 ) {
+            mid_t mid;
+            mid_init_raw( &mid, data, (size_t) size );
+            printf( "%4d  midi song, %d events, %.1f seconds\n", i, mid.song.event_count,
+                (double) mid.song.length / mid.song.sample_rate );
+        } else if( song == 2 ) {
+            printf( "%4d  pre-rendered song (not synthesized)\n", i );
+        }
+    }
+}
+
+
+static void songrender_write_u32( FILE* fp, u32 value ) {
+    u8 bytes[ 4 ] = { (u8)( value ), (u8)( value >> 8 ), (u8)( value >> 16 ), (u8)( value >> 24 ) };
+    fwrite( bytes, 1, sizeof( bytes ), fp );
+}
+
+
+static void songrender_write_u16( FILE* fp, u16 value ) {
+    u8 bytes[ 2 ] = { (u8)( value ), (u8)( value >> 8 ) };
+    fwrite( bytes, 1, sizeof( bytes ), fp );
+}
+
+
+// Writes the samples as a 16-bit stereo PCM WAV file
+
+static int songrender_write_wav( char const* filename, i16 const* samples, int sample_pairs_count, int sample_rate ) {
+    FILE* fp = fopen( filename, "wb" );
+    if( !fp ) return EXIT_FAILURE;
+
+    u32 data_size = (u32) sample_pairs_count * 2 * sizeof( i16 );
+    fwrite( "RIFF", 1, 4, fp );
+    songrender_write_u32( fp, 36 + data_size );
+    fwrite( "WAVEfmt ", 1, 8, fp );
+    songrender_write_u32( fp, 16 );
+    songrender_write_u16( fp, 1 ); // PCM
+    songrender_write_u16( fp, 2 ); // Channels
+    songrender_write_u32( fp, (u32) sample_rate );
+    songrender_write_u32( fp, (u32) sample_rate * 2 * sizeof( i16 ) ); // Bytes per second
+    songrender_write_u16( fp, 2 * sizeof( i16 ) ); // Bytes per sample pair
+    songrender_write_u16( fp, 16 ); // Bits per sample
+    fwrite( "data", 1, 4, fp );
+    songrender_write_u32( fp, data_size );
+    for( int i = 0; i < sample_pairs_count * 2; ++i ) songrender_write_u16( fp, (u16) samples[ i ] );
+
+    int error = ferror( fp );
+    fclose( fp );
+    return error ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+
+int main( int argc, char** argv ) {
+    if( argc < 2 ) {
+        printf( "Usage: songrender bundle [song_asset output.wav [sample_rate]]\n" );
+        return EXIT_FAILURE;
+    }
+
+    songrender_bundle_t bundle;
+    if( songrender_open_bundle( &bundle, argv[ 1 ] ) != EXIT_SUCCESS ) {
+        printf( "Could not open bundle '%s'\n", argv[ 1 ] );
+        return EXIT_FAILURE;
+    }
+
+    if( argc < 4 ) {
+        songrender_list_songs( &bundle );
+        mmap_close( bundle.mmap );
+        return EXIT_SUCCESS;
+    }
+
+    int asset = atoi( argv[ 2 ] );
+    int size = 0;
+    void const* data = asset >= 0 && asset < bundle.count ? songrender_find_asset( &bundle, asset, &size ) : NULL;
+    mid_t mid;
+    if( !data || songrender_is_song( data, size ) != 1 || !mid_init_raw( &mid, data, (size_t) size ) ) {
+        printf( "Asset %s is not a midi song\n", argv[ 2 ] );
+        mmap_close( bundle.mmap );
+        return EXIT_FAILURE;
+    }
+    int sample_rate = argc > 4 ? atoi( argv[ 4 ] ) : mid.song.sample_rate;
+    sample_rate = sample_rate > 0 ? sample_rate : mid.song.sample_rate;
+
+    tsf* sound_font = songrender_load_soundfont( &bundle );
+    if( !sound_font ) {
+        printf( "Could not load soundfont\n" );
+        mmap_close( bundle.mmap );
+        return EXIT_FAILURE;
+    }
+
+    // Set up the song and synth exactly like `internal_pixie_start_song` does
+    mid_set_output_rate( &mid, sample_rate );
+    tsf_reset( sound_font );
+    tsf_channel_set_bank_preset( sound_font, 9, 128, 0 );
+    tsf_set_output( sound_font, TSF_STEREO_INTERLEAVED, sample_rate, 0.0f );
+    mid_skip_leading_silence( &mid, sound_font );
+
+    // Render in blocks of one frame, as the audio callback would, timing each block. Once all events have been
+    // processed, rendering continues until all voices have finished, so the release of the last notes is included.
+    int const block_size = sample_rate / 60;
+    int const max_tail = sample_rate * SONGRENDER_MAX_TAIL_SECONDS;
+    int capacity = sample_rate * 60;
+    int count = 0;
+    int tail = 0;
+    i16* samples = (i16*) malloc( sizeof( i16 ) * 2 * (size_t) capacity );
+    u64 const freq = app_time_count( NULL ) ? app_time_freq( NULL ) : 0;
+    u64 total_time = 0;
+    u64 peak_block_time = 0;
+    int peak_voices = 0;
+    while( mid.playback_event_pos < mid.song.event_count ||
+        ( tail < max_tail && tsf_active_voice_count( sound_font ) > 0 ) ) {
+        if( count + block_size > capacity ) {
+            capacity *= 2;
+            samples = (i16*) realloc( samples, sizeof( i16 ) * 2 * (size_t) capacity );
+        }
+
+        u64 start = app_time_count( NULL );
+        mid_render_short( &mid, samples + count * 2, block_size, sound_font );
+        u64 block_time = app_time_count( NULL ) - start;
+
+        total_time += block_time;
+        peak_block_time = block_time > peak_block_time ? block_time : peak_block_time;
+        int voices = tsf_active_voice_count( sound_font );
+        peak_voices = voices > peak_voices ? voices : peak_voices;
+        count += block_size;
+        if( mid.playback_event_pos >= mid.song.event_count ) tail += block_size;
+    }
+    tsf_close( sound_font );
+
+    // FNV-1a hash of the rendered samples, to compare renders between builds
+    u32 checksum = 2166136261u;
+    for( int i = 0; i < count * 2; ++i ) {
+        checksum = ( checksum ^ (u8)( samples[ i ] ) ) * 16777619u;
+        checksum = ( checksum ^ (u8)( ( (u16) samples[ i ] ) >> 8 ) ) * 16777619u;
+    }
+
+    double seconds = (double) count / sample_rate;
+    double total_ms = freq ? ( total_time * 1000.0 ) / freq : 0.0;
+    double block_ms = freq ? ( peak_block_time * 1000.0 ) / freq : 0.0;
+    double block_duration_ms = ( block_size * 1000.0 ) / sample_rate;
+    printf( "Rendered %.2f seconds at %d Hz in %.2f ms\n", seconds, sample_rate, total_ms );
+    printf( "Render time:    %.3f ms per second of audio (%.1fx realtime)\n", seconds > 0.0 ? total_ms / seconds : 0.0,
+        total_ms > 0.0 ? ( seconds * 1000.0 ) / total_ms : 0.0 );
+    printf( "Peak voices:    %d\n", peak_voices );
+    printf( "Peak block:     %.3f ms for %d samples (%.1f%% of realtime)\n", block_ms, block_size,
+        ( block_ms * 100.0 ) / block_duration_ms );
+    printf( "Checksum:       %08x\n", checksum );
+
+    int result = songrender_write_wav( argv[ 3 ], samples, count, sample_rate );
+    if( result != EXIT_SUCCESS ) printf( "Could not write '%s'\n", argv[ 3 ] );
+    free( samples );
+    mmap_close( bundle.mmap );
+    return result;
+}
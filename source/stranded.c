@@ -11,7 +11,7 @@
 
 
 ASSETS_BEGIN( "stranded.dat" )
-ASSET_BINARY( SOUNDFONT, "stranded/AweROMGM.sf2" )
+ASSET_SOUNDFONT( SOUNDFONT, "stranded/AweROMGM.sf2" )
 ASSET_SONG( SONG, "stranded/stranded.mid" )
 ASSET_FONT( FONT, "stranded/Volter__28Goldfish_29.ttf" )
 ASSET_PALETTE( PALETTE, "stranded/palette.png" )
@@ -153,8 +153,8 @@ int pixmain( int argc, char** argv ) {
 
     int spr_index = 1;
 
-    int background = sprite( spr_index++, -65, 0, BACKGROUND );
-    int treeline = sprite( spr_index++, -65, 0, TREELINE );
+    int background = sprite( spr_index++, 0, 0, BACKGROUND );
+    int treeline = sprite( spr_index++, 0, 0, TREELINE );
     int radio = sprite( spr_index++, 240, 0, RADIO_SPR ); objects_add( &objects, radio );
     int hut1 = sprite( spr_index++, 540, 0, HUT1 ); objects_add( &objects, hut1 );
 	int hut2 = sprite( spr_index++, 850, 20, HUT2 ); objects_add( &objects, hut2 );
@@ -171,6 +171,14 @@ int pixmain( int argc, char** argv ) {
     label_align( interact, TEXT_ALIGN_CENTER );
     label_outline( interact, 0 );
     label_shadow( interact, 0 );
+
+    // Everything in the world is on layer 1, which scrolls with the camera, while the rest stays in place on screen
+    for( int i = 0; i < objects_count( &objects ); ++i )
+        sprite_layer( objects_get( &objects, i ), 1 );
+    sprite_layer( background, 1 );
+    sprite_layer( treeline, 1 );
+    sprite_layer( guy, 1 );
+    sprite_layer( interact, 1 );
     
     int radio_back = sprite( spr_index++, -250, 0, BACKGROUND );
     sprite_hide( radio_back );
@@ -218,15 +226,8 @@ int pixmain( int argc, char** argv ) {
     float anim = 0.0f;
 
 	LOOP {
-		for( int i = 0; i < objects_count( &objects ); ++i )
-            sprite_origin( objects_get( &objects, i ), xpos, 0 );
-
-		sprite_origin( interact, xpos, 0 );
-
-		sprite_origin( guy, xpos, 0 );
+        camera( xpos, 0 );
 		sprite_pos( guy, xpos, sprite_y( guy ) );
-		sprite_pos( background, -xpos, sprite_y( background ) );
-		sprite_pos( treeline, -xpos, sprite_y( treeline ) );			
 
         if( !shown_intro ) {
             wait( 60 );
@@ -243,14 +244,17 @@ int pixmain( int argc, char** argv ) {
 		if( fadeout ) {
             if( --fadeout_delay <= 0 ) {
 			int all_black = 1;
+            rgb_t colors[ 64 ];
+            getcols( 0, 64, colors );
 			for( int i = 0; i < 64; ++i ) {
-				rgb_t c = getcol( i );
+				rgb_t c = colors[ i ];
 				if( c.r > 0 || c.g > 0 || c.b > 0 ) all_black = 0;
 				if( c.r > 0 ) c.r = (u8)( c.r - min( c.r, 3 ) ); 
 				if( c.r < 80 && c.g > 0 ) c.g = (u8)( c.g - min( c.g, 3 ) ); 
 				if( c.g < 80 && c.b > 0 ) c.b = (u8)( c.b - min( c.b, 3 ) ); 
-				setcol( i, c );
+				colors[ i ] = c;
 			}
+            setcols( 0, 64, colors );
 			if( all_black ) end( 0 );
             }
 		}